@@ -0,0 +1,565 @@
+#include "btree.h"
+
+/* Caminho da raiz até a folha percorrido em uma busca */
+typedef struct {
+    int depth;                                      // nós no caminho (o último é a folha)
+    uint32_t blocks[DIR_BTREE_MAX_DEPTH];           // bloco físico de cada nó
+    int pos[DIR_BTREE_MAX_DEPTH];                   // chave seguida em cada nó interno
+    dir_btree_node_t nodes[DIR_BTREE_MAX_DEPTH];
+} btree_path_t;
+
+/* ---- nós ---- */
+static int readNode(uint32_t block, dir_btree_node_t *node) {
+    if (block == 0 || readBlock(block, node) != 0) return -1;
+    if (node->header.magic != DIR_BTREE_MAGIC) return -1;
+    if (node->header.level == 0) return node->header.used <= DIR_BTREE_LEAF_BYTES ? 0 : -1;
+    return node->header.count <= DIR_BTREE_KEYS ? 0 : -1;
+}
+
+/* Nó novo no grupo do diretório */
+static int newNode(int dir_inode, uint8_t level, dir_btree_node_t *node, uint32_t *out_block) {
+    int block = allocateBlock(inodeGroup(dir_inode));
+    if (block < 0) return -1;
+
+    memset(node, 0, sizeof(*node));
+    node->header.magic = DIR_BTREE_MAGIC;
+    node->header.level = level;
+    *out_block = block;
+    return 0;
+}
+
+/* ---- busca ---- */
+/* Última chave do nó interno com nome <= name (a chave 0 cobre o início da faixa) */
+static int keySearch(const dir_btree_node_t *node, const char *name) {
+    int lo = 1, hi = node->header.count - 1, pos = 0;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(node->keys[mid].name, name) <= 0) {
+            pos = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return pos;
+}
+
+/* Deslocamento do primeiro registro da folha com nome >= name (ou do fim dos registros) */
+static size_t leafSeek(const dir_btree_node_t *leaf, const char *name) {
+    size_t offset = 0;
+    const dir_record_t *rec;
+    while ((rec = dirRecordAt(leaf->records, leaf->header.used, offset)) != NULL) {
+        if (dirRecordCompare(rec, name) >= 0) break;
+        offset += rec->rec_len;
+    }
+    return offset;
+}
+
+/* Registro com nome e tipo compatíveis; nomes iguais de tipos diferentes ficam lado a lado
+   e nunca são separados em folhas diferentes. Retorna o deslocamento, -1 se não existe */
+static long leafFind(const dir_btree_node_t *leaf, const char *name, inode_type_t type) {
+    size_t offset = leafSeek(leaf, name);
+    const dir_record_t *rec;
+    while ((rec = dirRecordAt(leaf->records, leaf->header.used, offset)) != NULL) {
+        if (dirRecordCompare(rec, name) != 0) break;
+        if (dirRecordMatches(rec, name, type)) return (long)offset;
+        offset += rec->rec_len;
+    }
+    return -1;
+}
+
+/* Desce da raiz até a folha responsável pelo nome, guardando o caminho */
+static int btreeWalk(int dir_inode, const char *name, btree_path_t *path) {
+    uint32_t block = inode_table[dir_inode].blocks[0];
+
+    for (int d = 0; d < DIR_BTREE_MAX_DEPTH; d++) {
+        dir_btree_node_t *node = &path->nodes[d];
+        if (readNode(block, node) != 0) return -1;
+        if (d > 0 && node->header.level + 1 != path->nodes[d - 1].header.level) return -1;
+        path->blocks[d] = block;
+
+        if (node->header.level == 0) {
+            path->depth = d + 1;
+            return 0;
+        }
+        if (node->header.count == 0) return -1;
+
+        path->pos[d] = keySearch(node, name);
+        block = node->keys[path->pos[d]].block;
+    }
+    return -1;
+}
+
+/* Só lê a folha onde nomes >= name começam (sem guardar o caminho) */
+static int seekLeaf(int dir_inode, const char *name, dir_btree_node_t *leaf) {
+    uint32_t block = inode_table[dir_inode].blocks[0];
+
+    for (int d = 0; d < DIR_BTREE_MAX_DEPTH; d++) {
+        if (readNode(block, leaf) != 0) return -1;
+        if (leaf->header.level == 0) return 0;
+        if (leaf->header.count == 0) return -1;
+        block = leaf->keys[keySearch(leaf, name)].block;
+    }
+    return -1;
+}
+
+int btreeFind(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
+    btree_path_t path;
+    if (btreeWalk(dir_inode, name, &path) != 0) return -1;
+
+    dir_btree_node_t *leaf = &path.nodes[path.depth - 1];
+    long offset = leafFind(leaf, name, type);
+    if (offset < 0) return -1;
+    *out_inode = ((const dir_record_t *)(leaf->records + offset))->inode_index;
+    return 0;
+}
+
+/* ---- inserção ---- */
+static void keyInsertAt(dir_btree_node_t *node, int at, const char *name, uint32_t child) {
+    memmove(&node->keys[at + 1], &node->keys[at],
+            (node->header.count - at) * sizeof(dir_btree_key_t));
+    memset(node->keys[at].name, 0, sizeof(node->keys[at].name));
+    strncpy(node->keys[at].name, name, sizeof(node->keys[at].name) - 1);
+    node->keys[at].block = child;
+    node->header.count++;
+}
+
+/* Há espaço para mais uma chave em algum nó interno do caminho (ou para crescer a árvore)? */
+static int pathHasRoom(const btree_path_t *path) {
+    for (int d = 0; d < path->depth - 1; d++)
+        if (path->nodes[d].header.count < DIR_BTREE_KEYS) return 1;
+    return path->depth < DIR_BTREE_MAX_DEPTH;
+}
+
+/* Insere (nome -> filho) no nó interno de profundidade d, logo após a chave seguida na busca.
+   Um nó cheio é dividido ao meio; quando a raiz se divide, uma raiz nova é criada acima dela
+   e passa a ser o blocks[0] do diretório */
+static int parentInsert(int dir_inode, btree_path_t *path, int d, const char *name, uint32_t child) {
+    if (d < 0) {
+        dir_btree_node_t root;
+        uint32_t root_block;
+        if (newNode(dir_inode, path->nodes[0].header.level + 1, &root, &root_block) != 0) return -1;
+
+        root.header.count = 1;
+        root.keys[0].block = path->blocks[0];
+        keyInsertAt(&root, 1, name, child);
+        if (writeBlock(root_block, &root) != 0) {
+            freeBlock(root_block);
+            return -1;
+        }
+        inode_table[dir_inode].blocks[0] = root_block;
+        return 0;
+    }
+
+    dir_btree_node_t *node = &path->nodes[d];
+    int at = path->pos[d] + 1;
+
+    if (node->header.count < DIR_BTREE_KEYS) {
+        keyInsertAt(node, at, name, child);
+        return writeBlock(path->blocks[d], node);
+    }
+
+    // divide o nó: a metade superior vai para um bloco novo
+    dir_btree_node_t right;
+    uint32_t right_block;
+    if (newNode(dir_inode, node->header.level, &right, &right_block) != 0) return -1;
+
+    int half = node->header.count / 2;
+    right.header.count = node->header.count - half;
+    memcpy(right.keys, &node->keys[half], right.header.count * sizeof(dir_btree_key_t));
+    node->header.count = half;
+    memset(&node->keys[half], 0, (DIR_BTREE_KEYS - half) * sizeof(dir_btree_key_t));
+
+    if (at > half) keyInsertAt(&right, at - half, name, child);
+    else keyInsertAt(node, at, name, child);
+
+    if (writeBlock(right_block, &right) != 0 ||
+        parentInsert(dir_inode, path, d - 1, right.keys[0].name, right_block) != 0) {
+        freeBlock(right_block);
+        return -1;
+    }
+    return writeBlock(path->blocks[d], node);
+}
+
+/* Reempacota entradas já ordenadas em uma folha vazia */
+static void leafFill(dir_btree_node_t *leaf, const dir_entry_t *entries, int count) {
+    size_t used = 0;
+    memset(leaf->records, 0, sizeof(leaf->records));
+    for (int k = 0; k < count; k++)
+        dirRecordInsert(leaf->records, DIR_BTREE_LEAF_BYTES, &used, used,
+                        entries[k].name, entries[k].inode_index, entries[k].type);
+    leaf->header.count = count;
+    leaf->header.used = used;
+}
+
+/* Insere o nome na folha da sua faixa. Com check_existing, a mesma leitura da folha
+   detecta um nome já presente (retorna 1 e o inode em *out_inode) */
+static int btreeInsert(int dir_inode, const char *name, inode_type_t type, int inode_index,
+                       int check_existing, int *out_inode) {
+    btree_path_t path;
+    if (btreeWalk(dir_inode, name, &path) != 0) return -1;
+
+    int d = path.depth - 1;
+    dir_btree_node_t *leaf = &path.nodes[d];
+
+    if (check_existing) {
+        long offset = leafFind(leaf, name, type);
+        if (offset >= 0) {
+            *out_inode = ((const dir_record_t *)(leaf->records + offset))->inode_index;
+            return 1;
+        }
+    }
+    *out_inode = inode_index;
+
+    // depois dos nomes iguais já presentes (de outros tipos)
+    size_t at = leafSeek(leaf, name);
+    const dir_record_t *rec;
+    while ((rec = dirRecordAt(leaf->records, leaf->header.used, at)) != NULL && dirRecordCompare(rec, name) == 0)
+        at += rec->rec_len;
+
+    inode_type_t new_type = inode_table[inode_index].type;
+    size_t used = leaf->header.used;
+    if (dirRecordInsert(leaf->records, DIR_BTREE_LEAF_BYTES, &used, at, name, inode_index, new_type) == 0) {
+        leaf->header.count++;
+        leaf->header.used = used;
+        return writeBlock(path.blocks[d], leaf);
+    }
+
+    // folha cheia: divide pela metade dos bytes, sem separar nomes iguais
+    if (!pathHasRoom(&path)) return -1;
+
+    dir_entry_t all[DIR_MAX_RECORDS_PER_BLOCK + 1];
+    size_t bytes[DIR_MAX_RECORDS_PER_BLOCK + 1], total_bytes = 0, offset = 0;
+    int total = 0, pos = -1;
+    while ((rec = dirRecordAt(leaf->records, leaf->header.used, offset)) != NULL) {
+        if (offset == at) pos = total++;
+        dirRecordToEntry(rec, &all[total]);
+        bytes[total++] = rec->rec_len;
+        offset += rec->rec_len;
+    }
+    if (pos < 0) pos = total++;
+    strcpy(all[pos].name, name);
+    all[pos].inode_index = inode_index;
+    all[pos].type = new_type;
+    bytes[pos] = DIR_RECORD_SIZE(strlen(name));
+    for (int k = 0; k < total; k++) total_bytes += bytes[k];
+
+    // nome novo no fim da última folha (inserção em ordem crescente): a folha antiga fica cheia
+    int split = total - 1;
+    if (pos != total - 1 || leaf->header.next_leaf != 0) {
+        size_t left_bytes = 0;
+        for (split = 0; split < total - 1 && left_bytes + bytes[split] <= total_bytes / 2; split++)
+            left_bytes += bytes[split];
+        if (split == 0) split = 1;
+    }
+    int preferred = split;
+    while (split < total && strcmp(all[split].name, all[split - 1].name) == 0) split++;
+    if (split == total) {
+        split = preferred;
+        while (split > 0 && strcmp(all[split].name, all[split - 1].name) == 0) split--;
+    }
+    if (split == 0) return -1;
+
+    dir_btree_node_t right;
+    uint32_t right_block;
+    if (newNode(dir_inode, 0, &right, &right_block) != 0) return -1;
+
+    leafFill(&right, &all[split], total - split);
+    right.header.next_leaf = leaf->header.next_leaf;
+    leafFill(leaf, all, split);
+    leaf->header.next_leaf = right_block;
+
+    // a folha antiga só é regravada depois que o índice já aponta para a nova
+    if (writeBlock(right_block, &right) != 0 ||
+        parentInsert(dir_inode, &path, d - 1, all[split].name, right_block) != 0) {
+        freeBlock(right_block);
+        return -1;
+    }
+    return writeBlock(path.blocks[d], leaf);
+}
+
+int btreeAdd(int dir_inode, const char *name, int inode_index) {
+    int out_inode;
+    return btreeInsert(dir_inode, name, FILE_ANY, inode_index, 0, &out_inode);
+}
+
+int btreeLookupOrAdd(int dir_inode, const char *name, inode_type_t type, int inode_index, int *out_inode) {
+    return btreeInsert(dir_inode, name, type, inode_index, 1, out_inode);
+}
+
+/* Insere entradas ordenadas por nome. As que caem na mesma folha e cabem nela entram com uma
+   única leitura e uma única escrita da folha; quando ela enche, a entrada seguinte passa pelo
+   caminho normal (com divisão) e o lote continua a partir dali. results[k] recebe 0 (inserida)
+   ou 1 (já existia, inode em entries[k].inode_index) */
+int btreeAddEntries(int dir_inode, dir_entry_t *entries, int count, int *results) {
+    int k = 0;
+    while (k < count) {
+        btree_path_t path;
+        if (btreeWalk(dir_inode, entries[k].name, &path) != 0) return -1;
+
+        int d = path.depth - 1;
+        dir_btree_node_t *leaf = &path.nodes[d];
+
+        // fim da faixa da folha: a chave seguinte no nível mais baixo que tiver uma
+        const char *limit = NULL;
+        for (int up = d - 1; up >= 0 && !limit; up--)
+            if (path.pos[up] + 1 < path.nodes[up].header.count)
+                limit = path.nodes[up].keys[path.pos[up] + 1].name;
+
+        int changed = 0, full = 0;
+        while (k < count && (!limit || strcmp(entries[k].name, limit) < 0)) {
+            dir_entry_t *entry = &entries[k];
+            long found = leafFind(leaf, entry->name, entry->type);
+            if (found >= 0) {
+                entry->inode_index = ((const dir_record_t *)(leaf->records + found))->inode_index;
+                results[k++] = 1;
+                continue;
+            }
+
+            size_t at = leafSeek(leaf, entry->name);
+            const dir_record_t *rec;
+            while ((rec = dirRecordAt(leaf->records, leaf->header.used, at)) != NULL &&
+                   dirRecordCompare(rec, entry->name) == 0)
+                at += rec->rec_len;
+
+            size_t used = leaf->header.used;
+            if (dirRecordInsert(leaf->records, DIR_BTREE_LEAF_BYTES, &used, at, entry->name,
+                                entry->inode_index, inode_table[entry->inode_index].type) != 0) {
+                full = 1;
+                break;
+            }
+            leaf->header.count++;
+            leaf->header.used = used;
+            results[k++] = 0;
+            changed = 1;
+        }
+        if (changed && writeBlock(path.blocks[d], leaf) != 0) return -1;
+
+        if (full) {
+            int out_inode;
+            int res = btreeInsert(dir_inode, entries[k].name, entries[k].type,
+                                  entries[k].inode_index, 1, &out_inode);
+            if (res < 0) return -1;
+            entries[k].inode_index = out_inode;
+            results[k++] = res;
+        }
+    }
+    return 0;
+}
+
+/* ---- remoção ---- */
+/* Folhas esvaziadas continuam na árvore, cobrindo a mesma faixa de nomes, e só são
+   liberadas junto com o diretório */
+int btreeRemove(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
+    btree_path_t path;
+    if (btreeWalk(dir_inode, name, &path) != 0) return -1;
+
+    int d = path.depth - 1;
+    dir_btree_node_t *leaf = &path.nodes[d];
+    long offset = leafFind(leaf, name, type);
+    if (offset < 0) return -1;
+
+    *out_inode = ((const dir_record_t *)(leaf->records + offset))->inode_index;
+    size_t used = leaf->header.used;
+    dirRecordRemove(leaf->records, &used, offset);
+    leaf->header.used = used;
+    leaf->header.count--;
+    return writeBlock(path.blocks[d], leaf);
+}
+
+/* Aponta a entrada existente para outro inode; só a folha dela é regravada */
+int btreeSetInode(int dir_inode, const char *name, inode_type_t type, int inode_index) {
+    btree_path_t path;
+    if (btreeWalk(dir_inode, name, &path) != 0) return -1;
+
+    int d = path.depth - 1;
+    dir_btree_node_t *leaf = &path.nodes[d];
+    long offset = leafFind(leaf, name, type);
+    if (offset < 0) return -1;
+
+    dir_record_t *target = (dir_record_t *)(leaf->records + offset);
+    target->inode_index = inode_index;
+    target->file_type = inode_table[inode_index].type;
+    return writeBlock(path.blocks[d], leaf);
+}
+
+/* ---- iteração ---- */
+/* Visita, em ordem de nome, as entradas que começam com prefix ("" = todas): desce uma vez
+   até a primeira folha da faixa e segue o encadeamento das folhas */
+int btreeForEachPrefix(int dir_inode, const char *prefix, dir_visit_fn visit, void *ctx) {
+    dir_btree_node_t leaf;
+    if (seekLeaf(dir_inode, prefix, &leaf) != 0) return -1;
+
+    size_t len = strlen(prefix);
+    size_t offset = leafSeek(&leaf, prefix);
+    dir_entry_t entry;
+
+    for (uint32_t hops = 0; hops < computed_data_blocks; hops++) {
+        const dir_record_t *rec;
+        while ((rec = dirRecordAt(leaf.records, leaf.header.used, offset)) != NULL) {
+            if (rec->name_len < len || memcmp(rec->name, prefix, len) != 0) return 0;
+            dirRecordToEntry(rec, &entry);
+            int res = visit(&entry, ctx);
+            if (res != 0) return res;
+            offset += rec->rec_len;
+        }
+        if (leaf.header.next_leaf == 0) return 0;
+        if (readNode(leaf.header.next_leaf, &leaf) != 0 || leaf.header.level != 0) return -1;
+        offset = 0;
+    }
+    return -1;
+}
+
+int btreeForEach(int dir_inode, dir_visit_fn visit, void *ctx) {
+    return btreeForEachPrefix(dir_inode, "", visit, ctx);
+}
+
+/* ---- leitura em lotes ---- */
+/* Bloco da folha onde nomes >= name começam; não lê a folha quando o pai já a identifica */
+static int seekLeafBlock(int dir_inode, const char *name, uint32_t *out_block) {
+    dir_btree_node_t node;
+    uint32_t block = inode_table[dir_inode].blocks[0];
+
+    for (int d = 0; d < DIR_BTREE_MAX_DEPTH; d++) {
+        if (readNode(block, &node) != 0) return -1;
+        if (node.header.level == 0) break;
+        if (node.header.count == 0) return -1;
+
+        block = node.keys[keySearch(&node, name)].block;
+        if (node.header.level == 1) break;
+    }
+    *out_block = block;
+    return 0;
+}
+
+/* Folha pela janela do iterador. Fora dela, lê de uma vez a folha e os blocos alocados
+   logo depois (folhas criadas em sequência costumam ser vizinhas no disco) */
+static dir_btree_node_t *iterLeaf(dir_iter_t *it, uint32_t block) {
+    if (block < it->window_first || block >= it->window_first + it->window_count) {
+        uint32_t count = 1;
+        while (count < DIR_ITER_READAHEAD && block + count < computed_data_blocks &&
+               blockInUse(block + count))
+            count++;
+
+        it->window_first = block;
+        it->window_count = 0;
+        if (readBlocks(block, count, it->window) != 0) {
+            // algum vizinho não passou na verificação: fica só com a folha
+            if (readBlock(block, it->window) != 0) return NULL;
+            count = 1;
+        }
+        it->window_count = count;
+    }
+
+    dir_btree_node_t *leaf = &it->window[block - it->window_first];
+    if (leaf->header.magic != DIR_BTREE_MAGIC || leaf->header.level != 0) return NULL;
+    if (leaf->header.used > DIR_BTREE_LEAF_BYTES) return NULL;
+    return leaf;
+}
+
+int btreeIterOpen(dir_iter_t *it) {
+    it->window = malloc((size_t)DIR_ITER_READAHEAD * sizeof(dir_btree_node_t));
+    if (!it->window) return -1;
+    if (seekLeafBlock(it->dir_inode, it->prefix, &it->leaf_block) != 0) return -1;
+
+    dir_btree_node_t *leaf = iterLeaf(it, it->leaf_block);
+    if (!leaf) return -1;
+    it->offset = leafSeek(leaf, it->prefix);
+    return 0;
+}
+
+/* Copia até max entradas a partir da posição do iterador. Retorna quantas, -1 em erro */
+int btreeIterRead(dir_iter_t *it, dir_entry_t *out, int max) {
+    int n = 0;
+
+    while (n < max && !it->done) {
+        dir_btree_node_t *leaf = iterLeaf(it, it->leaf_block);
+        if (!leaf) return -1;
+
+        const dir_record_t *rec;
+        while (n < max && (rec = dirRecordAt(leaf->records, leaf->header.used, it->offset)) != NULL) {
+            if (rec->name_len < it->prefix_len || memcmp(rec->name, it->prefix, it->prefix_len) != 0) {
+                it->done = 1;
+                return n;
+            }
+            dirRecordToEntry(rec, &out[n++]);
+            it->offset += rec->rec_len;
+        }
+        if (n == max) break;
+
+        if (leaf->header.next_leaf == 0) {
+            it->done = 1;
+            break;
+        }
+        if (++it->hops >= computed_data_blocks) return -1;
+        it->leaf_block = leaf->header.next_leaf;
+        it->offset = 0;
+    }
+    return n;
+}
+
+/* ---- conversão e liberação ---- */
+/* Copia as entradas do formato linear, libera seus blocos e começa a árvore com uma folha
+   vazia como raiz; as entradas são então reinseridas pelo caminho normal */
+int btreeConvert(int dir_inode) {
+    inode_t *dir = &inode_table[dir_inode];
+    size_t capacity = (size_t)BLOCKS_PER_INODE * DIR_MAX_RECORDS_PER_BLOCK;
+    dir_entry_t *entries = malloc(capacity * sizeof(dir_entry_t));
+    dir_block_t buffer;
+    size_t count = 0;
+    if (!entries) return -1;
+
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] == 0) continue;
+        if (readBlock(dir->blocks[i], &buffer) != 0) {
+            free(entries);
+            return -1;
+        }
+        size_t offset = 0;
+        const dir_record_t *rec;
+        while ((rec = dirRecordAt(buffer.raw, BLOCK_SIZE, offset)) != NULL) {
+            dirRecordToEntry(rec, &entries[count++]);
+            offset += rec->rec_len;
+        }
+    }
+
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] != 0) freeBlock(dir->blocks[i]);
+        dir->blocks[i] = 0;
+    }
+
+    dir_btree_node_t root;
+    uint32_t root_block;
+    if (newNode(dir_inode, 0, &root, &root_block) != 0) {
+        free(entries);
+        return -1;
+    }
+    dir->blocks[0] = root_block;
+    dir->flags |= INODE_FLAG_DIR_BTREE;
+
+    int res = writeBlock(root_block, &root);
+    for (size_t k = 0; k < count && res == 0; k++)
+        res = btreeAdd(dir_inode, entries[k].name, entries[k].inode_index);
+
+    free(entries);
+    return res;
+}
+
+static void freeSubtree(uint32_t block, int levels_left) {
+    dir_btree_node_t node;
+    if (block == 0) return;
+
+    if (levels_left > 0 && readNode(block, &node) == 0 && node.header.level > 0) {
+        for (int i = 0; i < node.header.count; i++)
+            freeSubtree(node.keys[i].block, levels_left - 1);
+    }
+    freeBlock(block);
+}
+
+/* Libera todos os nós da árvore (chamado quando o inode do diretório é liberado) */
+void btreeFree(int dir_inode) {
+    inode_t *dir = &inode_table[dir_inode];
+    freeSubtree(dir->blocks[0], DIR_BTREE_MAX_DEPTH);
+    dir->blocks[0] = 0;
+    dir->flags &= ~INODE_FLAG_DIR_BTREE;
+}
@@ -0,0 +1,22 @@
+#ifndef BTREE_H
+#define BTREE_H
+#include "fs.h"
+#include "fs_operations.h"
+
+/* Operações em diretórios com INODE_FLAG_DIR_BTREE (árvore B+ ordenada por nome) */
+int btreeFind(int dir_inode, const char *name, inode_type_t type, int *out_inode);
+int btreeAdd(int dir_inode, const char *name, int inode_index);
+int btreeLookupOrAdd(int dir_inode, const char *name, inode_type_t type, int inode_index, int *out_inode);
+int btreeAddEntries(int dir_inode, dir_entry_t *entries, int count, int *results);
+int btreeRemove(int dir_inode, const char *name, inode_type_t type, int *out_inode);
+int btreeSetInode(int dir_inode, const char *name, inode_type_t type, int inode_index);
+int btreeForEach(int dir_inode, dir_visit_fn visit, void *ctx);
+int btreeForEachPrefix(int dir_inode, const char *prefix, dir_visit_fn visit, void *ctx);
+int btreeIterOpen(dir_iter_t *it);
+int btreeIterRead(dir_iter_t *it, dir_entry_t *out, int max);
+
+/* Converte um diretório linear para a árvore / libera todos os nós da árvore */
+int btreeConvert(int dir_inode);
+void btreeFree(int dir_inode);
+
+#endif
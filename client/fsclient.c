@@ -0,0 +1,60 @@
+// Cliente do daemon multi-sessão: liga o terminal ao socket do main --daemon.
+// Todo o processamento (login, comandos, prompts) acontece no daemon; aqui só se repassa
+// a entrada para o socket e a resposta para a saída.
+#include "../server.h"
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// escreve tudo (write pode aceitar só parte do buffer)
+static int writeAll(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, data, len);
+        if (w <= 0) return -1;
+        data += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : SERVER_SOCKET;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Caminho do socket muito longo: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Não foi possível conectar a %s (o daemon está rodando? main --daemon)\n", path);
+        return 1;
+    }
+
+    // fim da entrada local: avisa o daemon (meia conexão) e continua lendo até ele encerrar
+    struct pollfd fds[2] = { { .fd = STDIN_FILENO, .events = POLLIN }, { .fd = fd, .events = POLLIN } };
+    char buffer[4096];
+    while (1) {
+        if (poll(fds, 2, -1) < 0) break;
+
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0 || writeAll(STDOUT_FILENO, buffer, (size_t)n) != 0) break;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (n <= 0) {
+                shutdown(fd, SHUT_WR);
+                fds[0].fd = -1;         // poll ignora descritores negativos
+            } else if (writeAll(fd, buffer, (size_t)n) != 0) {
+                break;
+            }
+        }
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,456 @@
+#include "compress.h"
+#include "fs_operations.h"
+#include <pthread.h>
+
+/* ---- codec LZ ---- */
+/* Cada sequência: token (4 bits de tamanho de literais | 4 bits de tamanho do match - 4),
+   bytes extras de tamanho (runs de 255), literais, offset de 2 bytes e bytes extras do match.
+   A última sequência só tem literais; o descompressor para ao atingir raw_len. */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 0xFFFF
+
+static int lzPutLength(uint8_t *out, size_t *op, size_t out_cap, size_t len) {
+    while (len >= 255) {
+        if (*op >= out_cap) return -1;
+        out[(*op)++] = 255;
+        len -= 255;
+    }
+    if (*op >= out_cap) return -1;
+    out[(*op)++] = (uint8_t)len;
+    return 0;
+}
+
+static int lzEmitSequence(uint8_t *out, size_t *op, size_t out_cap,
+                          const uint8_t *literals, size_t lit_len,
+                          size_t offset, size_t match_len) {
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+    if (*op >= out_cap) return -1;
+    out[(*op)++] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+
+    if (lit_len >= 15 && lzPutLength(out, op, out_cap, lit_len - 15) != 0) return -1;
+    if (*op + lit_len > out_cap) return -1;
+    memcpy(out + *op, literals, lit_len);
+    *op += lit_len;
+
+    if (match_len == 0) return 0;
+
+    if (*op + 2 > out_cap) return -1;
+    out[(*op)++] = (uint8_t)(offset & 0xFF);
+    out[(*op)++] = (uint8_t)(offset >> 8);
+    if (ml >= 15 && lzPutLength(out, op, out_cap, ml - 15) != 0) return -1;
+    return 0;
+}
+
+/* Comprime in em out. Retorna o tamanho comprimido, ou 0 se não couber em out_cap */
+size_t lzCompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap) {
+    uint32_t table[1 << LZ_HASH_BITS];  // posição + 1 da última ocorrência de cada hash
+    memset(table, 0, sizeof(table));
+
+    size_t ip = 0, anchor = 0, op = 0;
+
+    while (ip + LZ_MIN_MATCH <= in_len) {
+        uint32_t seq;
+        memcpy(&seq, in + ip, sizeof(seq));
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[h];
+        table[h] = ip + 1;
+
+        if (candidate == 0 || ip - (candidate - 1) > LZ_MAX_OFFSET ||
+            memcmp(in + candidate - 1, in + ip, LZ_MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+
+        size_t ref = candidate - 1;
+        size_t len = LZ_MIN_MATCH;
+        while (ip + len < in_len && in[ref + len] == in[ip + len]) len++;
+
+        if (lzEmitSequence(out, &op, out_cap, in + anchor, ip - anchor, ip - ref, len) != 0) return 0;
+        ip += len;
+        anchor = ip;
+    }
+
+    if (lzEmitSequence(out, &op, out_cap, in + anchor, in_len - anchor, 0, 0) != 0) return 0;
+    return op;
+}
+
+static int lzGetLength(const uint8_t *in, size_t in_len, size_t *ip, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= in_len) return -1;
+        b = in[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/* Descomprime exatamente raw_len bytes. Valida todos os limites (dados corrompidos retornam -1) */
+int lzDecompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t raw_len) {
+    size_t ip = 0, op = 0;
+
+    while (op < raw_len) {
+        if (ip >= in_len) return -1;
+        uint8_t token = in[ip++];
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && lzGetLength(in, in_len, &ip, &lit_len) != 0) return -1;
+        if (ip + lit_len > in_len || op + lit_len > raw_len) return -1;
+        memcpy(out + op, in + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (op >= raw_len) break;
+
+        if (ip + 2 > in_len) return -1;
+        size_t offset = in[ip] | ((size_t)in[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return -1;
+
+        size_t match_len = token & 0x0F;
+        if (match_len == 15 && lzGetLength(in, in_len, &ip, &match_len) != 0) return -1;
+        match_len += LZ_MIN_MATCH;
+        if (op + match_len > raw_len) return -1;
+
+        // cópia byte a byte: o match pode sobrepor a própria saída
+        for (size_t i = 0; i < match_len; i++, op++)
+            out[op] = out[op - offset];
+    }
+    return 0;
+}
+
+/* ---- cache de clusters descomprimidos ---- */
+typedef struct {
+    uint32_t block;         // primeiro bloco do cluster (0 = entrada vazia)
+    uint16_t raw_len;
+    uint32_t last_use;
+    char data[CLUSTER_DATA_SIZE];
+} cluster_cache_entry_t;
+
+static cluster_cache_entry_t cluster_cache[CLUSTER_CACHE_ENTRIES];
+static uint32_t cluster_cache_clock = 0;
+
+/* Leitores de arquivos diferentes compartilham o cache; a trava é a última da ordem (fs.h),
+   já que freeBlock invalida entradas segurando a do alocador */
+static pthread_mutex_t cluster_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Copia o cluster em cache para out. Retorna 0 se estava no cache */
+static int clusterCacheGet(uint32_t block, char *out, uint16_t *out_len) {
+    int res = -1;
+    pthread_mutex_lock(&cluster_cache_lock);
+    for (int i = 0; i < CLUSTER_CACHE_ENTRIES; i++) {
+        if (cluster_cache[i].block == block) {
+            cluster_cache[i].last_use = ++cluster_cache_clock;
+            memcpy(out, cluster_cache[i].data, cluster_cache[i].raw_len);
+            *out_len = cluster_cache[i].raw_len;
+            res = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cluster_cache_lock);
+    return res;
+}
+
+static void clusterCacheInsert(uint32_t block, const char *data, uint16_t raw_len) {
+    pthread_mutex_lock(&cluster_cache_lock);
+    cluster_cache_entry_t *victim = &cluster_cache[0];
+    for (int i = 0; i < CLUSTER_CACHE_ENTRIES; i++) {
+        // outro leitor pode ter inserido o mesmo cluster enquanto este era lido do disco
+        if (cluster_cache[i].block == block || cluster_cache[i].block == 0) { victim = &cluster_cache[i]; break; }
+        if (cluster_cache[i].last_use < victim->last_use) victim = &cluster_cache[i];
+    }
+    victim->block = block;
+    victim->raw_len = raw_len;
+    victim->last_use = ++cluster_cache_clock;
+    memcpy(victim->data, data, raw_len);
+    pthread_mutex_unlock(&cluster_cache_lock);
+}
+
+/* Chamado quando um bloco é liberado: o cluster que começava nele deixa de existir */
+void clusterCacheInvalidate(uint32_t block_index) {
+    pthread_mutex_lock(&cluster_cache_lock);
+    for (int i = 0; i < CLUSTER_CACHE_ENTRIES; i++) {
+        if (cluster_cache[i].block == block_index) cluster_cache[i].block = 0;
+    }
+    pthread_mutex_unlock(&cluster_cache_lock);
+}
+
+/* ---- clusters ---- */
+/* Slots do inode (ou do inode encadeado) que pertencem ao cluster; cria a cadeia se create */
+static uint32_t *clusterSlots(int inode_index, uint32_t cluster, int create) {
+    int current = inode_index;
+
+    for (uint32_t hop = cluster / CLUSTERS_PER_INODE; hop > 0; hop--) {
+        if (inode_table[current].next_inode == 0) {
+            if (!create) return NULL;
+            int next = allocateInode(inodeGroup(inode_index));
+            if (next < 0) return NULL;
+            inode_table[next].type = FILE_REGULAR;
+            inode_table[current].next_inode = next;
+        }
+        current = inode_table[current].next_inode;
+    }
+    return &inode_table[current].blocks[(cluster % CLUSTERS_PER_INODE) * CLUSTER_BLOCKS];
+}
+
+/* Solta os blocos de um cluster */
+static void releaseClusterSlots(uint32_t *slots) {
+    for (int i = 0; i < CLUSTER_BLOCKS; i++) {
+        if (slots[i] != 0) freeBlock(slots[i]);
+        slots[i] = 0;
+    }
+}
+
+/* Lê e descomprime um cluster (consultando o cache antes do disco) */
+int readCluster(int inode_index, uint32_t cluster, char *out, uint16_t *out_len) {
+    uint32_t *slots = clusterSlots(inode_index, cluster, 0);
+    if (!slots || slots[0] == 0) return -1;
+
+    if (clusterCacheGet(slots[0], out, out_len) == 0) return 0;
+
+    char stored[CLUSTER_BLOCKS * BLOCK_SIZE];
+    if (readBlock(slots[0], stored) != 0) return -1;
+
+    cluster_header_t header;
+    memcpy(&header, stored, sizeof(header));
+    size_t total = sizeof(header) + header.stored_len;
+    int nblocks = (total + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (header.raw_len > CLUSTER_DATA_SIZE || nblocks > CLUSTER_BLOCKS) return -1;
+
+    // demais blocos do cluster, agrupando os contíguos
+    int i = 1;
+    while (i < nblocks) {
+        int run = 1;
+        while (i + run < nblocks && slots[i + run] == slots[i] + run) run++;
+        if (slots[i] == 0 || readBlocks(slots[i], run, stored + i * BLOCK_SIZE) != 0) return -1;
+        i += run;
+    }
+
+    const uint8_t *payload = (const uint8_t *)stored + sizeof(header);
+    if (header.method == CLUSTER_LZ) {
+        if (lzDecompress(payload, header.stored_len, (uint8_t *)out, header.raw_len) != 0) return -1;
+    } else {
+        if (header.stored_len != header.raw_len) return -1;
+        memcpy(out, payload, header.raw_len);
+    }
+
+    clusterCacheInsert(slots[0], out, header.raw_len);
+    *out_len = header.raw_len;
+    return 0;
+}
+
+/* Comprime e grava um cluster em slots vazios, com blocos do grupo indicado */
+static int writeCluster(uint32_t *slots, int group, const char *raw, size_t raw_len) {
+    char stored[CLUSTER_BLOCKS * BLOCK_SIZE] = {0};
+    cluster_header_t header = {0};
+    uint8_t *payload = (uint8_t *)stored + sizeof(header);
+
+    header.raw_len = raw_len;
+    size_t clen = lzCompress((const uint8_t *)raw, raw_len, payload, raw_len > 0 ? raw_len - 1 : 0);
+    if (clen > 0) {
+        header.method = CLUSTER_LZ;
+        header.stored_len = clen;
+    } else {
+        // incompressível: guarda os dados como estão
+        header.method = CLUSTER_RAW;
+        header.stored_len = raw_len;
+        memcpy(payload, raw, raw_len);
+    }
+    memcpy(stored, &header, sizeof(header));
+
+    uint32_t nblocks = (sizeof(header) + header.stored_len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t done = 0;
+    while (done < nblocks) {
+        uint32_t first;
+        int count = allocateBlockRun(group, nblocks - done, &first);
+        if (count <= 0) {
+            releaseClusterSlots(slots);
+            return -1;
+        }
+        for (int k = 0; k < count; k++) slots[done + k] = first + k;
+        if (writeBlocks(first, count, stored + done * BLOCK_SIZE) != 0) {
+            releaseClusterSlots(slots);
+            return -1;
+        }
+        done += count;
+    }
+    return 0;
+}
+
+/* ---- arquivos comprimidos ---- */
+/* Anexa dados: o último cluster (se parcial) é descomprimido, completado e regravado em blocos
+   novos. Os blocos antigos só são soltos depois que a nova versão foi gravada, então uma falha
+   no meio mantém o conteúdo anterior */
+int compressedAppend(int inode_index, const char *data, size_t data_size) {
+    if (inode_index < 0 || inode_index >= MAX_INODES || !data) return -1;
+    if (data_size == 0) return 0;
+
+    inode_t *inode = &inode_table[inode_index];
+    uint32_t cluster = inode->size / CLUSTER_DATA_SIZE;
+    size_t used = inode->size % CLUSTER_DATA_SIZE;
+    char raw[CLUSTER_DATA_SIZE];
+    size_t written = 0;
+
+    if (used > 0) {
+        uint16_t len;
+        if (readCluster(inode_index, cluster, raw, &len) != 0 || len != used) return -1;
+    }
+
+    while (written < data_size) {
+        size_t n = CLUSTER_DATA_SIZE - used;
+        if (n > data_size - written) n = data_size - written;
+        memcpy(raw + used, data + written, n);
+        used += n;
+        written += n;
+
+        uint32_t *slots = clusterSlots(inode_index, cluster, 1);
+        uint32_t fresh[CLUSTER_BLOCKS] = {0};
+        if (!slots || writeCluster(fresh, inodeGroup(inode_index), raw, used) != 0) return -1;
+
+        // troca os slots e só então solta os do cluster antigo (vazios num cluster novo)
+        uint32_t old[CLUSTER_BLOCKS];
+        memcpy(old, slots, sizeof(old));
+        memcpy(slots, fresh, sizeof(fresh));
+        releaseClusterSlots(old);
+
+        // tamanho sempre reflete os clusters já gravados
+        inode->size = cluster * CLUSTER_DATA_SIZE + used;
+        if (used == CLUSTER_DATA_SIZE) {
+            cluster++;
+            used = 0;
+        }
+    }
+    return 0;
+}
+
+/* Lê o arquivo inteiro descomprimindo cluster a cluster */
+int compressedRead(int inode_index, char *buffer, size_t buffer_size, size_t *out_bytes) {
+    inode_t *inode = &inode_table[inode_index];
+    size_t total_size = inode->size;
+    if (buffer_size < total_size + 1) return -1;
+
+    char raw[CLUSTER_DATA_SIZE];
+    size_t offset = 0;
+    for (uint32_t cluster = 0; offset < total_size; cluster++) {
+        uint16_t len;
+        if (readCluster(inode_index, cluster, raw, &len) != 0) return -1;
+
+        size_t expected = total_size - offset < CLUSTER_DATA_SIZE ? total_size - offset : CLUSTER_DATA_SIZE;
+        if (len != expected) return -1;
+        memcpy(buffer + offset, raw, len);
+        offset += len;
+    }
+
+    buffer[offset] = '\0';
+    *out_bytes = offset;
+    return 0;
+}
+
+/* Converte o conteúdo de um arquivo entre os formatos normal e comprimido.
+   O novo conteúdo é montado em um inode temporário e depois trocado com o original */
+static int convertLocked(int inode_index, int enable) {
+    inode_t *inode = &inode_table[inode_index];
+    if (inode->type != FILE_REGULAR || (inode->flags & INODE_FLAG_USERDB_VIEW)) return -1;
+
+    int compressed = (inode->flags & INODE_FLAG_COMPRESSED) != 0;
+    if (compressed == (enable != 0)) return 0;
+
+    // o temporário não está em nenhum diretório: ninguém mais disputa a trava dele. Fica marcado
+    // como órfão até a troca, para que uma queda no meio o deixe para orphanRecover
+    int temp_index = allocateInode(inodeGroup(inode_index));
+    if (temp_index < 0) return -1;
+    inode_t *temp = &inode_table[temp_index];
+    temp->type = FILE_REGULAR;
+    temp->flags = INODE_FLAG_ORPHAN | (enable ? INODE_FLAG_COMPRESSED : 0);
+
+    size_t total_size = inode->size;
+    int res = 0;
+
+    if (compressed) {
+        // descomprime em lotes de clusters para limitar as sincronizações
+        size_t batch_cap = COPY_BATCH_BLOCKS * BLOCK_SIZE;
+        char *batch = malloc(batch_cap);
+        char raw[CLUSTER_DATA_SIZE];
+        size_t filled = 0;
+        if (!batch) res = -1;
+
+        for (uint32_t cluster = 0; res == 0 && cluster * CLUSTER_DATA_SIZE < total_size; cluster++) {
+            uint16_t len;
+            if (readCluster(inode_index, cluster, raw, &len) != 0) { res = -1; break; }
+            if (filled + len > batch_cap) {
+                if (addContentToInodeLocked(temp_index, batch, filled) != 0) { res = -1; break; }
+                sync_fs();
+                filled = 0;
+            }
+            memcpy(batch + filled, raw, len);
+            filled += len;
+        }
+        if (res == 0 && filled > 0 && addContentToInodeLocked(temp_index, batch, filled) != 0) res = -1;
+        free(batch);
+    } else {
+        // percorre os blocos do arquivo normal acumulando um cluster por vez
+        char raw[CLUSTER_DATA_SIZE];
+        char block[BLOCK_SIZE];
+        size_t offset = 0, filled = 0;
+        int current = inode_index;
+
+        while (res == 0 && offset < total_size) {
+            inode_t *ino = &inode_table[current];
+            for (int i = 0; i < BLOCKS_PER_INODE && offset < total_size; i++) {
+                if (ino->blocks[i] == 0) continue;
+                if (readBlock(ino->blocks[i], block) != 0) { res = -1; break; }
+
+                size_t len = total_size - offset < BLOCK_SIZE ? total_size - offset : BLOCK_SIZE;
+                size_t pos = 0;
+                while (pos < len) {
+                    size_t n = CLUSTER_DATA_SIZE - filled;
+                    if (n > len - pos) n = len - pos;
+                    memcpy(raw + filled, block + pos, n);
+                    filled += n;
+                    pos += n;
+                    if (filled == CLUSTER_DATA_SIZE) {
+                        if (compressedAppend(temp_index, raw, filled) != 0) { res = -1; break; }
+                        filled = 0;
+                    }
+                }
+                offset += len;
+                if (res != 0) break;
+            }
+            if (ino->next_inode == 0) break;
+            current = ino->next_inode;
+        }
+        if (res == 0 && offset != total_size) res = -1;
+        if (res == 0 && filled > 0 && compressedAppend(temp_index, raw, filled) != 0) res = -1;
+    }
+
+    if (res != 0) {
+        freeInode(temp_index);
+        return -1;
+    }
+
+    // troca o conteúdo: o original recebe os blocos do temporário
+    time_t mtime = inode->modification_date;
+    truncateInodeLocked(inode_index);
+    memcpy(inode->blocks, temp->blocks, sizeof(inode->blocks));
+    inode->next_inode = temp->next_inode;
+    inode->size = total_size;
+    inode->modification_date = mtime;
+    inode->flags = temp->flags & ~INODE_FLAG_ORPHAN;
+
+    memset(temp->blocks, 0, sizeof(temp->blocks));
+    temp->next_inode = 0;
+    freeInode(temp_index);
+    return 0;
+}
+
+int setInodeCompression(int inode_index, int enable) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
+
+    inodeLockWrite(inode_index);
+    int res = inodeInUse(inode_index) ? convertLocked(inode_index, enable) : -1;
+    inodeUnlock(inode_index);
+
+    sync_fs();
+    return res;
+}
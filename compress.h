@@ -0,0 +1,22 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+#include "fs.h"
+
+/* Número de clusters descomprimidos mantidos em memória */
+#define CLUSTER_CACHE_ENTRIES 16
+
+/* Codec LZ (formato de sequências literal + match, estilo LZ4) */
+size_t lzCompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap);
+int lzDecompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t raw_len);
+
+/* Arquivos comprimidos */
+int compressedAppend(int inode_index, const char *data, size_t data_size);
+int compressedRead(int inode_index, char *buffer, size_t buffer_size, size_t *out_bytes);
+int readCluster(int inode_index, uint32_t cluster, char *out, uint16_t *out_len);
+int setInodeCompression(int inode_index, int enable);
+uint32_t inodeStoredBlocks(int inode_index);
+
+/* Cache de clusters descomprimidos */
+void clusterCacheInvalidate(uint32_t block_index);
+
+#endif
@@ -1,16 +1,25 @@
 #include "core_utils.h"
 #include "utils.h"
 #include "fs_operations.h"
+#include "dedup.h"
+#include "compress.h"
+#include "crc32c.h"
+#include "userdb.h"
+#include "orphan.h"
+#include "session.h"
 #include <stdlib.h>
 #include <crypt.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <pthread.h>
 #define UNREFERENCED(x) (void)(x)
 
 
 /* ---- Comandos de FS ---- */
 
-int authenticated_uid = -1;
-const char* passwd_path = "etc/passwd";
-const char* shadow_path = "etc/shadow";
+__thread int authenticated_uid = -1;       // por sessão: no daemon cada sessão é uma thread
+const char* passwd_path = USERDB_PASSWD_PATH;
+const char* shadow_path = USERDB_SHADOW_PATH;
 
 int parse_octal_permissions(const char *str, uint8_t *out)
 {
@@ -45,9 +54,19 @@ int _cd(int *current_inode, const char *path, int user_id) {
     if (inode->type != FILE_DIRECTORY) return -1;
 
     if (!hasPermission(inode, authenticated_uid, PERM_EXEC) && user_id != ROOT_UID) {
-        printf("cd: Acesso negado, requer permissão X.\n");
+        sessionPrintf("cd: Acesso negado, requer permissão X.\n");
         return -1;
     };
+
+    // marca o novo diretório antes de largar o antigo. Entre resolver e marcar ele pode ter sido
+    // apagado e o número reaproveitado: o caminho tem que levar ao mesmo inode depois da marca
+    if (dirPin(target_inode) != 0) return -1;
+    int check;
+    if (resolvePath(path, *current_inode, &check) != 0 || check != target_inode) {
+        dirUnpin(target_inode);
+        return -1;
+    }
+    dirUnpin(*current_inode);
     *current_inode = target_inode;
     return 0;
 }
@@ -68,11 +87,11 @@ int _mkdir(int current_inode, const char *full_path, int user_id) {
     inode_t *parent = &inode_table[parent_inode];
 
     if (!hasPermission(parent, user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
-        printf("mkdir: acesso negado — requer W e X no diretório pai.\n");
+        sessionPrintf("mkdir: acesso negado — requer W e X no diretório pai.\n");
         return -1;
     }
 
-    return createDirectory(parent_inode, name, user_id, NULL);
+    return createDirectory(parent_inode, name, user_id, NULL) == 0 ? 0 : -1;
 }
 
 // _touch (cria arquivo) com criação recursiva
@@ -91,11 +110,169 @@ int _touch(int current_inode, const char *full_path, int user_id) {
     inode_t *parent = &inode_table[parent_inode];
 
     if (!hasPermission(parent, user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
-        printf("touch: acesso negado — requer W e X no diretório pai.\n");
+        sessionPrintf("touch: acesso negado — requer W e X no diretório pai.\n");
         return -1;
     }
 
-    return createFile(parent_inode, name, user_id);
+    return createFile(parent_inode, name, user_id, NULL) == 0 ? 0 : -1;
+}
+
+// bulk-create: uma linha da lista, já separada em diretório pai e nome
+typedef struct {
+    char parent[256];
+    create_request_t req;
+} bulk_item_t;
+
+static int compareBulkItems(const void *a, const void *b) {
+    const bulk_item_t *x = a, *y = b;
+    int res = strcmp(x->parent, y->parent);
+    return res != 0 ? res : strcmp(x->req.name, y->req.name);
+}
+
+/* Abre a lista de um comando em lote: "-" lê da entrada da sessão; qualquer outro caminho é um
+   arquivo do próprio filesystem, lido com as permissões de quem chamou. Nunca um arquivo do
+   hospedeiro: no daemon isso expunha os arquivos da máquina a qualquer sessão.
+   O conteúdo fica em *content até o fclose de quem chamou */
+static FILE *openList(int current_inode, const char *path, int user_id, char **content) {
+    *content = NULL;
+    if (strcmp(path, "-") == 0) return sessionIn();
+
+    int target;
+    if (resolvePath(path, current_inode, &target) != 0) return NULL;
+    inode_t *inode = &inode_table[target];
+    if (inode->type != FILE_REGULAR) return NULL;
+    if (!hasPermission(inode, user_id, PERM_READ) && user_id != ROOT_UID) {
+        sessionPrintf("Acesso negado, requer permissão R em '%s'\n", path);
+        return NULL;
+    }
+
+    size_t size = inode->size, bytes = 0;
+    *content = malloc(size + 1);
+    if (!*content || readContentFromInode(target, *content, size + 1, &bytes, user_id) != 0) {
+        free(*content);
+        *content = NULL;
+        return NULL;
+    }
+    (*content)[bytes] = '\0';
+
+    // com o '\0' final, um arquivo vazio ainda abre (e vira uma linha vazia, ignorada)
+    FILE *in = fmemopen(*content, bytes + 1, "r");
+    if (!in) {
+        free(*content);
+        *content = NULL;
+    }
+    return in;
+}
+
+// lê a lista de caminhos (um por linha; terminando em '/' cria diretório)
+static bulk_item_t *readBulkList(FILE *in, int from_stdin, int *out_count) {
+    bulk_item_t *items = NULL;
+    int count = 0, cap = 0;
+    char line[512];
+
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            if (from_stdin) break;      // linha vazia encerra a lista digitada
+            continue;
+        }
+
+        size_t len = strlen(line);
+        int is_dir = 0;
+        while (len > 1 && line[len - 1] == '/') {
+            line[--len] = '\0';
+            is_dir = 1;
+        }
+
+        char parent[256], name[256];
+        if (len >= sizeof(parent)) {
+            sessionPrintf("bulk-create: caminho muito longo: %s\n", line);
+            continue;
+        }
+        splitPath(line, parent, name);
+        if (name[0] == '\0' || strlen(name) >= MAX_NAMESIZE ||
+            strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            sessionPrintf("bulk-create: nome inválido: %s\n", line);
+            continue;
+        }
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 256;
+            bulk_item_t *grown = realloc(items, cap * sizeof(bulk_item_t));
+            if (!grown) break;
+            items = grown;
+        }
+        bulk_item_t *item = &items[count++];
+        strcpy(item->parent, parent);
+        strcpy(item->req.name, name);
+        item->req.type = is_dir ? FILE_DIRECTORY : FILE_REGULAR;
+        item->req.owner_uid = -1;
+    }
+
+    *out_count = count;
+    return items;
+}
+
+// bulk-create (cria em lote os arquivos e diretórios listados em um arquivo ou na entrada padrão)
+int _bulk_create(int current_inode, const char *list_path, int user_id) {
+    if (!list_path) return -1;
+
+    int from_stdin = strcmp(list_path, "-") == 0;
+    char *content;
+    FILE *in = openList(current_inode, list_path, user_id, &content);
+    if (!in) {
+        sessionPrintf("bulk-create: não foi possível ler '%s'\n", list_path);
+        return -1;
+    }
+
+    int count;
+    bulk_item_t *items = readBulkList(in, from_stdin, &count);
+    if (!from_stdin) fclose(in);
+    free(content);
+
+    // agrupa por diretório pai: um pai sempre vem antes dos seus filhos
+    qsort(items, count, sizeof(bulk_item_t), compareBulkItems);
+
+    create_request_t *reqs = malloc((count ? count : 1) * sizeof(create_request_t));
+    int created = 0, existing = 0, failed = 0;
+
+    for (int start = 0, end; start < count && reqs; start = end) {
+        for (end = start + 1; end < count && strcmp(items[end].parent, items[start].parent) == 0; end++);
+        int n = end - start;
+        const char *parent_path = items[start].parent;
+
+        int parent_inode;
+        if (resolvePath(parent_path, current_inode, &parent_inode) != 0 &&
+            (createDirectoriesRecursively(parent_path, current_inode, user_id) != 0 ||
+             resolvePath(parent_path, current_inode, &parent_inode) != 0)) {
+            sessionPrintf("bulk-create: diretório não encontrado: %s\n", parent_path);
+            failed += n;
+            continue;
+        }
+
+        inode_t *parent = &inode_table[parent_inode];
+        if (!hasPermission(parent, user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
+            sessionPrintf("bulk-create: acesso negado — requer W e X em '%s'.\n", parent_path);
+            failed += n;
+            continue;
+        }
+
+        for (int k = 0; k < n; k++) reqs[k] = items[start + k].req;
+        createEntries(parent_inode, reqs, n, user_id);
+        for (int k = 0; k < n; k++) {
+            if (reqs[k].result == 0) created++;
+            else if (reqs[k].result == 1) existing++;
+            else failed++;
+        }
+    }
+
+    // um único sync para o lote inteiro
+    sync_fs();
+    sessionPrintf("bulk-create: %d criados, %d já existiam, %d com erro\n", created, existing, failed);
+
+    free(reqs);
+    free(items);
+    return failed ? -1 : 0;
 }
 
 // echo > (sobrescreve conteúdo) com criação recursiva
@@ -111,22 +288,17 @@ int _echo_arrow(int current_inode, const char *full_path, const char *content, i
         if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
     }
 
+    // obtém o arquivo existente ou cria um novo na mesma passada pelo diretório
     int inode_index;
-    if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) {
-        if (createFile(parent_inode, name, user_id) != 0) return -1;
-        if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) return -1;
-    }
+    if (createFile(parent_inode, name, user_id, &inode_index) < 0) return -1;
 
     inode_t *inode = &inode_table[inode_index];
     if (!hasPermission(inode, user_id, PERM_WRITE) && user_id != ROOT_UID) {
-        printf("echo: acesso negado — requer permissão W.\n");
+        sessionPrintf("echo: acesso negado — requer permissão W.\n");
         return -1;
     }
 
-    inode->size = 0;  
-    if (inode->next_inode) freeInode(inode->next_inode);
-    inode->next_inode = 0;
-    for (int i = 0; i < BLOCKS_PER_INODE; i++) inode->blocks[i] = 0;
+    truncateInode(inode_index);
     return addContentToInode(inode_index, content, strlen(content), user_id);
 }
 
@@ -145,13 +317,13 @@ int _echo_arrow_arrow(int current_inode, const char *full_path, const char *cont
     }
 
     int inode_index;
-    if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) {
-        if (!hasPermission(&inode_table[inode_index], user_id, PERM_WRITE) && user_id != ROOT_UID) {
-            printf("echo: Acesso negado, requer permissão W.\n");
-            return -1;
-        }
-        if (createFile(parent_inode, name, user_id) != 0) return -1;
-        if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) return -1;
+    int existed = createFile(parent_inode, name, user_id, &inode_index);
+    if (existed < 0) return -1;
+
+    // arquivo recém-criado pertence ao usuário; só o existente precisa da verificação
+    if (existed && !hasPermission(&inode_table[inode_index], user_id, PERM_WRITE) && user_id != ROOT_UID) {
+        sessionPrintf("echo: Acesso negado, requer permissão W.\n");
+        return -1;
     }
 
 
@@ -176,7 +348,7 @@ int _cat(int current_inode, const char *path, int user_id, char** buffer) {
 
     // assegura que há permissão para leitura
     if (!hasPermission(inode, user_id, PERM_READ) && user_id != ROOT_UID) {
-        printf("Acesso negado, requer permissão R\n");
+        sessionPrintf("Acesso negado, requer permissão R\n");
         return -1;
     }
 
@@ -203,9 +375,9 @@ int _cat(int current_inode, const char *path, int user_id, char** buffer) {
     return 0;
 }
 
-// _cp 9copia arquivo) com criaçãp recursiva
+// _cp 9copia arquivo) com criaçãp recursiva. Com reflink, o destino compartilha os blocos da origem
 int _cp(int current_inode, const char *src_path, const char *src_name,
-           const char *dst_path, const char *dst_name, int user_id) {
+           const char *dst_path, const char *dst_name, int user_id, int reflink) {
     if (!src_name || !dst_name) return -1;
 
     int src_parent_inode = current_inode;
@@ -267,47 +439,28 @@ int _cp(int current_inode, const char *src_path, const char *src_name,
 
 
     if (!hasPermission(src_inode, user_id, PERM_READ) && user_id != ROOT_UID) {
-        printf("cp: Acesso negado, requer permissão de leitura no arquivo fonte.\n");
+        sessionPrintf("cp: Acesso negado, requer permissão de leitura no arquivo fonte.\n");
         return -1;
     }
 
     inode_t *dst_parent = &inode_table[dst_parent_inode];
     if (!hasPermission(dst_parent, user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
-        printf("cp: Acesso negado, requer permissão de escrita e execução no diretório destino.\n");
+        sessionPrintf("cp: Acesso negado, requer permissão de escrita e execução no diretório destino.\n");
         return -1;
     }
-    // Lê o conteúdo diretamente por inode
-    char *buffer = malloc(src_inode->size + 1);
-    if (!buffer) return -1;
-    size_t bytes_read = 0;
-    if (readContentFromInode(src_file_inode, buffer, src_inode->size + 1, &bytes_read, user_id) != 0) {
-        free(buffer);
-        return -1;
-    }
-
     // Cria arquivo destino se necessário
     int dst_file_inode;
-    if (dirFindEntry(dst_parent_inode, dst_base, FILE_REGULAR, &dst_file_inode) != 0) {
-        if (createFile(dst_parent_inode, dst_base, user_id) != 0) {
-            free(buffer);
-            return -1;
-        }
-        if (dirFindEntry(dst_parent_inode, dst_base, FILE_REGULAR, &dst_file_inode) != 0) {
-            free(buffer);
-            return -1;
-        }
-    } else {
-        // Se o arquivo já existe, precisamos sobrescrever: zera inode antes de escrever
-        inode_t *dst_inode = &inode_table[dst_file_inode];
-        dst_inode->size = 0;
-        dst_inode->next_inode = 0;
-        for (int i = 0; i < BLOCKS_PER_INODE; ++i) dst_inode->blocks[i] = 0;
+    int dst_existed = createFile(dst_parent_inode, dst_base, user_id, &dst_file_inode);
+    if (dst_existed < 0) return -1;
+    if (dst_existed && dst_file_inode == src_file_inode) {
+        sessionPrintf("cp: origem e destino são o mesmo arquivo.\n");
+        return -1;
     }
 
-    // Escreve no inode destino usando addContentToInode
-    int res = addContentToInode(dst_file_inode, buffer, bytes_read, user_id);
-    free(buffer);
-    return res;
+    // Copia bloco a bloco (ou compartilha os blocos); o conteúdo antigo do destino é liberado
+    if (reflink)
+        return reflinkInodeContent(src_file_inode, dst_file_inode, user_id);
+    return copyInodeContent(src_file_inode, dst_file_inode, user_id);
 }
 
 
@@ -315,20 +468,53 @@ int _cp(int current_inode, const char *src_path, const char *src_name,
 // _mv (move)
 int _mv(int current_inode, const char *src_path, const char *src_name,
            const char *dst_path, const char *dst_name, int user_id) {
-    // Copia o arquivo
-    if (_cp(current_inode, src_path, src_name, dst_path, dst_name, user_id) != 0) return -1;
+    if (!src_name || !dst_name) return -1;
+
+    // src_path/dst_path são a base para nomes relativos ("." = diretório atual)
+    int src_base_inode = current_inode, dst_base_inode = current_inode;
+    if (src_path && src_path[0] != '\0' && strcmp(src_path, ".") != 0 &&
+        resolvePath(src_path, current_inode, &src_base_inode) != 0) return -1;
+    if (dst_path && dst_path[0] != '\0' && strcmp(dst_path, ".") != 0 &&
+        resolvePath(dst_path, current_inode, &dst_base_inode) != 0) return -1;
+
+    char src_dir[256], src_base[256], dst_dir[256], dst_base[256];
+    if (strlen(src_name) >= sizeof(src_dir) || strlen(dst_name) >= sizeof(dst_dir)) return -1;
+    splitPath(src_name, src_dir, src_base);
+    splitPath(dst_name, dst_dir, dst_base);
 
-    // Apaga o arquivo de origem
     int src_parent_inode;
-    if (resolvePath(src_path, current_inode, &src_parent_inode) != 0) return -1;
+    if (resolvePath(src_dir, src_base_inode, &src_parent_inode) != 0) {
+        sessionPrintf("mv: origem não encontrada: %s\n", src_name);
+        return -1;
+    }
 
-    inode_t *src_parent = &inode_table[src_parent_inode];
-    if (!hasPermission(src_parent, user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
-        printf("mv: Acesso negado, requer permissão no diretório de origem.\n");
+    // destino que já é um diretório (ou termina em '/'): move para dentro dele, com o mesmo nome
+    int dst_parent_inode, dst_dir_inode;
+    const char *final_name = dst_base;
+    if (resolvePath(dst_name, dst_base_inode, &dst_dir_inode) == 0 &&
+        inode_table[dst_dir_inode].type == FILE_DIRECTORY) {
+        dst_parent_inode = dst_dir_inode;
+        final_name = src_base;
+    } else if (resolvePath(dst_dir, dst_base_inode, &dst_parent_inode) != 0) {
+        if (createDirectoriesRecursively(dst_dir, dst_base_inode, user_id) != 0) return -1;
+        if (resolvePath(dst_dir, dst_base_inode, &dst_parent_inode) != 0) return -1;
+    }
+
+    if (!hasPermission(&inode_table[src_parent_inode], user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
+        sessionPrintf("mv: Acesso negado, requer permissão no diretório de origem.\n");
+        return -1;
+    }
+    if (!hasPermission(&inode_table[dst_parent_inode], user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
+        sessionPrintf("mv: Acesso negado, requer permissão de escrita e execução no diretório destino.\n");
         return -1;
     }
 
-    return deleteFile(src_parent_inode, src_name, user_id);
+    // só a entrada de diretório muda de lugar; os blocos do arquivo não são tocados
+    if (renameEntry(src_parent_inode, src_base, dst_parent_inode, final_name) != 0) {
+        sessionPrintf("mv: não foi possível mover '%s' para '%s'.\n", src_name, dst_name);
+        return -1;
+    }
+    return 0;
 }
 
 
@@ -364,7 +550,7 @@ int _ln_s(int current_inode,
     }
     inode_t *dir_inode = &inode_table[link_dir_index];
     if (!hasPermission(dir_inode, user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
-        printf("ln: Acesso negado, requer permissões W e X no diretório.\n");
+        sessionPrintf("ln: Acesso negado, requer permissões W e X no diretório.\n");
         return -1;
     }
 
@@ -375,14 +561,88 @@ int _ln_s(int current_inode,
 }
 
 
+/* Saída do ls montada em memória e escrita de uma vez */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    time_t last_mtime;          // datas repetidas (arquivos criados no mesmo segundo)
+    char mtime_buf[32];         // reaproveitam a última formatação
+} ls_output_t;
+
+#define LS_LINE_MAX 160
+
+// formata uma entrada do ls no fim do buffer
+static int lsFormatEntry(ls_output_t *out, const fs_entry_t *entry, int info_arg) {
+    if (out->cap - out->len < LS_LINE_MAX) {
+        size_t cap = out->cap ? out->cap * 2 : 8192;
+        char *data = realloc(out->data, cap);
+        if (!data) return -1;
+        out->data = data;
+        out->cap = cap;
+    }
+    char *line = out->data + out->len;
+    size_t room = out->cap - out->len;
+
+    // Determina tipo de arquivo (guardado na própria entrada do diretório)
+    char type = '-';
+    if (entry->type == FILE_DIRECTORY) type = 'd';
+    else if (entry->type == FILE_REGULAR) type = 'f';
+    else if (entry->type == FILE_SYMLINK) type = 'l';
+
+    if (!info_arg) {
+        out->len += snprintf(line, room, "-%c     %s\n", type, entry->name);
+        return 0;
+    }
+
+    // Formata permissões (rwxrwxrwx)
+    char perm_str[10] = "---------";
+    for (int who = 3; who >= 0; who -= 3) {
+        perm_str[8-who-2] = (entry->permissions & (PERM_READ << who)) ? 'r' : '-';
+        perm_str[8-who-1] = (entry->permissions & (PERM_WRITE << who)) ? 'w' : '-';
+        perm_str[8-who] = (entry->permissions & (PERM_EXEC << who)) ? 'x' : '-';
+    }
+
+    if (out->mtime_buf[0] == '\0' || entry->modification_date != out->last_mtime) {
+        format_time(entry->modification_date, out->mtime_buf, sizeof(out->mtime_buf));
+        out->last_mtime = entry->modification_date;
+    }
+
+    int n = snprintf(line, room, "%c %s %u %u %8lu %s %s",
+        type,
+        perm_str,
+        entry->owner_uid,
+        entry->creator_uid,
+        (unsigned long)entry->size,
+        out->mtime_buf,
+        entry->name
+    );
+
+    // Se for link simbólico, mostra o alvo
+    if (entry->type == FILE_SYMLINK && entry->link_target_index < MAX_INODES)
+        n += snprintf(line + n, room - n, " -> %s", inode_table[entry->link_target_index].name);
+    n += snprintf(line + n, room - n, "\n");
+    out->len += n;
+    return 0;
+}
+
 // _ls (lista elementos)
 int _ls(int current_inode, const char *path, int user_id, int info_arg) {
+    // "ls dir/prefixo*": lista só as entradas que começam com o prefixo
+    char dir_path[256], prefix[256] = "";
+    const char *star = path ? strchr(path, '*') : NULL;
+    if (star && star[1] == '\0' && strlen(path) < sizeof(dir_path)) {
+        splitPath(path, dir_path, prefix);
+        prefix[strlen(prefix) - 1] = '\0';
+        path = dir_path;
+    }
+
     // checa se o caminho existe
     UNREFERENCED(user_id);
     int target_inode = current_inode;
     if (path && strlen(path) > 0) {
         if (resolvePath(path, current_inode, &target_inode) != 0) {
-            printf("ls: caminho não encontrado: %s\n", path);
+            sessionPrintf("ls: caminho não encontrado: %s\n", path);
             return -1;
         }
     }
@@ -390,86 +650,45 @@ int _ls(int current_inode, const char *path, int user_id, int info_arg) {
     inode_t *dir_inode = &inode_table[target_inode];
 
     if (!hasPermission(dir_inode, user_id, PERM_EXEC) && user_id != ROOT_UID) {
-        printf("ls: Acesso negado, requer permissão X no diretório.\n");
+        sessionPrintf("ls: Acesso negado, requer permissão X no diretório.\n");
         return -1;
     }
 
     if (!hasPermission(dir_inode, user_id, PERM_READ) && user_id != ROOT_UID) {
-        printf("ls: Acesso negado, requer permissão R no diretório.\n");
+        sessionPrintf("ls: Acesso negado, requer permissão R no diretório.\n");
         return -1;
     }
 
-    // itera sobre cada next dentro do inode
-    do {
-        // itera sobre cada bloco dentro do inode do diretório
-        for (int block_idx = 0; block_idx < BLOCKS_PER_INODE; block_idx++) {
-            if (dir_inode->blocks[block_idx] == 0) continue;
-            
-            dir_entry_t *entries = malloc(BLOCK_SIZE);
-            if (readBlock(dir_inode->blocks[block_idx], entries) != 0) {
-                free(entries);
-                return -1;
-            }
-            
-            int entries_per_block = BLOCK_SIZE / sizeof(dir_entry_t);
-            for (int entry_idx = 0; entry_idx < entries_per_block; entry_idx++) {
-                if (entries[entry_idx].inode_index == 0)
-                    continue;
-
-                inode_t *entry_inode = &inode_table[entries[entry_idx].inode_index];
-
-                // Determina tipo de arquivo
-                char type = '-';
-                if (entry_inode->type == FILE_DIRECTORY) type = 'd';
-                else if (entry_inode->type == FILE_REGULAR) type = 'f';
-                else if (entry_inode->type == FILE_SYMLINK) type = 'l';
-                
-
-                // Caso utilize o argumento para emular o _ls - l
-                if (info_arg) {
-                    // Formata permissões (rwxrwxrwx)
-                    char perm_str[10] = "---------";
-                    for (int who = 3; who >= 0; who -= 3) {
-                        perm_str[8-who-2] = (entry_inode->permissions & (PERM_READ << who)) ? 'r' : '-';
-                        perm_str[8-who-1] = (entry_inode->permissions & (PERM_WRITE << who)) ? 'w' : '-';
-                        perm_str[8-who] = (entry_inode->permissions & (PERM_EXEC << who)) ? 'x' : '-';
-                    }
-
-                    // Formata datas
-                    char ctime_buf[32], mtime_buf[32];
-                    format_time(entry_inode->creation_date, ctime_buf, sizeof(ctime_buf));
-                    format_time(entry_inode->modification_date, mtime_buf, sizeof(mtime_buf));
-
-                    printf("%c %s %d %d %8lu %s %s", 
-                        type,
-                        perm_str,
-                        entry_inode->owner_uid,
-                        entry_inode->creator_uid,
-                        (unsigned long)entry_inode->size,
-                        mtime_buf, 
-                        entry_inode->name
-                    );
-
-                    // Se for link simbólico, mostra o alvo
-                    if (entry_inode->type == FILE_SYMLINK) {
-                        printf(" -> %s", inode_table[entry_inode->link_target_index].name);
-                    }
-                    printf("\n");
-                }
-                else {
-                    printf("-%c     %s\n", type, entry_inode->name);
-                }
-            }
-
-            free(entries);
-        }
-        dir_inode = &inode_table[dir_inode->next_inode];
-    } while (dir_inode->next_inode != 0);
-    return 0;
+    // entradas saem em ordem de nome (diretórios grandes já as guardam ordenadas), em lotes
+    // que já trazem os atributos do inode
+    dir_iter_t it;
+    if (dirIterOpen(&it, target_inode, prefix) != 0) return -1;
+
+    fs_entry_t entries[DIR_ITER_BATCH];
+    fs_dir_list_t batch = { entries, 0 };
+    ls_output_t out = { 0 };
+    int res;
+    while ((res = dirIterNext(&it, &batch)) > 0) {
+        for (int i = 0; i < batch.count && res >= 0; i++)
+            if (lsFormatEntry(&out, &entries[i], info_arg) != 0) res = -1;
+        if (res < 0) break;
+    }
+    dirIterClose(&it);
+
+    // uma única escrita para a listagem inteira (depois do que já estiver no buffer da sessão)
+    FILE *session_out = sessionOut();
+    fflush(session_out);
+    for (size_t done = 0; done < out.len; ) {
+        ssize_t w = write(fileno(session_out), out.data + done, out.len - done);
+        if (w <= 0) break;
+        done += (size_t)w;
+    }
+    free(out.data);
+    return res < 0 ? -1 : 0;
 }
 
-// remove elementos (usada tanto por _rmdir quanto por rm)
-int _rm(int current_inode, const char *filepath, int user_id, int remove_dir) {
+// remove elementos (usada tanto por _rmdir quanto por rm e rm -r)
+int _rm(int current_inode, const char *filepath, int user_id, int remove_dir, int recursive) {
     if (!filepath) return -1;
 
     char parent_path[1024];
@@ -482,16 +701,16 @@ int _rm(int current_inode, const char *filepath, int user_id, int remove_dir) {
     int parent_inode;
     if (resolvePath(parent_path, current_inode, &parent_inode) != 0) {
         if (remove_dir)
-            printf("rmdir: diretório não encontrado: %s\n", parent_path);
+            sessionPrintf("rmdir: diretório não encontrado: %s\n", parent_path);
         else
-            printf("Arquivo não encontrado\n");
+            sessionPrintf("Arquivo não encontrado\n");
         return -1;
     }
 
 
     inode_t *parent = &inode_table[parent_inode];
     if (!hasPermission(parent, user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
-        printf("rm: Acesso negado, requer permissões W e X no diretório pai.\n");
+        sessionPrintf("rm: Acesso negado, requer permissões W e X no diretório pai.\n");
         return -1;
     }
 
@@ -500,9 +719,9 @@ int _rm(int current_inode, const char *filepath, int user_id, int remove_dir) {
     int target_inode;
     if (dirFindEntry(parent_inode, name, FILE_ANY, &target_inode) != 0) {
         if (remove_dir)
-            printf("rmdir: não existe o diretório: %s\n", filepath);
+            sessionPrintf("rmdir: não existe o diretório: %s\n", filepath);
         else
-            printf("Arquivo não encontrado\n");
+            sessionPrintf("Arquivo não encontrado\n");
         return -1;
     }
 
@@ -511,21 +730,42 @@ int _rm(int current_inode, const char *filepath, int user_id, int remove_dir) {
     // Verifica conforme o tipo de rm (e.g. rm ou _rmdir)
     if (remove_dir) {
         if (target->type != FILE_DIRECTORY) {
-            printf("rmdir: não é um diretório: %s\n", filepath);
+            sessionPrintf("rmdir: não é um diretório: %s\n", filepath);
+            return -1;
+        }
+        int res = deleteDirectory(parent_inode, name, user_id);
+        if (res == DIR_BUSY) {
+            sessionPrintf("rmdir: não é possível remover '%s': é o diretório atual de uma sessão\n", filepath);
             return -1;
         }
-        if (deleteDirectory(parent_inode, name, user_id) != 0) {
-            printf("rmdir: não foi possível remover '%s'\n", filepath);
+        if (res != 0) {
+            sessionPrintf("rmdir: não foi possível remover '%s'\n", filepath);
+            return -1;
+        }
+        return 0;
+    } else if (recursive) {
+        // nenhum diretório atual (desta ou de outra sessão) pode sumir debaixo do shell
+        int res = removeTree(parent_inode, name, user_id);
+        if (res == DIR_BUSY) {
+            sessionPrintf("rm: não é possível remover '%s': contém o diretório atual de uma sessão\n", filepath);
+            return -1;
+        }
+        if (res == -2) {
+            sessionPrintf("rm: Acesso negado, requer permissões R, W e X em todos os diretórios de '%s'.\n", filepath);
+            return -1;
+        }
+        if (res != 0) {
+            sessionPrintf("rm: não foi possível remover '%s'\n", filepath);
             return -1;
         }
         return 0;
     } else {
         if (target->type == FILE_DIRECTORY) {
-            printf("rm: não é possível remover '%s': é um diretório\n", filepath);
+            sessionPrintf("rm: não é possível remover '%s': é um diretório (use rm -r)\n", filepath);
             return -1;
         }
         if (deleteFile(parent_inode, name, user_id) != 0) {
-            printf("Erro ao remover arquivo: %s\n", filepath);
+            sessionPrintf("Erro ao remover arquivo: %s\n", filepath);
             return -1;
         }
         return 0;
@@ -534,12 +774,12 @@ int _rm(int current_inode, const char *filepath, int user_id, int remove_dir) {
 
 // rm (remove arquivo)
 int rm(int current_inode, const char *filepath, int user_id) {
-    return _rm(current_inode, filepath, user_id, 0);
+    return _rm(current_inode, filepath, user_id, 0, 0);
 }
 
 // _rmdir (remove diretorio)
 int _rmdir(int current_inode, const char *filepath, int user_id) {
-    return _rm(current_inode, filepath, user_id, 1);
+    return _rm(current_inode, filepath, user_id, 1, 0);
 }
 
 int _unlink(int current_inode, const char *filepath, int user_id){
@@ -554,20 +794,20 @@ int _unlink(int current_inode, const char *filepath, int user_id){
     // resolve o inode do diretorio pai
     int parent_inode;
     if (resolvePath(parent_path, current_inode, &parent_inode) != 0) {
-        printf("Link não encontrado\n");
+        sessionPrintf("Link não encontrado\n");
         return -1;
     }
 
     // Procura o arquivo com o nome dentro do diretório pai
     int target_inode;
     if (dirFindEntry(parent_inode, name, FILE_ANY, &target_inode) != 0) {
-        printf("Link não encontrado\n");
+        sessionPrintf("Link não encontrado\n");
         return -1;
     }
 
     inode_t *parent = &inode_table[parent_inode];
     if (!hasPermission(parent, user_id, PERM_WRITE | PERM_EXEC) && user_id != ROOT_UID) {
-        printf("unlink: Acesso negado, requer permissões W e X no diretório pai.\n");
+        sessionPrintf("unlink: Acesso negado, requer permissões W e X no diretório pai.\n");
         return -1;
     }
 
@@ -575,154 +815,284 @@ int _unlink(int current_inode, const char *filepath, int user_id){
 
     // Verifica se é um link simbolico
     if (target->type != FILE_SYMLINK) {
-        printf("Alvo não é um link: %s\n", filepath);
+        sessionPrintf("Alvo não é um link: %s\n", filepath);
         return -1;
         }
 
     if (deleteSymlink(parent_inode, target_inode, user_id) != 0) {
-            printf("Não foi possível remover '%s'\n", filepath);
+            sessionPrintf("Não foi possível remover '%s'\n", filepath);
             return -1;
         }
     return 0;
 }
 
 int _df(){
-    int free_blocks = 0;
-
-    for (uint32_t i = 0; i < computed_data_blocks; i++){
-        uint32_t byte = i / 8;
-        uint8_t bit = i % 8;
-
-        if ((block_bitmap[byte] & (1 << bit)) == 0) {
-            free_blocks ++;
-        }
-    }
+    // contadores do alocador, sem varrer o bitmap; os arquivos apagados há pouco entram como livres
+    orphanFlush();
+    int free_blocks = freeBlockCount();
 
     int used_blocks = computed_data_blocks - free_blocks;
     int use_percentage = (used_blocks * 100 + computed_data_blocks -1) / computed_data_blocks;
 
-    printf("Filesystem     N-blocks     Used Available Use%% Mounted on\n");
-    printf("%-14s %-12d %-6d %-5d %3d%%   /~\n",
+    sessionPrintf("Filesystem     N-blocks     Used Available Use%% Mounted on\n");
+    sessionPrintf("%-14s %-12d %-6d %-5d %3d%%   /~\n",
            DISK_NAME, computed_data_blocks, used_blocks, free_blocks, use_percentage);
 
     return 0;
 }
 
-int _chmod(int current_inode, const char *path, const char* permission_str, int user_id) {
-// read - peso 4
-// write - peso 2
-// execute - peso 1
-// exemplo - 77 = rwx rwx
+// dedup (deduplicação de blocos: on | off | status | varredura offline)
+int _dedup(const char *arg, int user_id) {
+    if (arg && strcmp(arg, "status") == 0) {
+        uint32_t saved = sharedBlocksSaved();
+        sessionPrintf("Deduplicação inline: %s\n", (fs_features & FS_FEATURE_DEDUP) ? "ativada" : "desativada");
+        sessionPrintf("Blocos economizados por compartilhamento: %u (%u KB)\n", saved, saved * BLOCK_SIZE / 1024);
+        return 0;
+    }
+
+    if (user_id != ROOT_UID) {
+        sessionPrintf("dedup: Acesso negado, você precisa ser root para utilizar esse comando. Utilize o comando 'sudo'\n");
+        return -1;
+    }
+
+    if (arg && strcmp(arg, "on") == 0)
+        return set_fs_features(fs_features | FS_FEATURE_DEDUP);
+    if (arg && strcmp(arg, "off") == 0)
+        return set_fs_features(fs_features & ~FS_FEATURE_DEDUP);
+    if (arg && arg[0] != '\0') {
+        sessionPrintf("Uso: dedup [on|off|status]\n");
+        return -1;
+    }
+
+    dedup_report_t report;
+    uint32_t saved_before = sharedBlocksSaved();
+    if (dedupScan(&report) != 0) {
+        sessionPrintf("dedup: erro ao varrer o disco\n");
+        return -1;
+    }
+    uint32_t saved = sharedBlocksSaved();
+
+    sessionPrintf("Arquivos verificados: %u\n", report.files);
+    sessionPrintf("Blocos verificados:   %u\n", report.blocks_scanned);
+    sessionPrintf("Blocos duplicados liberados: %u (%u KB)\n", report.blocks_merged, report.blocks_merged * BLOCK_SIZE / 1024);
+    sessionPrintf("Economia total por compartilhamento: %u blocos (%u KB, antes %u KB)\n",
+           saved, saved * BLOCK_SIZE / 1024, saved_before * BLOCK_SIZE / 1024);
+    return 0;
+}
+
+// compress (compressão transparente por arquivo: on | off | status)
+int _compress(int current_inode, const char *path, const char *mode, int user_id) {
     int target_inode;
     if (resolvePath(path, current_inode, &target_inode) != 0) {
-        printf("chmod: esse arquivo não existe\n");
+        sessionPrintf("compress: esse arquivo não existe\n");
         return -1;
     }
-        
 
     inode_t *inode = &inode_table[target_inode];
+    if (inode->type != FILE_REGULAR) {
+        sessionPrintf("compress: %s não é um arquivo regular\n", path);
+        return -1;
+    }
 
-    // Somente dono pode alterar permissões
-    if (inode->owner_uid != user_id & user_id != ROOT_UID) {
-        printf("chmod: Acesso negado, apenas o dono pode usar chmod.\n");
+    uint32_t logical_blocks = (inode->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    if (!mode || mode[0] == '\0' || strcmp(mode, "status") == 0) {
+        uint32_t stored = countInodeBlocks(target_inode);
+        sessionPrintf("%s: %s, %u bytes em %u blocos (taxa %.2fx)\n", path,
+               (inode->flags & INODE_FLAG_COMPRESSED) ? "comprimido" : "normal",
+               inode->size, stored, stored ? (double)logical_blocks / stored : 1.0);
+        return 0;
+    }
+
+    // Somente dono pode alterar o formato do arquivo
+    if (inode->owner_uid != (uint32_t)user_id && user_id != ROOT_UID) {
+        sessionPrintf("compress: Acesso negado, apenas o dono pode usar compress.\n");
         return -1;
     }
 
-    uint8_t new_perm;
-    if (parse_octal_permissions(permission_str, &new_perm) != 0) {
-        printf("chmod: formato inválido (use octal, ex: 75, 64, 60)\n");
+    int enable;
+    if (strcmp(mode, "on") == 0) enable = 1;
+    else if (strcmp(mode, "off") == 0) enable = 0;
+    else {
+        sessionPrintf("Uso: compress <arquivo> [on|off|status]\n");
         return -1;
     }
 
-    inode->permissions = new_perm;
-    sync_fs();
-    
+    uint32_t before = countInodeBlocks(target_inode);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (setInodeCompression(target_inode, enable) != 0) {
+        sessionPrintf("compress: não foi possível converter '%s'\n", path);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    uint32_t after = countInodeBlocks(target_inode);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    sessionPrintf("%s: %u -> %u blocos (taxa %.2fx), %.1f MB/s\n", path, before, after,
+           after ? (double)logical_blocks / after : 1.0,
+           seconds > 0 ? inode->size / seconds / (1024 * 1024) : 0.0);
     return 0;
 }
 
+// scrub (verificação dos checksums de todos os blocos)
+int _scrub(const char *threads_arg, int user_id) {
+    if (user_id != ROOT_UID) {
+        sessionPrintf("scrub: Acesso negado, você precisa ser root para utilizar esse comando. Utilize o comando 'sudo'\n");
+        return -1;
+    }
 
+    int nthreads = threads_arg ? atoi(threads_arg) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1) {
+        sessionPrintf("Uso: scrub [threads]\n");
+        return -1;
+    }
 
-int assert_user_exists(const char* username) {
-    char* content;
-    _cat(ROOT_INODE, passwd_path, ROOT_UID, &content); // Lê o arquivo passwd para encontrar o usuário e seu UID
-
-    char* line_ptr = strtok(content, "\n"); // Itera sobre cada linha do passwd
-    while (line_ptr != NULL) {
+    scrub_report_t report;
+    int res = scrub_fs(nthreads, &report);
+    if (res < 0) {
+        sessionPrintf("scrub: erro ao verificar o disco\n");
+        return -1;
+    }
 
-        char *colon1_ptr = strchr(line_ptr, ':'); // Procura o ':' que divide as linhas do passwd que contém <nome>:x:<UID>. Nesse caso será utilizado como marcador para o final da string.
+    sessionPrintf("Threads: %u (crc32c: %s)\n", report.threads, crc32cImplementation());
+    sessionPrintf("Blocos de dados verificados: %u\n", report.blocks_checked);
+    if (report.blocks_unverified)
+        sessionPrintf("Blocos sem checksum: %u\n", report.blocks_unverified);
+    sessionPrintf("Erros em dados: %u, erros em metadados: %u\n", report.data_errors, report.meta_errors);
+    sessionPrintf("%.1f MB lidos em %.3fs (%.1f MB/s)\n", report.bytes_read / (1024.0 * 1024), report.seconds,
+           report.seconds > 0 ? report.bytes_read / report.seconds / (1024 * 1024) : 0.0);
+    return res;
+}
 
-        int name_length = colon1_ptr - line_ptr; // calcula o número de carácteres do inicio da linha até o colon ':'
-        char username_found[name_length + 1]; 
-        strncpy(username_found, line_ptr, name_length); // copia somente o nome do usuario
-        username_found[name_length] = '\0';
+// userdb (formato da base de usuários: status | binary [capacidade] | text)
+int _userdb(const char *arg, const char *capacity_arg, int user_id) {
+    userdb_super_t status;
+    if (!arg || strcmp(arg, "status") == 0) {
+        if (userdbStatus(&status) != 0) {
+            sessionPrintf("userdb: erro ao ler a base de usuários\n");
+            return -1;
+        }
+        int binary = (fs_features & FS_FEATURE_USERDB) != 0;
+        sessionPrintf("Formato: %s\n", binary ? "binário" : "texto (passwd/shadow)");
+        sessionPrintf("Usuários: %u, próximo uid: %u\n", status.count, status.next_uid);
+        if (binary) {
+            sessionPrintf("Capacidade: %u uids, região de %u blocos (%u KB)\n",
+                   status.capacity, userdb_blocks, userdb_blocks * BLOCK_SIZE / 1024);
+            sessionPrintf("Visões: %s (%u B), %s (%u B)\n",
+                   status.passwd_inode != USERDB_NO_VIEW ? passwd_path : "passwd removido", status.passwd_bytes,
+                   status.shadow_inode != USERDB_NO_VIEW ? shadow_path : "shadow removido", status.shadow_bytes);
+        }
+        return 0;
+    }
 
+    if (user_id != ROOT_UID) {
+        sessionPrintf("userdb: Acesso negado, você precisa ser root para utilizar esse comando. Utilize o comando 'sudo'\n");
+        return -1;
+    }
 
-        if (strcmp(username_found, username) == 0) { // usuário encontrado, procura o UID agora
+    if (strcmp(arg, "binary") == 0) {
+        if (fs_features & FS_FEATURE_USERDB) {
+            sessionPrintf("userdb: a base já está no formato binário\n");
+            return 0;
+        }
+        int next = userdbNextUid();
+        long capacity = capacity_arg ? atol(capacity_arg) : USERDB_DEFAULT_CAPACITY;
+        if (!capacity_arg && capacity < 2L * next) capacity = 2L * next;
+        if (capacity < 1 || capacity > USERDB_MAX_CAPACITY) {
+            sessionPrintf("userdb: capacidade deve estar entre 1 e %d\n", USERDB_MAX_CAPACITY);
+            return -1;
+        }
+        if (capacity < next) {
+            sessionPrintf("userdb: capacidade %ld menor que o maior uid em uso (%d)\n", capacity, next - 1);
+            return -1;
+        }
+        if (userdbToBinary((uint32_t)capacity) != 0) {
+            sessionPrintf("userdb: erro ao converter a base (espaço contíguo insuficiente?)\n");
+            return -1;
+        }
+        sessionPrintf("Base de usuários convertida para o formato binário (capacidade %ld uids)\n", capacity);
+        return 0;
+    }
 
-            char *colon2_ptr = strchr(colon1_ptr + 1, ':'); // <nome>:x:<UID> (ponteiro posicionado no último colon ':' para encotrar UID)
+    if (strcmp(arg, "text") == 0) {
+        if (!(fs_features & FS_FEATURE_USERDB)) {
+            sessionPrintf("userdb: a base já está em %s e %s\n", passwd_path, shadow_path);
+            return 0;
+        }
+        if (userdbToText() != 0) {
+            sessionPrintf("userdb: erro ao regravar %s e %s\n", passwd_path, shadow_path);
+            return -1;
+        }
+        sessionPrintf("Base de usuários convertida para %s e %s\n", passwd_path, shadow_path);
+        return 0;
+    }
 
-            char *uid_str = colon2_ptr + 1; // CUIDADO, PRECISO VERIFICAR SE ESSE PONTEIRO PODE INCLUIR O '\n' DO FINAL DA STRING
+    sessionPrintf("Uso: userdb [status | binary [capacidade] | text]\n");
+    return -1;
+}
 
-            int uid = atoi(uid_str); // converte a string para inteiro
-            free(content);
+int _chmod(int current_inode, const char *path, const char* permission_str, int user_id) {
+// read - peso 4
+// write - peso 2
+// execute - peso 1
+// exemplo - 77 = rwx rwx
+    int target_inode;
+    if (resolvePath(path, current_inode, &target_inode) != 0) {
+        sessionPrintf("chmod: esse arquivo não existe\n");
+        return -1;
+    }
+        
 
-            return uid;
-        }
+    uint8_t new_perm;
+    if (parse_octal_permissions(permission_str, &new_perm) != 0) {
+        sessionPrintf("chmod: formato inválido (use octal, ex: 75, 64, 60)\n");
+        return -1;
+    }
 
-        line_ptr = strtok(NULL, "\n"); // pula de linha
+    // Somente dono pode alterar permissões (conferido com a trava do inode)
+    int res = setInodePermissions(target_inode, new_perm, user_id);
+    if (res == -2) {
+        sessionPrintf("chmod: Acesso negado, apenas o dono pode usar chmod.\n");
+        return -1;
     }
+    if (res != 0) {
+        sessionPrintf("chmod: esse arquivo não existe\n");
+        return -1;
+    }
+    return 0;
+}
 
-    free(content);
-    return -1;
+
+
+// uid do usuário (consulta a base em memória, sem reler o passwd), -1 se não existe
+int assert_user_exists(const char* username) {
+    return userdbUidOf(username);
 }
 
 
 int _chown(int current_inode, const char *path, const char* new_owner, int user_id) {
-    if (user_id != ROOT_UID) {printf("chown: Acesso negado, você precisa ser root para utilizar esse comando. Utilize o comando 'sudo'\n"); return -1; }
+    if (user_id != ROOT_UID) {sessionPrintf("chown: Acesso negado, você precisa ser root para utilizar esse comando. Utilize o comando 'sudo'\n"); return -1; }
     int new_owner_uid = assert_user_exists(new_owner);
-    if (new_owner_uid == -1) {printf("chown: O usuário %s não existe\n", new_owner); return -1;}
+    if (new_owner_uid == -1) {sessionPrintf("chown: O usuário %s não existe\n", new_owner); return -1;}
 
     int target_inode;
     if (resolvePath(path, current_inode, &target_inode) != 0) {
-        printf("chown: esse arquivo não existe\n");
+        sessionPrintf("chown: esse arquivo não existe\n");
         return -1;
     }
 
-    inode_t *inode = &inode_table[target_inode];
-    inode->owner_uid = new_owner_uid;
-    sync_fs();
+    if (setInodeOwner(target_inode, new_owner_uid) != 0) {
+        sessionPrintf("chown: esse arquivo não existe\n");
+        return -1;
+    }
     return 0;
 }
 
 // Utils
 
 int get_next_uid() {
-    char *content = NULL;
-
-    // Lê o arquivo passwd
-    _cat(ROOT_INODE, passwd_path, ROOT_UID, &content);
-    if (!content) return -1;
-
-    char buffer[2048];
-    strncpy(buffer, content, sizeof(buffer) - 1);
-    buffer[sizeof(buffer) - 1] = '\0';
-    free(content);
-
-    // tratamento caso o passwd termine com '\n'
-    size_t len = strlen(buffer);
-    if (len > 0 && buffer[len - 1] == '\n')
-        buffer[len - 1] = '\0';
-
-    // encontra a última linha
-    char *last_line_break = strrchr(buffer, '\n');
-    char *last_line = last_line_break ? last_line_break + 1 : buffer;
-
-    // encontra o último 'colon' o do UID
-    char *last_colon = strrchr(last_line, ':');
-    if (!last_colon) return -1;
-
-    int uid = atoi(last_colon + 1);
-    return uid + 1;
+    return userdbNextUid();
 }
 
 int create_root() {
@@ -734,134 +1104,376 @@ int create_root() {
 }
 
 int create_user() {
-    char username[MAX_NAMESIZE], password[MAX_PASSWORD_SIZE], passwd_entry[MAX_PASSWD_ENTRY], shadow_entry[MAX_SHADOW_ENTRY], encrypted_password[MAX_HASH_SIZE], user_home[MAX_NAMESIZE + 7];
-    int passwd_inode, shadow_inode;
+    char username[MAX_NAMESIZE], password[MAX_PASSWORD_SIZE], encrypted_password[MAX_HASH_SIZE], user_home[MAX_NAMESIZE + 7];
 
 
     // Input do Usuário
-    printf("------------ Criação de usuário -----------\n\n");
-    printf("Digite o nome do usuário a ser criado: ");
-    fgets(username, MAX_NAMESIZE, stdin);
-    printf("Defina a senha: ");
-    fgets(password, MAX_PASSWORD_SIZE, stdin);
+    sessionPrintf("------------ Criação de usuário -----------\n\n");
+    sessionPrintf("Digite o nome do usuário a ser criado: ");
+    if (!sessionGets(username, MAX_NAMESIZE)) return -1;
+    sessionPrintf("Defina a senha: ");
+    if (!sessionGets(password, MAX_PASSWORD_SIZE)) return -1;
 
     // Remove o '\n'
     username[strcspn(username, "\n")] = '\0';
     password[strcspn(password, "\n")] = '\0';
 
-    // Obtendo os I-Nodes do passwd e shadow
-    resolvePath(passwd_path, ROOT_INODE, &passwd_inode);
-    resolvePath(shadow_path, ROOT_INODE, &shadow_inode);
+    if (assert_user_exists(username) != -1) {
+        sessionPrintf("O usuário %s já existe!\n\n", username);
+        return -1;
+    }
 
     // obtém o próximo UID disponível
     int new_uid = get_next_uid();
-    
-    // Lógica do passwd
-    snprintf(passwd_entry, sizeof(passwd_entry), "%s:x:%d\n", username, new_uid);
-    addContentToInode(passwd_inode, passwd_entry, strlen(passwd_entry), ROOT_UID);
 
-    
-    // Lógica do shadow
+    // passwd e shadow recebem as linhas novas e a base em memória é atualizada junto
     encrypt_password(password, encrypted_password);
-    snprintf(shadow_entry, sizeof(shadow_entry), "%s:%s\n", username, encrypted_password);
-    addContentToInode(shadow_inode, shadow_entry, strlen(shadow_entry), ROOT_UID);
+    if (userdbAppend(username, new_uid, encrypted_password) != 0) {
+        sessionPrintf("Erro ao criar o usuário %s\n\n", username);
+        return -1;
+    }
 
     // Cria a home do usuário
     snprintf(user_home, sizeof(user_home), "home/%s/", username);
     _mkdir(ROOT_INODE, user_home, new_uid);
-    printf("Usuário criado!\n\n");
+    sessionPrintf("Usuário criado!\n\n");
     return 0;
 }
 
 
-int login(const char* username, const char* password, int uid) {
-    char* content;
-    char password_found[MAX_HASH_SIZE];
-
-    // Buffers precisam ser zerados antes do uso
-    password_found[0] = '\0';
-    _cat(ROOT_INODE, shadow_path, ROOT_UID, &content);
-    // Itera linhas
-    char* line = strtok(content, "\n");
-    while (line != NULL)
-    {
-        // Manipulação da string para encontrar o usuário no shadow <nome_usuario>:<hash da senha>
-        char* colon1_ptr = strchr(line, ':');  // posiciona um ponteiro no colon para obter o tamanho do nome
-
-        int user_length = colon1_ptr - line;
-
-        char username_found[user_length + 1];
-        strncpy(username_found, line, user_length);
-        username_found[user_length] = '\0';
-
-        // Compara usuário
-        if (strcmp(username_found, username) == 0) {
-            // usuário encontrado!
-            // manipulação da string para obter o hash da senha
-            size_t end_line = strcspn(colon1_ptr + 1, "\n");
-            strncpy(password_found, colon1_ptr + 1, end_line);
-            password_found[end_line] = '\0';
-
-            if (strcmp(password_found, crypt(password, password_found)) == 0) { // caso o hash da senha informada coincida com o hash da senha armazenada, autentica o usuário
-                authenticated_uid = uid;
-            } else {
-                authenticated_uid = -1;
-            }
-            break;
+// create-users: uma linha "nome:senha" da lista
+typedef struct {
+    char name[MAX_NAMESIZE];
+    char password[MAX_PASSWORD_SIZE];
+    int line;
+    int skip;
+} new_user_t;
+
+typedef struct {
+    new_user_t *users;
+    userdb_entry_t *entries;
+    int first, end;
+    int failed;
+} hash_worker_t;
+
+static int compareNewUserNames(const void *a, const void *b) {
+    const new_user_t *x = a, *y = b;
+    int res = strcmp(x->name, y->name);
+    return res != 0 ? res : x->line - y->line;
+}
+
+static int compareNewUserLines(const void *a, const void *b) {
+    return ((const new_user_t *)a)->line - ((const new_user_t *)b)->line;
+}
+
+// cada thread gera os hashes de uma faixa contígua da lista, com a sua própria crypt_data
+static void *hashWorker(void *arg) {
+    hash_worker_t *w = arg;
+    struct crypt_data *data = calloc(1, sizeof(struct crypt_data));
+    for (int i = w->first; i < w->end; i++) {
+        if (!data || encrypt_password_r(w->users[i].password, w->entries[i].hash, data) != 0) w->failed++;
+        memset(w->users[i].password, 0, MAX_PASSWORD_SIZE);
+    }
+    free(data);
+    return NULL;
+}
+
+static new_user_t *readUserList(FILE *in, int from_stdin, int *out_count) {
+    new_user_t *users = NULL;
+    int count = 0, cap = 0, line_no = 0;
+    char line[MAX_NAMESIZE + MAX_PASSWORD_SIZE + 8];
+
+    while (fgets(line, sizeof(line), in)) {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            if (from_stdin) break;      // linha vazia encerra a lista digitada
+            continue;
+        }
+
+        char *colon = strchr(line, ':');
+        if (!colon || colon == line || colon - line >= MAX_NAMESIZE ||
+            strlen(colon + 1) >= MAX_PASSWORD_SIZE || strcspn(line, "/ ") < (size_t)(colon - line)) {
+            sessionPrintf("create-users: linha %d inválida (use nome:senha)\n", line_no);
+            continue;
+        }
+        *colon = '\0';
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 256;
+            new_user_t *grown = realloc(users, cap * sizeof(new_user_t));
+            if (!grown) break;
+            users = grown;
         }
+        new_user_t *user = &users[count++];
+        strcpy(user->name, line);
+        strcpy(user->password, colon + 1);
+        user->line = line_no;
+        user->skip = 0;
+    }
+    memset(line, 0, sizeof(line));
+
+    *out_count = count;
+    return users;
+}
+
+// create-users (cria em lote os usuários listados, com os hashes gerados em paralelo)
+int _create_users(int current_inode, const char *list_path, int user_id) {
+    if (!list_path) return -1;
+    if (user_id != ROOT_UID) {
+        sessionPrintf("create-users: Acesso negado, você precisa ser root para utilizar esse comando. Utilize o comando 'sudo'\n");
+        return -1;
+    }
 
-        line = strtok(NULL, "\n");
+    int from_stdin = strcmp(list_path, "-") == 0;
+    char *content;
+    FILE *in = openList(current_inode, list_path, user_id, &content);
+    if (!in) {
+        sessionPrintf("create-users: não foi possível ler '%s'\n", list_path);
+        return -1;
     }
 
-    printf("%s\n", authenticated_uid != -1 ? "Usuário autenticado!\n" : "Login inválido!");
+    struct timespec start, hashed, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    free(content);
+    int count;
+    new_user_t *users = readUserList(in, from_stdin, &count);
+    if (!from_stdin) fclose(in);
+    if (content) {
+        memset(content, 0, strlen(content));     // senhas em texto puro
+        free(content);
+    }
+
+    // nomes repetidos na lista (vale a primeira linha) ou já existentes ficam de fora
+    int skipped = 0;
+    qsort(users, count, sizeof(new_user_t), compareNewUserNames);
+    for (int i = 0; i < count; i++) {
+        if ((i > 0 && strcmp(users[i].name, users[i - 1].name) == 0) || assert_user_exists(users[i].name) != -1) {
+            sessionPrintf("create-users: o usuário %s já existe\n", users[i].name);
+            users[i].skip = 1;
+            skipped++;
+        }
+    }
+    qsort(users, count, sizeof(new_user_t), compareNewUserLines);
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+        if (!users[i].skip) users[kept++] = users[i];
+
+    // uids em sequência, na ordem da lista
+    userdb_entry_t *entries = calloc(kept ? kept : 1, sizeof(userdb_entry_t));
+    int next_uid = get_next_uid();
+    if (!entries || next_uid < 0) {
+        sessionPrintf("create-users: erro ao preparar a lista\n");
+        free(entries);
+        if (users) memset(users, 0, count * sizeof(new_user_t));
+        free(users);
+        return -1;
+    }
+    for (int i = 0; i < kept; i++) {
+        strcpy(entries[i].name, users[i].name);
+        entries[i].uid = next_uid + i;
+    }
+
+    // hashes em paralelo
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > CREATE_USERS_MAX_THREADS) nthreads = CREATE_USERS_MAX_THREADS;
+    if (nthreads > kept) nthreads = kept;
+    if (nthreads < 1) nthreads = 1;
+
+    pthread_t threads[CREATE_USERS_MAX_THREADS];
+    hash_worker_t workers[CREATE_USERS_MAX_THREADS];
+    int threaded[CREATE_USERS_MAX_THREADS] = {0};
+    int per_thread = (kept + nthreads - 1) / nthreads, hash_errors = 0;
+    for (int t = 0; t < nthreads; t++) {
+        int first = t * per_thread, end = first + per_thread < kept ? first + per_thread : kept;
+        workers[t] = (hash_worker_t){ .users = users, .entries = entries, .first = first, .end = end };
+        threaded[t] = t > 0 && pthread_create(&threads[t], NULL, hashWorker, &workers[t]) == 0;
+    }
+    // a thread que chama faz a primeira faixa (e as de threads que não subiram)
+    for (int t = 0; t < nthreads; t++)
+        if (!threaded[t]) hashWorker(&workers[t]);
+    for (int t = 0; t < nthreads; t++) {
+        if (threaded[t]) pthread_join(threads[t], NULL);
+        hash_errors += workers[t].failed;
+    }
+    // as senhas dos ignorados (de kept em diante) não passaram pelos workers
+    if (users) memset(users, 0, count * sizeof(new_user_t));
+    free(users);
+    clock_gettime(CLOCK_MONOTONIC, &hashed);
+
+    if (hash_errors > 0 || userdbAppendMany(entries, kept) != 0) {
+        sessionPrintf("create-users: erro ao gravar os usuários\n");
+        free(entries);
+        return -1;
+    }
+
+    // homes num lote só: um pai, uma passada pelo diretório, um sync
+    int home_inode, homes = 0;
+    create_request_t *reqs = malloc((kept ? kept : 1) * sizeof(create_request_t));
+    if (reqs && (resolvePath("home", ROOT_INODE, &home_inode) == 0 ||
+                 (createDirectoriesRecursively("home", ROOT_INODE, ROOT_UID) == 0 &&
+                  resolvePath("home", ROOT_INODE, &home_inode) == 0))) {
+        for (int i = 0; i < kept; i++) {
+            strcpy(reqs[i].name, entries[i].name);
+            reqs[i].type = FILE_DIRECTORY;
+            reqs[i].owner_uid = entries[i].uid;
+        }
+        createEntries(home_inode, reqs, kept, ROOT_UID);
+        for (int i = 0; i < kept; i++)
+            if (reqs[i].result == 0) homes++;
+    }
+    free(reqs);
+    free(entries);
+    sync_fs();
+    clock_gettime(CLOCK_MONOTONIC, &done);
+
+    double hash_secs = (hashed.tv_sec - start.tv_sec) + (hashed.tv_nsec - start.tv_nsec) / 1e9;
+    double total_secs = (done.tv_sec - start.tv_sec) + (done.tv_nsec - start.tv_nsec) / 1e9;
+    sessionPrintf("create-users: %d criados, %d ignorados, %d homes criadas\n", kept, skipped, homes);
+    sessionPrintf("Hashes: %.3fs com %d thread(s), total %.3fs\n", hash_secs, nthreads, total_secs);
+    return homes == kept ? 0 : -1;
+}
+
+int login(const char* username, const char* password, int uid) {
+    // hash da senha guardado no shadow <nome_usuario>:<hash da senha>
+    const char *password_found = userdbPasswordHash(username);
+
+    // caso o hash da senha informada coincida com o hash da senha armazenada, autentica o usuário
+    static __thread struct crypt_data data;     // crypt() não é reentrante: sessões fazem login em paralelo
+    data.initialized = 0;
+    const char *attempt = password_found ? crypt_r(password, password_found, &data) : NULL;
+    if (attempt && strcmp(password_found, attempt) == 0) {
+        authenticated_uid = uid;
+    } else {
+        authenticated_uid = -1;
+    }
+
+    sessionPrintf("%s\n", authenticated_uid != -1 ? "Usuário autenticado!\n" : "Login inválido!");
     return authenticated_uid;
 }
 
 
+/* ---- sudo: tickets de autenticação ----
+   Depois de uma autenticação bem-sucedida, novos sudo do mesmo usuário na mesma sessão
+   dispensam a senha (e o crypt) enquanto o ticket não expirar. O ticket guarda o hash da
+   senha da época: se a senha mudar, ele deixa de valer */
+typedef struct {
+    int valid;
+    int uid;
+    uint64_t session;
+    char password_hash[MAX_HASH_SIZE];
+    struct timespec issued;
+} sudo_ticket_t;
+
+static __thread sudo_ticket_t sudo_ticket;
+static __thread uint64_t session_id = 0;
+__thread int sudo_timeout = SUDO_TICKET_TIMEOUT;
+
+// nova sessão de login: tickets de sessões anteriores não valem mais
+void start_session(void) {
+    if (getrandom(&session_id, sizeof(session_id), 0) != sizeof(session_id)) session_id++;
+    sudo_ticket.valid = 0;
+}
+
+static double secondsSince(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int sudoTicketValid(int uid) {
+    if (!sudo_ticket.valid || sudo_ticket.uid != uid || sudo_ticket.session != session_id) return 0;
+    if (secondsSince(&sudo_ticket.issued) >= sudo_timeout) return 0;
+
+    // senha trocada desde a autenticação
+    const char *hash = userdbPasswordHash(username);
+    return hash && strcmp(hash, sudo_ticket.password_hash) == 0;
+}
+
+static void sudoTicketIssue(int uid) {
+    const char *hash = userdbPasswordHash(username);
+    sudo_ticket.valid = sudo_timeout > 0 && hash != NULL;
+    if (!sudo_ticket.valid) return;
+    sudo_ticket.uid = uid;
+    sudo_ticket.session = session_id;
+    strncpy(sudo_ticket.password_hash, hash, MAX_HASH_SIZE - 1);
+    sudo_ticket.password_hash[MAX_HASH_SIZE - 1] = '\0';
+    clock_gettime(CLOCK_MONOTONIC, &sudo_ticket.issued);
+}
+
+// pede a senha (até 3 tentativas), a menos que haja um ticket válido
+static int sudoAuthenticate(int uid) {
+    if (sudoTicketValid(uid)) {
+        clock_gettime(CLOCK_MONOTONIC, &sudo_ticket.issued);
+        return 0;
+    }
+
+    int tries = 3, old_uid = authenticated_uid;
+    char password[MAX_PASSWORD_SIZE];
+    while (tries)
+    {
+        sessionPrintf("Senha: ");
+        if (!sessionGets(password, MAX_PASSWORD_SIZE)) break;
+        password[strcspn(password, "\n")] = '\0';
+        if (login(username, password, uid) != -1) {
+            sudoTicketIssue(uid);
+            return 0;
+        }
+        tries--;
+    }
+    // restaura o uid anterior caso o usuário gaste todas as tentativas.
+    authenticated_uid = old_uid;
+    return -1;
+}
+
+
 // CMD IMPLEMENTATION
 
 
 void cmd_cd(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
-    if (!arg1) { printf("Uso: cd <dir>\n"); return; }
+    if (!arg1) { sessionPrintf("Uso: cd <dir>\n"); return; }
     UNREFERENCED(arg1); UNREFERENCED(arg2); UNREFERENCED(arg3);
     _cd(current_inode, arg1, uid);
 }
 
 
 void cmd_mkdir(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
-    if (!arg1) { printf("Uso: mkdir <nome>\n"); return; }
+    if (!arg1) { sessionPrintf("Uso: mkdir <nome>\n"); return; }
     UNREFERENCED(arg2); UNREFERENCED(arg3);
     _mkdir(*current_inode, arg1, uid);
 }
 
 void cmd_touch(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
-    if (!arg1) { printf("Uso: touch <arquivo>\n"); return; }
+    if (!arg1) { sessionPrintf("Uso: touch <arquivo>\n"); return; }
     UNREFERENCED(arg2); UNREFERENCED(arg3);
     _touch(*current_inode, arg1, uid);
 }
 
 void cmd_rm(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
-    if (!arg1) { printf("Uso: rm <arquivo>\n"); return; }
-    UNREFERENCED(arg2); UNREFERENCED(arg3);
+    UNREFERENCED(arg3);
+    if (arg1 && strcmp(arg1, "-r") == 0) {
+        if (!arg2) { sessionPrintf("Uso: rm [-r] <arquivo>\n"); return; }
+        _rm(*current_inode, arg2, uid, 0, 1);
+        return;
+    }
+    if (!arg1) { sessionPrintf("Uso: rm [-r] <arquivo>\n"); return; }
     rm(*current_inode, arg1, uid);
 }
 
 void cmd_clear(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
     UNREFERENCED(current_inode); UNREFERENCED(arg1); UNREFERENCED(arg2); UNREFERENCED(arg3); UNREFERENCED(uid);
-    system("clear");
+    sessionPrintf("\033[H\033[2J");       // o mesmo que clear(1), mas chega ao terminal da sessão
 }
 
 void cmd_rmdir(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
-    if (!arg1) { printf("Uso: rmdir <dir>\n"); return; }
+    if (!arg1) { sessionPrintf("Uso: rmdir <dir>\n"); return; }
     UNREFERENCED(arg2); UNREFERENCED(arg3);
     _rmdir(*current_inode, arg1, uid);
 }
 
 void cmd_echo(int *current_inode, const char *content, const char *redir, const char *filename, int uid) {
     if (!content || !redir || !filename) {
-        printf("Uso: echo <conteudo> >|>> <arquivo>\n");
+        sessionPrintf("Uso: echo <conteudo> >|>> <arquivo>\n");
         return;
     }
 
@@ -872,16 +1484,16 @@ void cmd_echo(int *current_inode, const char *content, const char *redir, const
         _echo_arrow_arrow(*current_inode, filename, content, uid);
 
     else
-        printf("Operador inválido: %s (use > ou >>)\n", redir);
+        sessionPrintf("Operador inválido: %s (use > ou >>)\n", redir);
 }
 
 void cmd_cat(int *current_inode, const char *file, const char *arg2, const char *arg3, int uid) {
-    if (!file) { printf("Uso: cat <arquivo>\n"); return; }
+    if (!file) { sessionPrintf("Uso: cat <arquivo>\n"); return; }
     UNREFERENCED(arg2); UNREFERENCED(arg3);
     char *content = NULL;
 
     if (_cat(*current_inode, file, uid, &content) != -1)
-        printf("%s\n", content);
+        sessionPrintf("%s\n", content);
 
     free(content);
 }
@@ -897,14 +1509,19 @@ void cmd_ls(int *current_inode, const char *arg1, const char *arg2, const char *
 
 
 void cmd_cp(int *current_inode, const char *src, const char *dst, const char *arg3, int uid) {
-    if (!src || !dst) { printf("Uso: cp <src> <dst>\n"); return; }
+    if (src && strcmp(src, "--reflink") == 0) {
+        if (!dst || !arg3) { sessionPrintf("Uso: cp [--reflink] <src> <dst>\n"); return; }
+        _cp(*current_inode, ".", dst, ".", arg3, uid, 1);
+        return;
+    }
+    if (!src || !dst) { sessionPrintf("Uso: cp [--reflink] <src> <dst>\n"); return; }
     UNREFERENCED(arg3);
-    _cp(*current_inode, ".", src, ".", dst, uid);
+    _cp(*current_inode, ".", src, ".", dst, uid, 0);
 }
 
 
 void cmd_mv(int *current_inode, const char *src, const char *dst, const char *arg3, int uid) {
-    if (!src || !dst) { printf("Uso: mv <src> <dst>\n"); return; }
+    if (!src || !dst) { sessionPrintf("Uso: mv <src> <dst>\n"); return; }
     UNREFERENCED(arg3);
     _mv(*current_inode, ".", src, ".", dst, uid);
 }
@@ -912,32 +1529,33 @@ void cmd_mv(int *current_inode, const char *src, const char *dst, const char *ar
 
 void cmd_ln(int *current_inode, const char *opt, const char *src, const char *dst, int uid) {
     if (!opt || !src || !dst || strcmp(opt, "-s") != 0) {
-        printf("Uso: ln -s <src> <dst>\n");
+        sessionPrintf("Uso: ln -s <src> <dst>\n");
         return;
     }
     _ln_s(*current_inode, src, dst, uid);
 }
 
 void cmd_sudo(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
-    if (!arg1) { printf("Uso: sudo <comando> <args>\n"); return; }
-    int handled = 0, tries = 3, old_uid = authenticated_uid;
-    char password[MAX_PASSWORD_SIZE];
-    while (tries)
-    {
-        printf("Senha: ");
-        fgets(password, MAX_PASSWORD_SIZE, stdin);
-        password[strcspn(password, "\n")] = '\0';
-        if (login(username, password, uid) != -1) {
-            break;
-        }
-        tries--;
+    if (!arg1) { sessionPrintf("Uso: sudo [-k | -v | -T segundos] <comando> <args>\n"); return; }
+    int handled = 0;
+
+    // -k descarta o ticket sem pedir senha
+    if (strcmp(arg1, "-k") == 0) {
+        sudo_ticket.valid = 0;
+        return;
     }
-    // restaura o uid anterior caso o usuário gaste todas as tentativas.
-    if (authenticated_uid == -1) {
-        authenticated_uid = old_uid; 
+
+    if (sudoAuthenticate(uid) != 0) return;
+
+    // -v só autentica (e renova o ticket); -T muda a janela dos tickets desta sessão
+    if (strcmp(arg1, "-v") == 0) return;
+    if (strcmp(arg1, "-T") == 0) {
+        if (!arg2 || atoi(arg2) < 0) { sessionPrintf("Uso: sudo -T <segundos>\n"); return; }
+        sudo_timeout = atoi(arg2);
+        sudoTicketIssue(uid);       // a autenticação acima passa a valer pela janela nova
+        sessionPrintf("sudo: senha válida por %d segundos\n", sudo_timeout);
         return;
-    } 
-    
+    }
 
     for (int i = 0; i < command_count; i++) {
         if (strcmp(arg1, commands[i].name) == 0) {
@@ -952,13 +1570,13 @@ void cmd_sudo(int *current_inode, const char *arg1, const char *arg2, const char
     }
 
     if (!handled) {
-        printf("sudo: Comando não reconhecido: %s\n", arg1);
+        sessionPrintf("sudo: Comando não reconhecido: %s\n", arg1);
     }
 }
 
 
 void cmd_unlink(int *current_inode, const char *f, const char *arg2, const char *arg3, int uid) {
-    if (!f) { printf("Uso: unlink <arquivo>\n"); return; }
+    if (!f) { sessionPrintf("Uso: unlink <arquivo>\n"); return; }
     UNREFERENCED(arg2); UNREFERENCED(arg3);
     _unlink(*current_inode, f, uid);
 }
@@ -970,19 +1588,52 @@ void cmd_df(int *current_inode, const char *arg1, const char *arg2, const char *
 }
 
 void cmd_chmod(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
-    if (!arg1 || !arg2 || !atoi(arg2)) { printf("Uso: chmod <caminho do arquivo> <código da permissão (2 digítos owner|others)>\n"); return; }
+    if (!arg1 || !arg2 || !atoi(arg2)) { sessionPrintf("Uso: chmod <caminho do arquivo> <código da permissão (2 digítos owner|others)>\n"); return; }
     UNREFERENCED(arg3);
     _chmod(*current_inode, arg1, arg2, uid);
 }
 
 
 void cmd_chown(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
-    if (!arg1 || !arg2) { printf("Uso: chown <caminho do arquivo> <nome do novo dono>\n"); return; }
+    if (!arg1 || !arg2) { sessionPrintf("Uso: chown <caminho do arquivo> <nome do novo dono>\n"); return; }
     UNREFERENCED(arg3);
     _chown(*current_inode, arg1, arg2, uid);
 }
 
 
+void cmd_dedup(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
+    UNREFERENCED(current_inode); UNREFERENCED(arg2); UNREFERENCED(arg3);
+    _dedup(arg1, uid);
+}
+
+void cmd_compress(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
+    if (!arg1) { sessionPrintf("Uso: compress <arquivo> [on|off|status]\n"); return; }
+    UNREFERENCED(arg3);
+    _compress(*current_inode, arg1, arg2, uid);
+}
+
+void cmd_bulk_create(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
+    if (!arg1) { sessionPrintf("Uso: bulk-create <lista | ->\n"); return; }
+    UNREFERENCED(arg2); UNREFERENCED(arg3);
+    _bulk_create(*current_inode, arg1, uid);
+}
+
+void cmd_scrub(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
+    UNREFERENCED(current_inode); UNREFERENCED(arg2); UNREFERENCED(arg3);
+    _scrub(arg1, uid);
+}
+
+void cmd_userdb(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
+    UNREFERENCED(current_inode); UNREFERENCED(arg3);
+    _userdb(arg1, arg2, uid);
+}
+
+void cmd_create_users(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
+    if (!arg1) { sessionPrintf("Uso: create-users <lista | ->\n"); return; }
+    UNREFERENCED(arg2); UNREFERENCED(arg3);
+    _create_users(*current_inode, arg1, uid);
+}
+
 void cmd_create_user(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid) {
     UNREFERENCED(current_inode); UNREFERENCED(arg1); UNREFERENCED(arg2); UNREFERENCED(arg3); UNREFERENCED(uid);
     create_user();
@@ -9,6 +9,8 @@
 #define MAX_UID_SIZE 3
 #define MAX_PASSWD_ENTRY MAX_NAMESIZE + MAX_UID_SIZE + 3 // NOME(32):x:UID(3)> = 32 + 6
 #define MAX_SHADOW_ENTRY 256
+#define CREATE_USERS_MAX_THREADS 16
+#define SUDO_TICKET_TIMEOUT 300     // segundos em que um sudo autenticado dispensa a senha
 
 
 void cmd_cd(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
@@ -29,6 +31,12 @@ void cmd_df(int *current_inode, const char *arg1, const char *arg2, const char *
 void cmd_chmod(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
 void cmd_chown(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
 void cmd_create_user(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
+void cmd_dedup(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
+void cmd_compress(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
+void cmd_scrub(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
+void cmd_bulk_create(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
+void cmd_create_users(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
+void cmd_userdb(int *current_inode, const char *arg1, const char *arg2, const char *arg3, int uid);
 
 
 
@@ -36,8 +44,10 @@ int create_root();
 int create_user();
 int login(const char* username, const char* password, int uid);
 int assert_user_exists(const char* username);
+void start_session(void);
 
 
-extern int authenticated_uid;
+extern __thread int authenticated_uid;
+extern __thread int sudo_timeout;
 
 #endif
\ No newline at end of file
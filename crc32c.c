@@ -0,0 +1,105 @@
+#include "crc32c.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u  // polinômio Castagnoli refletido
+
+static uint32_t crc_table[8][256];
+static uint32_t (*crc_impl)(uint32_t, const uint8_t *, size_t) = NULL;
+static const char *crc_impl_name = "";
+
+/* ---- versão em software: slicing-by-8 ---- */
+static void crc32cInitTables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int s = 1; s < 8; s++)
+            crc_table[s][i] = (crc_table[s - 1][i] >> 8) ^ crc_table[0][crc_table[s - 1][i] & 0xFF];
+}
+
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t *p, size_t len) {
+    crc = ~crc;
+
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));   // assume little-endian, como o resto do formato em disco
+        w ^= crc;
+        crc = crc_table[7][w & 0xFF] ^
+              crc_table[6][(w >> 8) & 0xFF] ^
+              crc_table[5][(w >> 16) & 0xFF] ^
+              crc_table[4][(w >> 24) & 0xFF] ^
+              crc_table[3][(w >> 32) & 0xFF] ^
+              crc_table[2][(w >> 40) & 0xFF] ^
+              crc_table[1][(w >> 48) & 0xFF] ^
+              crc_table[0][w >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+/* ---- versão em hardware: instrução crc32 (SSE4.2) ---- */
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *p, size_t len) {
+    crc = ~crc;
+
+#if defined(__x86_64__)
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        c = _mm_crc32_u64(c, w);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+#endif
+    while (len >= 4) {
+        uint32_t w;
+        memcpy(&w, p, sizeof(w));
+        crc = _mm_crc32_u32(crc, w);
+        p += 4;
+        len -= 4;
+    }
+    while (len--)
+        crc = _mm_crc32_u8(crc, *p++);
+
+    return ~crc;
+}
+#endif
+
+/* Escolhe a implementação na primeira chamada */
+static void crc32cInit(void) {
+    crc32cInitTables();
+    crc_impl = crc32cSoftware;
+    crc_impl_name = "slicing-by-8";
+#ifdef CRC32C_HAVE_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc_impl = crc32cHardware;
+        crc_impl_name = "sse4.2";
+    }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    if (!crc_impl) crc32cInit();
+    return crc_impl(crc, data, len);
+}
+
+const char *crc32cImplementation(void) {
+    if (!crc_impl) crc32cInit();
+    return crc_impl_name;
+}
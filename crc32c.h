@@ -0,0 +1,11 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+#include <stdint.h>
+#include <stddef.h>
+
+/* CRC32C (Castagnoli). Usa a instrução crc32 do SSE4.2 quando disponível,
+   senão uma tabela slicing-by-8 */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+const char *crc32cImplementation(void);
+
+#endif
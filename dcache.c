@@ -0,0 +1,191 @@
+#include "dcache.h"
+#include <pthread.h>
+
+typedef struct {
+    int parent;             // inode do diretório (-1 = slot livre)
+    int inode;              // inode da entrada (-1 = entrada negativa)
+    uint32_t hash;
+    int next_in_bucket;     // encadeamento do bucket (ou da lista de livres)
+    int lru_prev;
+    int lru_next;
+    char name[MAX_NAMESIZE];
+} dcache_entry_t;
+
+static dcache_entry_t entries[DCACHE_ENTRIES];
+static int buckets[DCACHE_BUCKETS];
+static int lru_head = -1, lru_tail = -1;    // mais recente / menos recente
+static int free_list = -1;
+static int initialized = 0;
+static int used_entries = 0;
+// folha na ordem de travas: nada é chamado de fora do cache com ela tomada
+static pthread_mutex_t dcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ---- estrutura ---- */
+static void dcacheInit(void) {
+    for (int b = 0; b < DCACHE_BUCKETS; b++) buckets[b] = -1;
+    for (int i = 0; i < DCACHE_ENTRIES; i++) {
+        entries[i].parent = -1;
+        entries[i].next_in_bucket = i + 1 < DCACHE_ENTRIES ? i + 1 : -1;
+    }
+    free_list = 0;
+    lru_head = lru_tail = -1;
+    used_entries = 0;
+    initialized = 1;
+}
+
+/* FNV-1a com mistura final, para que nomes parecidos ("f1", "f2") caiam em buckets diferentes */
+static uint32_t nameHash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+static uint32_t keyHash(int parent_inode, const char *name) {
+    return nameHash(name) ^ ((uint32_t)parent_inode * 0x9E3779B1u);
+}
+
+static int findEntry(int parent_inode, const char *name, uint32_t hash) {
+    for (int i = buckets[hash % DCACHE_BUCKETS]; i >= 0; i = entries[i].next_in_bucket) {
+        if (entries[i].hash == hash && entries[i].parent == parent_inode && strcmp(entries[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void lruUnlink(int i) {
+    if (entries[i].lru_prev >= 0) entries[entries[i].lru_prev].lru_next = entries[i].lru_next;
+    else lru_head = entries[i].lru_next;
+    if (entries[i].lru_next >= 0) entries[entries[i].lru_next].lru_prev = entries[i].lru_prev;
+    else lru_tail = entries[i].lru_prev;
+}
+
+static void lruPushFront(int i) {
+    entries[i].lru_prev = -1;
+    entries[i].lru_next = lru_head;
+    if (lru_head >= 0) entries[lru_head].lru_prev = i;
+    lru_head = i;
+    if (lru_tail < 0) lru_tail = i;
+}
+
+/* Tira a entrada do bucket e da LRU e devolve o slot à lista de livres */
+static void removeEntry(int i) {
+    int *link = &buckets[entries[i].hash % DCACHE_BUCKETS];
+    while (*link != i) link = &entries[*link].next_in_bucket;
+    *link = entries[i].next_in_bucket;
+
+    lruUnlink(i);
+    entries[i].parent = -1;
+    entries[i].next_in_bucket = free_list;
+    free_list = i;
+    used_entries--;
+}
+
+static void storeEntry(int parent_inode, const char *name, int inode_index) {
+    if (!initialized) dcacheInit();
+    if (strlen(name) >= MAX_NAMESIZE) return;
+
+    uint32_t hash = keyHash(parent_inode, name);
+    int i = findEntry(parent_inode, name, hash);
+    if (i >= 0) {
+        entries[i].inode = inode_index;
+        lruUnlink(i);
+        lruPushFront(i);
+        return;
+    }
+
+    // cache cheio: descarta a entrada usada há mais tempo
+    if (free_list < 0) removeEntry(lru_tail);
+
+    i = free_list;
+    free_list = entries[i].next_in_bucket;
+
+    entries[i].parent = parent_inode;
+    entries[i].inode = inode_index;
+    entries[i].hash = hash;
+    strcpy(entries[i].name, name);
+    entries[i].next_in_bucket = buckets[hash % DCACHE_BUCKETS];
+    buckets[hash % DCACHE_BUCKETS] = i;
+    lruPushFront(i);
+    used_entries++;
+}
+
+/* ---- interface ---- */
+dcache_result_t dcacheLookup(int parent_inode, const char *name, int *out_inode) {
+    pthread_mutex_lock(&dcache_lock);
+    if (!initialized) dcacheInit();
+
+    dcache_result_t res = DCACHE_MISS;
+    int i = findEntry(parent_inode, name, keyHash(parent_inode, name));
+    if (i >= 0) {
+        lruUnlink(i);
+        lruPushFront(i);
+        if (entries[i].inode < 0) {
+            res = DCACHE_NEGATIVE;
+        } else {
+            *out_inode = entries[i].inode;
+            res = DCACHE_HIT;
+        }
+    }
+    pthread_mutex_unlock(&dcache_lock);
+    return res;
+}
+
+void dcacheInsert(int parent_inode, const char *name, int inode_index) {
+    pthread_mutex_lock(&dcache_lock);
+    storeEntry(parent_inode, name, inode_index);
+    pthread_mutex_unlock(&dcache_lock);
+}
+
+/* Registra que o nome não existe no diretório (nenhum tipo) */
+void dcacheInsertNegative(int parent_inode, const char *name) {
+    pthread_mutex_lock(&dcache_lock);
+    storeEntry(parent_inode, name, -1);
+    pthread_mutex_unlock(&dcache_lock);
+}
+
+void dcacheInvalidate(int parent_inode, const char *name) {
+    pthread_mutex_lock(&dcache_lock);
+    if (initialized) {
+        int i = findEntry(parent_inode, name, keyHash(parent_inode, name));
+        if (i >= 0) removeEntry(i);
+    }
+    pthread_mutex_unlock(&dcache_lock);
+}
+
+/* Inode liberado: some das entradas em que aparece como diretório ou como alvo,
+   já que o número pode ser reaproveitado por outro arquivo */
+void dcachePurgeInode(int inode_index) {
+    pthread_mutex_lock(&dcache_lock);
+    for (int i = 0; initialized && used_entries > 0 && i < DCACHE_ENTRIES; i++) {
+        if (entries[i].parent < 0) continue;
+        if (entries[i].parent == inode_index || entries[i].inode == inode_index) removeEntry(i);
+    }
+    pthread_mutex_unlock(&dcache_lock);
+}
+
+/* Como dcachePurgeInode para todos os inodes marcados no bitmap, com uma só varredura */
+void dcachePurgeInodes(const uint8_t *inode_set) {
+    pthread_mutex_lock(&dcache_lock);
+    for (int i = 0; initialized && used_entries > 0 && i < DCACHE_ENTRIES; i++) {
+        if (entries[i].parent < 0) continue;
+        int parent = entries[i].parent, inode = entries[i].inode;
+        if ((inode_set[parent / 8] & (1 << (parent % 8))) ||
+            (inode >= 0 && (inode_set[inode / 8] & (1 << (inode % 8)))))
+            removeEntry(i);
+    }
+    pthread_mutex_unlock(&dcache_lock);
+}
+
+void dcacheClear(void) {
+    pthread_mutex_lock(&dcache_lock);
+    if (initialized) dcacheInit();
+    pthread_mutex_unlock(&dcache_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+#include "fs.h"
+
+/* Cache de entradas de diretório (pai, nome) -> inode, com LRU e entradas negativas */
+#define DCACHE_ENTRIES 1024
+#define DCACHE_BUCKETS 2048
+
+typedef enum {
+    DCACHE_MISS,        // nada se sabe sobre o nome
+    DCACHE_HIT,         // nome existe, inode em *out_inode
+    DCACHE_NEGATIVE     // nome não existe no diretório
+} dcache_result_t;
+
+dcache_result_t dcacheLookup(int parent_inode, const char *name, int *out_inode);
+void dcacheInsert(int parent_inode, const char *name, int inode_index);
+void dcacheInsertNegative(int parent_inode, const char *name);
+void dcacheInvalidate(int parent_inode, const char *name);
+void dcachePurgeInode(int inode_index);
+void dcachePurgeInodes(const uint8_t *inode_set);
+void dcacheClear(void);
+
+#endif
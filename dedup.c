@@ -0,0 +1,173 @@
+#include "dedup.h"
+#include "fs_operations.h"
+#include <pthread.h>
+
+/* Buckets do índice: escritores de arquivos diferentes procuram e inserem ao mesmo tempo.
+   O sync copia o índice sem esta trava; uma entrada copiada pela metade é inofensiva, porque
+   o conteúdo é sempre comparado byte a byte antes de um bloco ser compartilhado */
+static pthread_mutex_t dedup_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ---- hash de conteúdo ---- */
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/* Hash de 64 bits do bloco, processando uma palavra de 8 bytes por vez */
+uint64_t hashBlock(const void *data) {
+    const unsigned char *p = data;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ BLOCK_SIZE;
+
+    for (size_t i = 0; i < BLOCK_SIZE; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, p + i, sizeof(w));
+        w *= 0x87C37B91114253D5ULL;
+        w = rotl64(w, 31);
+        w *= 0x4CF5AD432745937FULL;
+        h ^= w;
+        h = rotl64(h, 27) * 5 + 0x52DCE729;
+    }
+
+    // mistura final para espalhar os bits entre os buckets
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* ---- índice ---- */
+static dedup_entry_t *bucketOf(uint64_t hash) {
+    return &dedup_index[(hash & (DEDUP_INDEX_BUCKETS - 1)) * DEDUP_BUCKET_WAYS];
+}
+
+/* Entrada válida: aponta para um bloco vivo que ainda carrega a marca do índice */
+static int entryIsLive(const dedup_entry_t *entry) {
+    return entry->block != 0 && blockRefCount(entry->block) > 0 && blockIsIndexed(entry->block);
+}
+
+/* Procura um bloco com o mesmo conteúdo e já pega uma referência a ele (*out_block).
+   A referência vem antes da comparação: com ela o bloco não pode ser liberado e realocado
+   por outra thread no meio, e um bloco marcado no índice nunca é regravado no lugar.
+   O conteúdo é comparado byte a byte, então colisões de hash e entradas antigas nunca
+   causam compartilhamento indevido */
+int dedupShareBlock(const void *data, uint64_t hash, uint32_t *out_block) {
+    if (!dedup_index || !data || !out_block) return -1;
+
+    dedup_entry_t ways[DEDUP_BUCKET_WAYS];
+    pthread_mutex_lock(&dedup_lock);
+    memcpy(ways, bucketOf(hash), sizeof(ways));
+    pthread_mutex_unlock(&dedup_lock);
+
+    char candidate[BLOCK_SIZE];
+    for (int w = 0; w < DEDUP_BUCKET_WAYS; w++) {
+        uint32_t block = ways[w].block;
+        if (ways[w].hash != hash || block == 0 || blockAddRef(block) != 0) continue;
+
+        if (blockIsIndexed(block) && readBlock(block, candidate) == 0 &&
+            memcmp(candidate, data, BLOCK_SIZE) == 0) {
+            *out_block = block;
+            return 0;
+        }
+        freeBlock(block);
+    }
+    return -1;
+}
+
+/* Registra o bloco no índice, reaproveitando entradas vazias ou mortas do bucket */
+void dedupInsert(uint64_t hash, uint32_t block) {
+    if (!dedup_index || block == 0) return;
+
+    pthread_mutex_lock(&dedup_lock);
+    dedup_entry_t *bucket = bucketOf(hash);
+    int way = -1;
+
+    for (int w = 0; w < DEDUP_BUCKET_WAYS; w++) {
+        if (bucket[w].block == block || !entryIsLive(&bucket[w])) { way = w; break; }
+    }
+    // bucket cheio: substitui uma via escolhida pelo próprio hash
+    if (way == -1) way = (hash >> 32) % DEDUP_BUCKET_WAYS;
+
+    bucket[way].hash = hash;
+    bucket[way].block = block;
+    bucket[way].reserved = 0;
+    blockSetIndexed(block);
+    __atomic_store_n(&dedup_index_dirty, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&dedup_lock);
+}
+
+/* ---- deduplicação offline ---- */
+/* Percorre os blocos cheios de um arquivo, trocando duplicados pelo bloco já indexado */
+static int dedupFile(int inode_index, dedup_report_t *report) {
+    inode_t *file = &inode_table[inode_index];
+    uint32_t full_blocks = file->size / BLOCK_SIZE;
+    uint32_t logical = 0;
+    char buffer[BLOCK_SIZE];
+
+    int current_idx = inode_index;
+    while (logical < full_blocks) {
+        inode_t *current = &inode_table[current_idx];
+
+        for (int i = 0; i < BLOCKS_PER_INODE && logical < full_blocks; i++) {
+            uint32_t block = current->blocks[i];
+            if (block == 0) continue;
+            logical++;
+
+            if (readBlock(block, buffer) != 0) return -1;
+            report->blocks_scanned++;
+
+            uint64_t hash = hashBlock(buffer);
+            uint32_t shared;
+            if (dedupShareBlock(buffer, hash, &shared) != 0) {
+                dedupInsert(hash, block);
+                continue;
+            }
+            if (shared == block) {
+                freeBlock(shared);      // o próprio bloco: devolve a referência extra
+                continue;
+            }
+
+            current->blocks[i] = shared;
+            freeBlock(block);
+            report->blocks_merged++;
+        }
+
+        if (current->next_inode == 0) break;
+        current_idx = current->next_inode;
+    }
+    return 0;
+}
+
+/* Varre todos os arquivos regulares do disco e compartilha blocos idênticos */
+int dedupScan(dedup_report_t *report) {
+    if (!report || !inode_table) return -1;
+    memset(report, 0, sizeof(*report));
+
+    int res = 0;
+    for (int i = 0; i < MAX_INODES && res == 0; i++) {
+        // cada arquivo é tratado com a própria trava de escrita; os outros seguem livres
+        inodeLockWrite(i);
+        inode_t *inode = &inode_table[i];
+        // inodes encadeados (continuação) não têm nome; são visitados pelo inode principal.
+        // Arquivos comprimidos guardam clusters, não blocos de conteúdo, e ficam de fora
+        if (inodeInUse(i) && inode->type == FILE_REGULAR && inode->name[0] != '\0' &&
+            !(inode->flags & (INODE_FLAG_COMPRESSED | INODE_FLAG_USERDB_VIEW))) {
+            res = dedupFile(i, report);
+            report->files++;
+        }
+        inodeUnlock(i);
+    }
+
+    sync_fs();
+    return res;
+}
+
+/* Blocos economizados: cada referência extra a um bloco é um bloco que não foi gravado */
+uint32_t sharedBlocksSaved(void) {
+    uint32_t saved = 0;
+    for (uint32_t b = 1; b < computed_data_blocks; b++) {
+        uint16_t refs = blockRefCount(b);
+        if (refs > 1) saved += refs - 1;
+    }
+    return saved;
+}
@@ -0,0 +1,22 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+#include "fs.h"
+
+typedef struct {
+    uint32_t files;           // arquivos percorridos
+    uint32_t blocks_scanned;  // blocos cheios verificados
+    uint32_t blocks_merged;   // blocos liberados por serem duplicados
+} dedup_report_t;
+
+/* Hash de conteúdo de um bloco */
+uint64_t hashBlock(const void *data);
+
+/* Índice persistente hash -> bloco */
+int dedupShareBlock(const void *data, uint64_t hash, uint32_t *out_block);
+void dedupInsert(uint64_t hash, uint32_t block);
+
+/* Deduplicação offline de todo o disco */
+int dedupScan(dedup_report_t *report);
+uint32_t sharedBlocksSaved(void);
+
+#endif
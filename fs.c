@@ -1,18 +1,34 @@
 #include "fs.h"
 #include "fs_operations.h"
+#include "compress.h"
+#include "crc32c.h"
+#include "dcache.h"
+#include "btree.h"
+#include "userdb.h"
+#include "writeback.h"
+#include "orphan.h"
 #include <string.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/file.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
 
 /* ---- Variáveis globais ---- */
 unsigned char *block_bitmap = NULL;
+uint16_t *block_refcount = NULL;
+dedup_entry_t *dedup_index = NULL;
+int dedup_index_dirty = 0;
+uint32_t fs_features = 0;
+uint32_t userdb_first_block = 0;
+uint32_t userdb_blocks = 0;
+uint32_t orphan_head = 0;
 unsigned char *inode_bitmap = NULL;
 inode_t *inode_table = NULL;
 FILE *disk = NULL;
@@ -21,14 +37,246 @@ FILE *disk = NULL;
 off_t off_block_bitmap = 0;
 off_t off_inode_bitmap = 0;
 off_t off_inode_table = 0;
+off_t off_block_refcount = 0;
+off_t off_dedup_index = 0;
+off_t off_csum_region = 0;
 off_t off_data_region = 0;
 
 size_t computed_block_bitmap_bytes = 0;
 size_t computed_inode_bitmap_bytes = 0;
 size_t computed_inode_table_bytes = 0;
+size_t computed_block_refcount_bytes = 0;
+size_t computed_dedup_index_bytes = 0;
+size_t computed_csum_region_bytes = 0;
 uint32_t computed_meta_blocks = 0;
 uint32_t computed_data_blocks = 0;
 
+/* ---- Travas (ordem completa em fs.h) ---- */
+/* meta_lock: gravação dos metadados (flush_fs, header), um sync por vez.
+   Bitmaps e refcount não têm trava: são alterados com operações atômicas (veja alocação) */
+static pthread_mutex_t meta_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t inode_locks[MAX_INODES];
+static pthread_once_t inode_locks_once = PTHREAD_ONCE_INIT;
+
+/* ---- Grupos de alocação (fs.h) ---- */
+/* Contadores de livres em memória, divididos em ALLOC_SHARDS fatias. Cada thread conta na sua
+   fatia, que tem uma entrada por grupo e linhas de cache só dela; o total de um grupo é a soma
+   das fatias */
+#define ALLOC_SHARDS 16
+
+typedef struct {
+    struct {
+        int64_t free_blocks;
+        int64_t free_inodes;
+    } groups[MAX_GROUPS];
+} __attribute__((aligned(64))) alloc_shard_t;
+
+_Static_assert(GROUP_BLOCKS % 64 == 0 && (uint64_t)MAX_GROUPS * GROUP_BLOCKS >= MAX_BLOCKS,
+               "grupos devem cobrir o disco em palavras inteiras do bitmap");
+_Static_assert(MAX_INODES / MAX_GROUPS >= 64, "cada grupo precisa de ao menos 64 inodes");
+
+static fs_group_desc_t groups[MAX_GROUPS];      // layout, como no header
+static alloc_shard_t alloc_shards[ALLOC_SHARDS];
+static uint32_t next_shard = 0;
+static uint32_t layout_generation = 1;      // muda a cada init/mount: os cursores das threads recomeçam
+static __thread int thread_shard = -1;
+static __thread uint32_t thread_generation = 0;
+static __thread uint32_t block_cursors[MAX_GROUPS];    // palavra da fatia de cada grupo onde a thread procura primeiro
+static uint32_t group_count = 0;
+
+static void reset_free_counters(void);
+
+/* Livres do grupo: soma das fatias (cada fatia sozinha pode ficar negativa) */
+static int64_t groupFreeBlocks(uint32_t g) {
+    int64_t total = 0;
+    for (int s = 0; s < ALLOC_SHARDS; s++)
+        total += __atomic_load_n(&alloc_shards[s].groups[g].free_blocks, __ATOMIC_RELAXED);
+    return total;
+}
+
+static int64_t groupFreeInodes(uint32_t g) {
+    int64_t total = 0;
+    for (int s = 0; s < ALLOC_SHARDS; s++)
+        total += __atomic_load_n(&alloc_shards[s].groups[g].free_inodes, __ATOMIC_RELAXED);
+    return total;
+}
+
+/* Último header gravado: o sync só regrava o header quando os contadores dos grupos mudam */
+static fs_header_t header_on_disk;
+
+/* Tabela de refcount só é regravada quando alterada (flag lida e zerada atomicamente pelo sync) */
+static int refcount_dirty = 0;
+
+/* Região de checksums: um CRC32C por bloco de dados (0 = sem checksum) seguido
+   de um CRC32C por bloco de BLOCK_SIZE bytes de cada região de metadados */
+static uint32_t *block_csums = NULL;
+static uint32_t *meta_csums = NULL;
+static uint32_t data_csum_count = 0;
+static uint32_t meta_csum_count = 0;
+
+/* Regiões de metadados cobertas por checksum, na ordem em que aparecem no disco */
+typedef struct {
+    const char *name;
+    const void *data;
+    size_t bytes;
+    off_t offset;
+    int atomic_words;       // alterada com operações atômicas (copiada palavra a palavra)
+} meta_region_t;
+
+#define META_REGION_COUNT 5
+#define META_INODE_TABLE 2
+
+static void list_meta_regions(meta_region_t regions[META_REGION_COUNT]) {
+    regions[0] = (meta_region_t){ "bitmap de blocos", block_bitmap, computed_block_bitmap_bytes, off_block_bitmap, 1 };
+    regions[1] = (meta_region_t){ "bitmap de inodes", inode_bitmap, computed_inode_bitmap_bytes, off_inode_bitmap, 1 };
+    regions[2] = (meta_region_t){ "tabela de inodes", inode_table, computed_inode_table_bytes, off_inode_table, 0 };
+    regions[3] = (meta_region_t){ "refcount de blocos", block_refcount, computed_block_refcount_bytes, off_block_refcount, 1 };
+    regions[4] = (meta_region_t){ "índice de deduplicação", dedup_index, computed_dedup_index_bytes, off_dedup_index, 0 };
+}
+
+/* Cópia de cada região de metadados como está no disco. O sync tira um retrato das regiões vivas,
+   regrava só os trechos de BLOCK_SIZE bytes que mudaram e calcula os checksums sobre a cópia:
+   threads alterando as tabelas durante o sync nunca deixam conteúdo e checksum divergentes */
+static unsigned char *meta_on_disk[META_REGION_COUNT];
+static unsigned char *meta_snapshot = NULL;     // retrato de todas as regiões (sob meta_lock)
+static size_t meta_snapshot_off[META_REGION_COUNT];
+static int meta_snapshot_taken[META_REGION_COUNT];
+static fs_header_t header_snapshot;
+
+/* Cria as cópias em disco a partir do estado atual (logo após criar ou montar o FS) */
+static int init_meta_images(void) {
+    meta_region_t regions[META_REGION_COUNT];
+    list_meta_regions(regions);
+
+    size_t total = 0;
+    for (int r = 0; r < META_REGION_COUNT; r++) {
+        meta_on_disk[r] = malloc(regions[r].bytes);
+        if (!meta_on_disk[r]) return -1;
+        memcpy(meta_on_disk[r], regions[r].data, regions[r].bytes);
+        meta_snapshot_off[r] = total;
+        total += regions[r].bytes;
+    }
+    meta_snapshot = malloc(total);
+    return meta_snapshot ? 0 : -1;
+}
+
+static void free_meta_images(void) {
+    for (int r = 0; r < META_REGION_COUNT; r++) {
+        free(meta_on_disk[r]);
+        meta_on_disk[r] = NULL;
+    }
+    free(meta_snapshot);
+    meta_snapshot = NULL;
+}
+
+/* Quantidade de checksums de metadados para os tamanhos de região atuais */
+static uint32_t count_meta_csums(void) {
+    size_t sizes[META_REGION_COUNT] = {
+        computed_block_bitmap_bytes, computed_inode_bitmap_bytes, computed_inode_table_bytes,
+        computed_block_refcount_bytes, computed_dedup_index_bytes
+    };
+    uint32_t count = 0;
+    for (int r = 0; r < META_REGION_COUNT; r++)
+        count += (sizes[r] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    return count;
+}
+
+/* Calcula (compute = 1) ou verifica (compute = 0) os checksums dos metadados, sempre sobre
+   as cópias em disco. Retorna o número de blocos de metadados com checksum divergente */
+static uint32_t check_meta_csums(int compute) {
+    meta_region_t regions[META_REGION_COUNT];
+    list_meta_regions(regions);
+
+    uint32_t idx = 0, errors = 0;
+    for (int r = 0; r < META_REGION_COUNT; r++) {
+        const unsigned char *data = meta_on_disk[r];
+        for (size_t off = 0; off < regions[r].bytes; off += BLOCK_SIZE, idx++) {
+            size_t len = regions[r].bytes - off < BLOCK_SIZE ? regions[r].bytes - off : BLOCK_SIZE;
+            uint32_t crc = crc32c(0, data + off, len);
+            if (compute) {
+                meta_csums[idx] = crc;
+            } else if (meta_csums[idx] != crc) {
+                fprintf(stderr, "[ERRO] Checksum inválido nos metadados: %s, bloco %zu\n",
+                        regions[r].name, off / BLOCK_SIZE);
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+/* Grava no disco, na posição indicada, sem passar pelo buffer do FILE */
+static int write_at(const void *data, size_t bytes, off_t offset) {
+    return pwrite(fileno(disk), data, bytes, offset) == (ssize_t)bytes ? 0 : -1;
+}
+
+/* Grava os checksums de metadados. Chamada sob meta_lock; os de dados são gravados pela passada
+   de writeback, junto com os próprios blocos */
+static void write_csums(void) {
+    check_meta_csums(1);
+    write_at(meta_csums, (size_t)meta_csum_count * sizeof(uint32_t),
+             off_csum_region + (off_t)data_csum_count * sizeof(uint32_t));
+}
+
+/* Copia a região para o retrato. Nenhuma região é copiada com trava: bitmaps e refcount são
+   lidos palavra a palavra com leituras atômicas, a tabela de inodes e o índice de dedup com
+   memcpy. Um bloco alocado ou um inode alterado durante a cópia pode ficar de fora ou sair pela
+   metade: quem o altera chama sync_fs depois e a próxima gravação o corrige */
+static void snapshot_meta_region(int r, const meta_region_t *region) {
+    unsigned char *copy = meta_snapshot + meta_snapshot_off[r];
+    if (region->atomic_words) {
+        const uint64_t *words = region->data;
+        uint64_t *copy_words = (uint64_t *)copy;
+        for (size_t w = 0; w < region->bytes / sizeof(uint64_t); w++)
+            copy_words[w] = __atomic_load_n(&words[w], __ATOMIC_RELAXED);
+    } else {
+        memcpy(copy, region->data, region->bytes);
+    }
+    meta_snapshot_taken[r] = 1;
+}
+
+/* Grava os trechos de BLOCK_SIZE bytes do retrato da região que mudaram desde a última gravação */
+static void write_meta_region(int r, const meta_region_t *region) {
+    if (!meta_snapshot_taken[r]) return;
+    meta_snapshot_taken[r] = 0;
+
+    const unsigned char *copy = meta_snapshot + meta_snapshot_off[r];
+    unsigned char *on_disk = meta_on_disk[r];
+    for (size_t off = 0; off < region->bytes; off += BLOCK_SIZE) {
+        size_t len = region->bytes - off < BLOCK_SIZE ? region->bytes - off : BLOCK_SIZE;
+        if (memcmp(copy + off, on_disk + off, len) == 0) continue;
+
+        write_at(copy + off, len, region->offset + (off_t)off);
+        memcpy(on_disk + off, copy + off, len);
+    }
+}
+
+/* Verifica um bloco lido contra o checksum registrado */
+static int verify_block(uint32_t block_index, const void *buffer) {
+    uint32_t expected = block_csums ? __atomic_load_n(&block_csums[block_index], __ATOMIC_RELAXED) : 0;
+    if (expected == 0) return 0;
+    uint32_t crc = crc32c(0, buffer, BLOCK_SIZE);
+    if (crc == expected) return 0;
+    fprintf(stderr, "[ERRO] Checksum inválido no bloco %u (esperado %08x, lido %08x)\n",
+            block_index, expected, crc);
+    return -1;
+}
+
+/* Checksums de dados: block_csums descreve o que está no disco, não o que está no cache de
+   escrita (leituras do cache não são verificadas). A passada de writeback grava cada bloco e, logo
+   depois, o checksum dele, então uma queda deixa no máximo a última sequência gravada sem o
+   checksum novo, e não todos os blocos gravados desde a última gravação dos metadados */
+int writeBlockCsums(uint32_t first_block, uint32_t count, const uint32_t *csums) {
+    if (!disk || !block_csums || first_block + count > data_csum_count) return -1;
+    return write_at(csums, (size_t)count * sizeof(uint32_t),
+                    off_csum_region + (off_t)first_block * sizeof(uint32_t));
+}
+
+void setBlockCsum(uint32_t block_index, uint32_t csum) {
+    if (!block_csums || block_index >= data_csum_count) return;
+    __atomic_store_n(&block_csums[block_index], csum, __ATOMIC_RELAXED);
+}
+
 /* ---- Calcula layout do FS ---- */
 static void compute_layout(void) {
     size_t inode_bmap_bytes = (MAX_INODES + 7) / 8;
@@ -40,15 +288,31 @@ static void compute_layout(void) {
     /* Calcula bytes do bitmap de blocos */
     size_t bmap_bytes = (data_blocks + 7) / 8;
 
+    /* Um contador de referências por bloco (compartilhamento por reflink) */
+    size_t refcount_bytes = data_blocks * sizeof(uint16_t);
+
+    /* Índice persistente hash -> bloco usado pela deduplicação */
+    size_t dedup_bytes = (size_t)DEDUP_INDEX_BUCKETS * DEDUP_BUCKET_WAYS * sizeof(dedup_entry_t);
+
     /* Computa tamanhos */
     computed_block_bitmap_bytes = bmap_bytes;
     computed_inode_bitmap_bytes = inode_bmap_bytes;
     computed_inode_table_bytes = inode_tbl_bytes;
+    computed_block_refcount_bytes = refcount_bytes;
+    computed_dedup_index_bytes = dedup_bytes;
+
+    /* Checksums: um por bloco de dados e um por bloco de cada região de metadados */
+    data_csum_count = bmap_bytes * 8;
+    meta_csum_count = count_meta_csums();
+    computed_csum_region_bytes = (size_t)(data_csum_count + meta_csum_count) * sizeof(uint32_t);
 
     /* Número de blocos ocupados pela meta-região */
     computed_meta_blocks = (computed_block_bitmap_bytes +
                             computed_inode_bitmap_bytes +
-                            computed_inode_table_bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+                            computed_inode_table_bytes +
+                            computed_block_refcount_bytes +
+                            computed_dedup_index_bytes +
+                            computed_csum_region_bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
     /* Blocos de dados efetivos */
     computed_data_blocks = MAX_BLOCKS - computed_meta_blocks;
@@ -57,8 +321,88 @@ static void compute_layout(void) {
     off_block_bitmap = sizeof(fs_header_t);
     off_inode_bitmap = off_block_bitmap + computed_block_bitmap_bytes;
     off_inode_table = off_inode_bitmap + computed_inode_bitmap_bytes;
-    off_data_region = off_inode_table + computed_inode_table_bytes;
+    off_block_refcount = off_inode_table + computed_inode_table_bytes;
+    off_dedup_index = off_block_refcount + computed_block_refcount_bytes;
+    off_csum_region = off_dedup_index + computed_dedup_index_bytes;
+    off_data_region = off_csum_region + computed_csum_region_bytes;
     off_data_region = ((off_data_region + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE;
+
+    /* Grupos: GROUP_BLOCKS blocos por grupo (o último fica com o resto) e o mesmo número de
+       inodes em cada um, em múltiplos de 64; as fatias de cada grupo nas regiões de metadados
+       começam em palavras inteiras dos bitmaps */
+    group_count = (computed_data_blocks + GROUP_BLOCKS - 1) / GROUP_BLOCKS;
+    uint32_t inodes_per_group = (MAX_INODES / group_count) & ~63u;
+    for (uint32_t g = 0; g < group_count; g++) {
+        fs_group_desc_t *desc = &groups[g];
+        desc->first_block = g * GROUP_BLOCKS;
+        desc->block_count = g + 1 < group_count ? GROUP_BLOCKS : computed_data_blocks - desc->first_block;
+        desc->first_inode = g * inodes_per_group;
+        desc->inode_count = g + 1 < group_count ? inodes_per_group : MAX_INODES - desc->first_inode;
+        desc->off_block_bitmap = off_block_bitmap + desc->first_block / 8;
+        desc->off_inode_bitmap = off_inode_bitmap + desc->first_inode / 8;
+        desc->off_inode_table = off_inode_table + desc->first_inode * sizeof(inode_t);
+    }
+}
+
+/* ---- Grava o header com o layout atual ---- */
+static void build_header(fs_header_t *out) {
+    fs_header_t header = {0};
+    header.magic = FS_MAGIC;
+    header.version = FS_VERSION;
+    header.features = fs_features;
+    header.block_bitmap_bytes = computed_block_bitmap_bytes;
+    header.inode_bitmap_bytes = computed_inode_bitmap_bytes;
+    header.inode_table_bytes = computed_inode_table_bytes;
+    header.block_refcount_bytes = computed_block_refcount_bytes;
+    header.dedup_index_bytes = computed_dedup_index_bytes;
+    header.csum_region_bytes = computed_csum_region_bytes;
+    header.meta_blocks = computed_meta_blocks;
+    header.data_blocks = computed_data_blocks;
+    header.off_block_bitmap = off_block_bitmap;
+    header.off_inode_bitmap = off_inode_bitmap;
+    header.off_inode_table = off_inode_table;
+    header.off_block_refcount = off_block_refcount;
+    header.off_dedup_index = off_dedup_index;
+    header.off_csum_region = off_csum_region;
+    header.off_data_region = off_data_region;
+    header.userdb_first_block = userdb_first_block;
+    header.userdb_blocks = userdb_blocks;
+    header.orphan_head = __atomic_load_n(&orphan_head, __ATOMIC_RELAXED);
+    header.group_count = group_count;
+    for (uint32_t g = 0; g < group_count; g++) {
+        int64_t free_blocks = groupFreeBlocks(g);
+        int64_t free_inodes = groupFreeInodes(g);
+        header.groups[g] = groups[g];
+        header.groups[g].free_blocks = free_blocks > 0 ? free_blocks : 0;
+        header.groups[g].free_inodes = free_inodes > 0 ? free_inodes : 0;
+    }
+    header.header_csum = crc32c(0, &header, sizeof(header));
+    *out = header;
+}
+
+/* Grava o header se mudou desde a última gravação */
+static int write_header_image(const fs_header_t *header) {
+    if (memcmp(header, &header_on_disk, sizeof(*header)) == 0) return 0;
+
+    header_on_disk = *header;
+    return write_at(header, sizeof(*header), 0);
+}
+
+static int write_header(void) {
+    fs_header_t header;
+    build_header(&header);
+    return write_header_image(&header);
+}
+
+/* Um processo por disco: bitmaps, tabela de inodes e caches vivem na memória de quem montou.
+   Várias sessões ao mesmo tempo passam pelo daemon (main --daemon), que monta uma vez só.
+   A trava some sozinha quando o processo termina */
+static int lock_disk(void) {
+    if (flock(fileno(disk), LOCK_EX | LOCK_NB) == 0) return 0;
+    fprintf(stderr, "Disco %s em uso por outro processo. Para várias sessões use 'main --daemon'.\n", DISK_NAME);
+    fclose(disk);
+    disk = NULL;
+    return -1;
 }
 
 /* ---- Inicializa um novo filesystem ---- */
@@ -71,6 +415,7 @@ int init_fs(void) {
     printf("[INFO] Inicializando novo filesystem...\n");
     disk = fopen(DISK_NAME, "wb+");
     if (!disk) { perror("Erro ao criar disco"); return -1; }
+    if (lock_disk() != 0) return -1;
 
     ftruncate(fileno(disk), DISK_SIZE_MB * 1024 * 1024);
     compute_layout();
@@ -78,14 +423,23 @@ int init_fs(void) {
     block_bitmap = calloc(1, computed_block_bitmap_bytes);
     inode_bitmap = calloc(1, computed_inode_bitmap_bytes);
     inode_table = calloc(MAX_INODES, sizeof(inode_t));
-    if (!block_bitmap || !inode_bitmap || !inode_table) {
+    block_refcount = calloc(1, computed_block_refcount_bytes);
+    dedup_index = calloc(1, computed_dedup_index_bytes);
+    block_csums = calloc(1, computed_csum_region_bytes);
+    if (!block_bitmap || !inode_bitmap || !inode_table || !block_refcount || !dedup_index || !block_csums) {
         perror("Erro ao alocar memória para FS");
         fclose(disk);
         return -1;
     }
+    meta_csums = block_csums + data_csum_count;
+
+    /* Bloco 0 fica reservado: nos inodes, blocks[i] == 0 significa slot vazio */
+    block_bitmap[0] |= 1;
+    block_refcount[0] = 1;
+    reset_free_counters();
 
     /* Cria diretório raiz */
-    int root_inode = allocateInode();
+    int root_inode = allocateInode(0);
     inode_table[root_inode].type = FILE_DIRECTORY;
     inode_table[root_inode].size = 0;
     inode_table[root_inode].creation_date = time(NULL);
@@ -97,23 +451,10 @@ int init_fs(void) {
     dirAddEntry(ROOT_INODE, ".", FILE_DIRECTORY, ROOT_INODE);
     dirAddEntry(ROOT_INODE, "..", FILE_DIRECTORY, ROOT_INODE);
     sync_inode(root_inode);
+    writebackFlush(1);      // entradas da raiz, antes dos metadados que apontam para elas
 
     /* Escreve header no disco */
-    fs_header_t header = {0};
-    header.magic = FS_MAGIC;
-    header.block_bitmap_bytes = computed_block_bitmap_bytes;
-    header.inode_bitmap_bytes = computed_inode_bitmap_bytes;
-    header.inode_table_bytes = computed_inode_table_bytes;
-    header.meta_blocks = computed_meta_blocks;
-    header.data_blocks = computed_data_blocks;
-    header.off_block_bitmap = off_block_bitmap;
-    header.off_inode_bitmap = off_inode_bitmap;
-    header.off_inode_table = off_inode_table;
-    header.off_data_region = off_data_region;
-
-    fseek(disk, 0, SEEK_SET);
-    fwrite(&header, sizeof(header), 1, disk);
-    fflush(disk);
+    write_header();
 
     /* Escreve bitmaps e tabela de inodes */
     // bitmap de blocos
@@ -128,6 +469,25 @@ int init_fs(void) {
     fseek(disk, off_inode_table, SEEK_SET);
     fwrite(inode_table, 1, computed_inode_table_bytes, disk);
 
+    // contadores de referência dos blocos
+    fseek(disk, off_block_refcount, SEEK_SET);
+    fwrite(block_refcount, 1, computed_block_refcount_bytes, disk);
+    refcount_dirty = 0;
+
+    // índice de deduplicação
+    fseek(disk, off_dedup_index, SEEK_SET);
+    fwrite(dedup_index, 1, computed_dedup_index_bytes, disk);
+    dedup_index_dirty = 0;
+    fflush(disk);
+
+    // checksums de dados e metadados
+    if (init_meta_images() != 0) {
+        perror("Erro ao alocar memória para FS");
+        return -1;
+    }
+    check_meta_csums(1);
+    write_at(block_csums, computed_csum_region_bytes, off_csum_region);
+
     printf("\n[INFO] Filesystem criado com sucesso.\n\n");
 
     printf("[INFO] Disposição do disco:\n");
@@ -135,9 +495,18 @@ int init_fs(void) {
     printf("[INFO]   |--Espaço para bitmap de blocos: %ldB\n", computed_block_bitmap_bytes);
     printf("[INFO]   |--Espaço para bitmap de inodes: %ldB\n", computed_inode_bitmap_bytes);
     printf("[INFO]   |--Espaço para tabela de inodes: %ldB\n", computed_inode_table_bytes);
+    printf("[INFO]   |--Espaço para refcount de blocos: %ldB\n", computed_block_refcount_bytes);
+    printf("[INFO]   |--Espaço para índice de deduplicação: %ldB\n", computed_dedup_index_bytes);
+    printf("[INFO]   |--Espaço para checksums: %ldB\n", computed_csum_region_bytes);
     printf("         |\n");
     printf("[INFO]   |--Espaço disponivel: %dB\n", computed_data_blocks * BLOCK_SIZE);
-    printf("[INFO]   |--Equivalente a: %d blocos\n\n", computed_data_blocks);
+    printf("[INFO]   |--Equivalente a: %d blocos\n", computed_data_blocks);
+    printf("[INFO]   |--Grupos de alocação: %u (%u blocos e %u inodes cada)\n\n",
+           group_count, groups[0].block_count, groups[0].inode_count);
+    if (writebackStart() != 0)
+        fprintf(stderr, "[AVISO] Thread de writeback não iniciou; o disco só é gravado com o cache cheio ou ao desmontar.\n");
+    if (orphanStart() != 0)
+        fprintf(stderr, "[AVISO] Thread de liberação não iniciou; arquivos apagados são liberados ao desmontar.\n");
     return 0;
 }
 
@@ -146,6 +515,7 @@ int mount_fs(void) {
     printf("[INFO] Montando filesystem existente...\n");
     disk = fopen(DISK_NAME, "rb+");
     if (!disk) { perror("Erro ao abrir disco"); return -1; }
+    if (lock_disk() != 0) return -1;
 
     fs_header_t header;
     fseek(disk, 0, SEEK_SET);
@@ -161,22 +531,59 @@ int mount_fs(void) {
         return -1;
     }
 
+    if (header.version != FS_VERSION) {
+        fprintf(stderr, "Versão do disco incompatível (esperada %d). Remova %s para recriar.\n",
+                FS_VERSION, DISK_NAME);
+        fclose(disk);
+        return -1;
+    }
+
+    uint32_t stored_header_csum = header.header_csum;
+    header.header_csum = 0;
+    if (crc32c(0, &header, sizeof(header)) != stored_header_csum) {
+        fprintf(stderr, "Checksum do header inválido: disco corrompido.\n");
+        fclose(disk);
+        return -1;
+    }
+
     /* Restaura variáveis globais */
+    fs_features = header.features;
     computed_block_bitmap_bytes = header.block_bitmap_bytes;
     computed_inode_bitmap_bytes = header.inode_bitmap_bytes;
     computed_inode_table_bytes = header.inode_table_bytes;
+    computed_block_refcount_bytes = header.block_refcount_bytes;
+    computed_dedup_index_bytes = header.dedup_index_bytes;
+    computed_csum_region_bytes = header.csum_region_bytes;
     computed_meta_blocks = header.meta_blocks;
     computed_data_blocks = header.data_blocks;
     off_block_bitmap = header.off_block_bitmap;
     off_inode_bitmap = header.off_inode_bitmap;
     off_inode_table = header.off_inode_table;
+    off_block_refcount = header.off_block_refcount;
+    off_dedup_index = header.off_dedup_index;
+    off_csum_region = header.off_csum_region;
     off_data_region = header.off_data_region;
+    userdb_first_block = header.userdb_first_block;
+    userdb_blocks = header.userdb_blocks;
+    orphan_head = header.orphan_head;
+    if (header.group_count == 0 || header.group_count > MAX_GROUPS) {
+        fprintf(stderr, "Disco inválido ou corrompido.\n");
+        fclose(disk);
+        return -1;
+    }
+    group_count = header.group_count;
+    memcpy(groups, header.groups, sizeof(groups));
+    header.header_csum = stored_header_csum;
+    header_on_disk = header;
 
     /* Aloca memória */
     block_bitmap = malloc(computed_block_bitmap_bytes);
     inode_bitmap = malloc(computed_inode_bitmap_bytes);
     inode_table = malloc(computed_inode_table_bytes);
-    if (!block_bitmap || !inode_bitmap || !inode_table) {
+    block_refcount = malloc(computed_block_refcount_bytes);
+    dedup_index = malloc(computed_dedup_index_bytes);
+    block_csums = malloc(computed_csum_region_bytes);
+    if (!block_bitmap || !inode_bitmap || !inode_table || !block_refcount || !dedup_index || !block_csums) {
         perror("Erro ao alocar memória para FS");
         fclose(disk);
         return -1;
@@ -190,11 +597,42 @@ int mount_fs(void) {
     // bitmap de inodes
     fseek(disk, off_inode_bitmap, SEEK_SET);
     fread(inode_bitmap, 1, computed_inode_bitmap_bytes, disk);
+    reset_free_counters();
 
     // tabela de inodes
     fseek(disk, off_inode_table, SEEK_SET);
     fread(inode_table, 1, computed_inode_table_bytes, disk);
 
+    // contadores de referência dos blocos
+    fseek(disk, off_block_refcount, SEEK_SET);
+    fread(block_refcount, 1, computed_block_refcount_bytes, disk);
+
+    // índice de deduplicação
+    fseek(disk, off_dedup_index, SEEK_SET);
+    fread(dedup_index, 1, computed_dedup_index_bytes, disk);
+    if (init_meta_images() != 0) {
+        perror("Erro ao alocar memória para FS");
+        fclose(disk);
+        return -1;
+    }
+
+    // checksums: verifica os metadados recém-lidos
+    data_csum_count = computed_block_bitmap_bytes * 8;
+    meta_csum_count = count_meta_csums();
+    meta_csums = block_csums + data_csum_count;
+    fseek(disk, off_csum_region, SEEK_SET);
+    fread(block_csums, 1, computed_csum_region_bytes, disk);
+    uint32_t meta_errors = check_meta_csums(0);
+    if (meta_errors > 0)
+        fprintf(stderr, "[AVISO] %u bloco(s) de metadados com checksum inválido. Rode 'scrub'.\n", meta_errors);
+    // o checksum de um bloco livre não é zerado no disco; o que ficou lá é de um conteúdo antigo
+    for (uint32_t b = 0; b < computed_data_blocks; b++)
+        if (!blockInUse(b)) block_csums[b] = 0;
+
+    // arquivos apagados cujos blocos não chegaram a ser liberados antes de uma queda
+    int orphans = orphanRecover();
+    if (orphans > 0)
+        printf("[INFO] %d inode(s) órfão(s) liberado(s).\n", orphans);
 
     printf("[INFO] Filesystem montado com sucesso!\n\n");
 
@@ -203,49 +641,123 @@ int mount_fs(void) {
     printf("[INFO]   |--Espaço para bitmap de blocos: %ldB\n", computed_block_bitmap_bytes);
     printf("[INFO]   |--Espaço para bitmap de inodes: %ldB\n", computed_inode_bitmap_bytes);
     printf("[INFO]   |--Espaço para tabela de inodes: %ldB\n", computed_inode_table_bytes);
+    printf("[INFO]   |--Espaço para refcount de blocos: %ldB\n", computed_block_refcount_bytes);
+    printf("[INFO]   |--Espaço para índice de deduplicação: %ldB\n", computed_dedup_index_bytes);
+    printf("[INFO]   |--Espaço para checksums: %ldB\n", computed_csum_region_bytes);
     printf("         |\n");
     printf("[INFO]   |--Espaço disponivel: %dB\n", computed_data_blocks * BLOCK_SIZE);
-    printf("[INFO]   |--Equivalente a: %d blocos\n\n", computed_data_blocks);
+    printf("[INFO]   |--Equivalente a: %d blocos\n", computed_data_blocks);
+    printf("[INFO]   |--Grupos de alocação: %u (%u blocos e %u inodes cada)\n\n",
+           group_count, groups[0].block_count, groups[0].inode_count);
+    if (writebackStart() != 0)
+        fprintf(stderr, "[AVISO] Thread de writeback não iniciou; o disco só é gravado com o cache cheio ou ao desmontar.\n");
+    if (orphanStart() != 0)
+        fprintf(stderr, "[AVISO] Thread de liberação não iniciou; arquivos apagados são liberados ao desmontar.\n");
     return 0;
 }
 
-/* ---- Sincroniza FS inteiro ---- */
-int sync_fs(void) {
-    if (!disk || !block_bitmap || !inode_bitmap || !inode_table) return -1;
-    fseek(disk, off_block_bitmap, SEEK_SET);
-    fwrite(block_bitmap, 1, computed_block_bitmap_bytes, disk);
+/* ---- Grava os metadados ---- */
+/* Retrato de todas as regiões e do header, tirado por writebackSnapshot no instante da barreira:
+   todo dado para o qual ele aponta foi escrito antes dela. Chamada sob meta_lock e wb_lock */
+static void take_meta_snapshot(void) {
+    meta_region_t regions[META_REGION_COUNT];
+    list_meta_regions(regions);
 
-    fseek(disk, off_inode_bitmap, SEEK_SET);
-    fwrite(inode_bitmap, 1, computed_inode_bitmap_bytes, disk);
+    snapshot_meta_region(0, &regions[0]);
+    snapshot_meta_region(1, &regions[1]);
+    snapshot_meta_region(META_INODE_TABLE, &regions[META_INODE_TABLE]);
+    // flags zeradas antes da cópia: uma alteração no meio marca a região de novo
+    if (__atomic_exchange_n(&refcount_dirty, 0, __ATOMIC_ACQ_REL))
+        snapshot_meta_region(3, &regions[3]);
+    if (__atomic_exchange_n(&dedup_index_dirty, 0, __ATOMIC_ACQ_REL))
+        snapshot_meta_region(4, &regions[4]);
+    build_header(&header_snapshot);     // contadores dos grupos e lista de órfãos
+}
 
-    fseek(disk, off_inode_table, SEEK_SET);
-    fwrite(inode_table, 1, computed_inode_table_bytes, disk);
+/* Grava o retrato tirado por take_meta_snapshot. Chamada sob meta_lock */
+static void write_metadata(void) {
+    meta_region_t regions[META_REGION_COUNT];
+    list_meta_regions(regions);
 
-    fflush(disk);
+    for (int r = 0; r < META_REGION_COUNT; r++)
+        write_meta_region(r, &regions[r]);
+    write_header_image(&header_snapshot);
+    write_csums();
     fsync(fileno(disk));
+}
 
+/* ---- Sincroniza FS inteiro ---- */
+/* Cada escritor sincroniza ao terminar: os metadados só são marcados e a thread de writeback os
+   grava quando envelhecem, junto com os anteriores (ver writeback.h) */
+int sync_fs(void) {
+    if (!disk || !inode_table || !meta_snapshot) return -1;
+    writebackMarkMetadata();
     return 0;
 }
 
-/* ---- Persiste um inode específico no disco ---- */
+/* ---- Persiste um inode específico ---- */
 void sync_inode(int inode_num) {
-    if (!disk || !inode_table) return;
-    fseek(disk, off_inode_table + inode_num * sizeof(inode_t), SEEK_SET);
-    fwrite(&inode_table[inode_num], sizeof(inode_t), 1, disk);
-    fflush(disk);
+    (void)inode_num;        // a tabela inteira vai na próxima gravação, só as páginas alteradas
+    if (!disk || !inode_table || !meta_snapshot) return;
+    writebackMarkMetadata();
+}
+
+/* ---- Grava agora blocos sujos e metadados, nessa ordem ---- */
+/* Pode ser chamada por várias threads: uma grava por vez e os metadados são copiados antes de ir
+   para o disco, então ninguém precisa parar. O retrato é tirado na barreira, antes dos dados: um
+   bloco alocado e escrito depois dela não aparece nele, e o que aparece já está no disco quando
+   ele é gravado */
+int flush_fs(void) {
+    if (!disk || !block_bitmap || !inode_bitmap || !inode_table || !meta_snapshot) return -1;
+    pthread_mutex_lock(&meta_lock);
+    writebackClearMetadata();
+    uint64_t barrier = writebackSnapshot(take_meta_snapshot);
+    int res = writebackFlushBefore(barrier);
+    if (res == 0) {
+        write_metadata();
+    } else {
+        // o retrato fica para a próxima tentativa, tirada de novo
+        if (meta_snapshot_taken[3]) __atomic_store_n(&refcount_dirty, 1, __ATOMIC_RELEASE);
+        if (meta_snapshot_taken[4]) __atomic_store_n(&dedup_index_dirty, 1, __ATOMIC_RELEASE);
+        memset(meta_snapshot_taken, 0, sizeof(meta_snapshot_taken));
+        writebackMarkMetadata();
+    }
+    pthread_mutex_unlock(&meta_lock);
+    return res;
 }
 
 
 /* ---- Desmonta FS ---- */
 int unmount_fs(void) {
-    sync_fs();
+    orphanStop();
+    writebackStop();
+    flush_fs();
+    dcacheClear();
     free(block_bitmap); block_bitmap = NULL;
+    free(block_refcount); block_refcount = NULL;
+    free(dedup_index); dedup_index = NULL;
+    free(block_csums); block_csums = NULL; meta_csums = NULL;
     free(inode_bitmap); inode_bitmap = NULL;
     free(inode_table); inode_table = NULL;
+    free_meta_images();
+    memset(&header_on_disk, 0, sizeof(header_on_disk));
+    orphan_head = 0;
     if (disk) { fclose(disk); disk = NULL; }
     return 0;
 }
 
+/* ---- Liga/desliga funcionalidades opcionais e persiste no header ---- */
+int set_fs_features(uint32_t features) {
+    if (!disk) return -1;
+    writebackFlush(1);      // o header vai direto para o disco: os blocos sujos vão antes
+    pthread_mutex_lock(&meta_lock);
+    fs_features = features;
+    int res = write_header();
+    if (res == 0 && fsync(fileno(disk)) != 0) res = -1;
+    pthread_mutex_unlock(&meta_lock);
+    return res;
+}
+
 /* ----- Utilitarios --------*/
 /* Formata timestamp para prints */
 const char *format_time(time_t t, char *buf, size_t buflen) {
@@ -309,87 +821,604 @@ int show_inode_info(int inode_index) {
 
 
 
-/* ---- alocação ---- */
-/* Aloca novo bloco */
-int allocateBlock(void) {
-    for (uint32_t i = 0; i < computed_data_blocks; i++){
-        uint32_t byte = i / 8;
-        uint8_t bit = i % 8;
+/* ---- travas de inode ---- */
+static void init_inode_locks(void) {
+    for (int i = 0; i < MAX_INODES; i++) pthread_rwlock_init(&inode_locks[i], NULL);
+}
+
+void inodeLockRead(int inode_index) {
+    pthread_once(&inode_locks_once, init_inode_locks);
+    pthread_rwlock_rdlock(&inode_locks[inode_index]);
+}
+
+void inodeLockWrite(int inode_index) {
+    pthread_once(&inode_locks_once, init_inode_locks);
+    pthread_rwlock_wrlock(&inode_locks[inode_index]);
+}
 
-        if ((block_bitmap[byte] & (1 << bit)) == 0) {
-            block_bitmap[byte] |= (1 << bit);
-            return i;
+void inodeUnlock(int inode_index) {
+    pthread_rwlock_unlock(&inode_locks[inode_index]);
+}
+
+/* Trava de escrita em dois inodes sem relação de parentesco, na ordem dos índices */
+void inodeLockPair(int a, int b) {
+    if (a == b) { inodeLockWrite(a); return; }
+    inodeLockWrite(a < b ? a : b);
+    inodeLockWrite(a < b ? b : a);
+}
+
+void inodeUnlockPair(int a, int b) {
+    inodeUnlock(a);
+    if (a != b) inodeUnlock(b);
+}
+
+/* ---- alocação ----
+   Sem trava: os bitmaps são alterados em palavras de 64 bits, com fetch-or para reservar e
+   fetch-and para liberar, e o bloco (ou inode) é de quem viu o seu bit passar de 0 para 1. O bit
+   i fica no bit i % 64 da palavra i / 64, que em little-endian é o bit i % 8 do byte i / 8 do
+   formato em disco. O refcount de cada bloco muda por compare-and-swap.
+   Cada grupo de alocação começa numa palavra inteira dos dois bitmaps. Dentro do grupo, cada
+   thread procura blocos a partir do próprio cursor, que começa numa faixa diferente para cada
+   fatia, e conta os livres na sua fatia: escritores no mesmo grupo quase nunca disputam a mesma
+   palavra do bitmap nem a mesma linha de cache. O df soma as fatias de todos os grupos */
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "os bitmaps em palavras de 64 bits supõem little-endian"
+#endif
+_Static_assert(MAX_BLOCKS % 64 == 0 && MAX_INODES % 64 == 0, "bitmaps devem ocupar palavras inteiras");
+
+int blockGroup(uint32_t block_index) {
+    uint32_t g = block_index / GROUP_BLOCKS;
+    return g < group_count ? (int)g : (int)group_count - 1;
+}
+
+int inodeGroup(int inode_index) {
+    if (inode_index < 0 || group_count == 0) return 0;
+    uint32_t g = (uint32_t)inode_index / groups[0].inode_count;
+    return g < group_count ? (int)g : (int)group_count - 1;
+}
+
+/* Grupo para um diretório novo: entre os grupos com inodes livres acima da média, o de mais
+   blocos livres (o do pai, em caso de empate). Diretórios irmãos vão para grupos diferentes e
+   os arquivos de cada um ficam juntos no grupo dele */
+int groupForDirectory(int parent_inode) {
+    int64_t total_inodes = 0;
+    for (uint32_t g = 0; g < group_count; g++)
+        total_inodes += groupFreeInodes(g);
+    int64_t average = group_count ? total_inodes / group_count : 0;
+
+    int best = inodeGroup(parent_inode);
+    int64_t best_free = -1;
+    for (uint32_t n = 0; n < group_count; n++) {
+        uint32_t g = (best + n) % group_count;      // o do pai é visto primeiro
+        int64_t inodes = groupFreeInodes(g);
+        int64_t blocks = groupFreeBlocks(g);
+        if (inodes <= 0 || inodes < average || blocks <= best_free) continue;
+        best = g;
+        best_free = blocks;
+    }
+    return best;
+}
+
+static int bitTest(const unsigned char *bitmap, uint32_t i) {
+    uint64_t word = __atomic_load_n(&((const uint64_t *)bitmap)[i / 64], __ATOMIC_ACQUIRE);
+    return (word >> (i % 64)) & 1;
+}
+
+/* Reserva o bit i; retorna 1 se foi esta chamada que o mudou de 0 para 1 */
+static int bitClaim(unsigned char *bitmap, uint32_t i) {
+    uint64_t mask = 1ULL << (i % 64);
+    return (__atomic_fetch_or(&((uint64_t *)bitmap)[i / 64], mask, __ATOMIC_ACQ_REL) & mask) == 0;
+}
+
+static void bitRelease(unsigned char *bitmap, uint32_t i) {
+    __atomic_fetch_and(&((uint64_t *)bitmap)[i / 64], ~(1ULL << (i % 64)), __ATOMIC_RELEASE);
+}
+
+/* Reserva o primeiro bit livre da faixa [first, first + nbits), com first múltiplo de 64,
+   começando na palavra start da faixa e dando a volta nela. Palavras cheias custam uma leitura;
+   um bit levado por outra thread só faz tentar o próximo. Retorna o bit reservado, ou -1 */
+static int bitmapClaim(unsigned char *bitmap, uint32_t first, uint32_t nbits, uint32_t start) {
+    const uint64_t *words = (const uint64_t *)bitmap + first / 64;
+    uint32_t nwords = (nbits + 63) / 64;
+    for (uint32_t n = 0; n < nwords; n++) {
+        uint32_t w = (start + n) % nwords;
+        uint64_t free_bits = ~__atomic_load_n(&words[w], __ATOMIC_RELAXED);
+        if (w == nwords - 1 && nbits % 64) free_bits &= (1ULL << (nbits % 64)) - 1;
+
+        while (free_bits) {
+            uint32_t i = first + w * 64 + __builtin_ctzll(free_bits);
+            if (bitClaim(bitmap, i)) return i;
+            free_bits &= free_bits - 1;
         }
     }
     return -1;
 }
 
-/* Libera bloco existente */
-void freeBlock(int block_index) {
-    if (block_index >= 0 && block_index < (int)computed_data_blocks) {
-        uint32_t byte = block_index / 8;
-        uint8_t bit = block_index % 8;
-        if ((block_bitmap[byte] & (1 << bit)) == 0) return;
-        block_bitmap[byte] &= ~(1 << bit);
+/* Fatia da thread atual. A cada init/mount os cursores da thread voltam para o começo da faixa
+   da fatia dentro de cada grupo; a primeira thread a alocar (o terminal, ou a primeira sessão do
+   daemon) fica com a fatia 0 e começa do início de cada grupo, como antes */
+static int allocShard(void) {
+    if (thread_shard < 0)
+        thread_shard = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) % ALLOC_SHARDS;
+    uint32_t generation = __atomic_load_n(&layout_generation, __ATOMIC_ACQUIRE);
+    if (thread_generation != generation) {
+        for (uint32_t g = 0; g < group_count; g++)
+            block_cursors[g] = (uint32_t)((uint64_t)(groups[g].block_count / 64) * thread_shard / ALLOC_SHARDS);
+        thread_generation = generation;
     }
+    return thread_shard;
 }
 
-/* Aoca novo inode */
-int allocateInode(void) {
-    for (uint32_t i = 0; i < MAX_INODES; i++) {
-        uint32_t byte = i / 8;
-        uint8_t bit = i % 8;
+static void countFreeBlocks(uint32_t block_index, int64_t delta) {
+    __atomic_fetch_add(&alloc_shards[allocShard()].groups[blockGroup(block_index)].free_blocks, delta, __ATOMIC_RELAXED);
+}
 
-        if ((inode_bitmap[byte] & (1 << bit)) == 0) {
-            inode_bitmap[byte] |= (1 << bit);
-            memset(&inode_table[i], 0, sizeof(inode_t));
-            inode_table[i].next_inode = 0;
-            return i;
+static void countFreeInodes(int inode_index, int64_t delta) {
+    __atomic_fetch_add(&alloc_shards[allocShard()].groups[inodeGroup(inode_index)].free_inodes, delta, __ATOMIC_RELAXED);
+}
+
+/* O inode está alocado? Quem espera a trava de um arquivo deve conferir ao recebê-la,
+   porque ele pode ter sido apagado nesse meio tempo. Um órfão já foi apagado: o bit só volta
+   quando os blocos forem liberados */
+int inodeInUse(int inode_index) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return 0;
+    return bitTest(inode_bitmap, inode_index) &&
+           !(__atomic_load_n(&inode_table[inode_index].flags, __ATOMIC_RELAXED) & INODE_FLAG_ORPHAN);
+}
+
+/* O bit do inode está marcado? Diferente de inodeInUse, conta também os órfãos */
+int inodeAllocated(int inode_index) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return 0;
+    return bitTest(inode_bitmap, inode_index);
+}
+
+/* O bloco de dados está alocado? */
+int blockInUse(uint32_t block_index) {
+    return block_index < computed_data_blocks && bitTest(block_bitmap, block_index);
+}
+
+/* Blocos de dados livres: soma dos contadores dos grupos */
+uint32_t freeBlockCount(void) {
+    int64_t total = 0;
+    for (uint32_t g = 0; g < group_count; g++)
+        total += groupFreeBlocks(g);
+    return total > 0 ? (uint32_t)total : 0;
+}
+
+/* Quantos bits da faixa [first, first + nbits) estão marcados (first múltiplo de 64) */
+static uint32_t countUsedBits(const unsigned char *bitmap, uint32_t first, uint32_t nbits) {
+    const uint64_t *words = (const uint64_t *)bitmap + first / 64;
+    uint32_t used = 0;
+    for (uint32_t w = 0; w < (nbits + 63) / 64; w++) {
+        uint64_t word = words[w];
+        if (w == nbits / 64) word &= (1ULL << (nbits % 64)) - 1;
+        used += __builtin_popcountll(word);
+    }
+    return used;
+}
+
+/* Recalcula os contadores dos grupos a partir dos bitmaps (ao criar ou montar o FS): o total
+   vai para a fatia 0 e as outras zeram */
+static void reset_free_counters(void) {
+    memset(alloc_shards, 0, sizeof(alloc_shards));
+    for (uint32_t g = 0; g < group_count; g++) {
+        const fs_group_desc_t *desc = &groups[g];
+        alloc_shards[0].groups[g].free_blocks = desc->block_count - countUsedBits(block_bitmap, desc->first_block, desc->block_count);
+        alloc_shards[0].groups[g].free_inodes = desc->inode_count - countUsedBits(inode_bitmap, desc->first_inode, desc->inode_count);
+    }
+    __atomic_add_fetch(&layout_generation, 1, __ATOMIC_RELEASE);
+}
+
+/* Aloca um bloco no grupo (ou no primeiro grupo seguinte com espaço) */
+int allocateBlock(int group) {
+    uint32_t block;
+    return allocateBlockRun(group, 1, &block) == 1 ? (int)block : -1;
+}
+
+/* Aloca uma sequência contígua de até max_count blocos livres dentro de um grupo, a partir do
+   primeiro livre depois do cursor da thread no grupo; um grupo cheio passa a busca para o seguinte.
+   Retorna quantos blocos foram reservados a partir de *out_first, ou -1 se o disco estiver cheio */
+int allocateBlockRun(int group, uint32_t max_count, uint32_t *out_first) {
+    if (!out_first || max_count == 0 || group_count == 0) return -1;
+    if (group < 0 || (uint32_t)group >= group_count) group = 0;
+
+    int shard = allocShard();
+    for (uint32_t n = 0; n < group_count; n++) {
+        uint32_t g = (group + n) % group_count;
+        const fs_group_desc_t *desc = &groups[g];
+
+        int first = bitmapClaim(block_bitmap, desc->first_block, desc->block_count, block_cursors[g]);
+        if (first < 0) continue;
+
+        // estende enquanto os vizinhos do grupo estiverem livres; um vizinho levado por outra
+        // thread encerra a sequência
+        uint32_t end = desc->first_block + desc->block_count, count = 1;
+        while (count < max_count && first + count < end && bitClaim(block_bitmap, first + count))
+            count++;
+
+        for (uint32_t b = first; b < first + count; b++)
+            __atomic_store_n(&block_refcount[b], 1, __ATOMIC_RELEASE);
+        block_cursors[g] = (first + count - 1 - desc->first_block) / 64;
+        __atomic_store_n(&refcount_dirty, 1, __ATOMIC_RELEASE);
+        __atomic_fetch_sub(&alloc_shards[shard].groups[g].free_blocks, count, __ATOMIC_RELAXED);
+        *out_first = first;
+        return count;
+    }
+    return -1;
+}
+
+/* Aloca exatamente count blocos contíguos (primeira faixa livre grande o bastante, em qualquer grupo) */
+int allocateBlockExtent(uint32_t count, uint32_t *out_first) {
+    if (!out_first || count == 0) return -1;
+
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < computed_data_blocks; i++) {
+        if (bitTest(block_bitmap, i)) {
+            run = 0;
+            continue;
+        }
+        if (++run < count) continue;
+
+        // faixa livre: reserva bloco a bloco; se outra thread levou algum, devolve o que
+        // já pegou e continua procurando depois dele
+        uint32_t first = i + 1 - count, b = first;
+        while (b <= i && bitClaim(block_bitmap, b)) b++;
+        if (b <= i) {
+            for (uint32_t r = first; r < b; r++) bitRelease(block_bitmap, r);
+            i = b;
+            run = 0;
+            continue;
         }
+
+        for (b = first; b <= i; b++) {
+            __atomic_store_n(&block_refcount[b], 1, __ATOMIC_RELEASE);
+            countFreeBlocks(b, -1);
+        }
+        __atomic_store_n(&refcount_dirty, 1, __ATOMIC_RELEASE);
+        *out_first = first;
+        return 0;
     }
     return -1;
 }
 
-/* Libera inode existent */
-void freeInode(int inode_index) {
-    if (inode_index < 0 || inode_index >= MAX_INODES)
-        return;
+/* Solta uma referência ao bloco; o bloco só é liberado quando ninguém mais o usa */
+void freeBlock(int block_index) {
+    if (block_index < 0 || block_index >= (int)computed_data_blocks) return;
+
+    uint16_t *refcount = &block_refcount[block_index];
+    uint16_t refs = __atomic_load_n(refcount, __ATOMIC_ACQUIRE), next;
+    do {
+        if ((refs & BLOCK_REF_MASK) == 0) return;      // já livre
+        next = (refs & BLOCK_REF_MASK) > 1 ? refs - 1 : 0;
+    } while (!__atomic_compare_exchange_n(refcount, &refs, next, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_store_n(&refcount_dirty, 1, __ATOMIC_RELEASE);
+    if (next != 0) return;
+
+    // última referência: cache de escrita, checksum e cache de clusters são limpos antes de
+    // devolver o bit, porque a partir dele o bloco pode ser realocado. O checksum depois do cache:
+    // uma passada de writeback em andamento só o registra se o bloco ainda estiver lá
+    writebackDiscard(block_index);
+    __atomic_store_n(&block_csums[block_index], 0, __ATOMIC_RELAXED);
+    clusterCacheInvalidate(block_index);
+    bitRelease(block_bitmap, block_index);
+    countFreeBlocks(block_index, 1);
+}
+
+/* Adiciona uma referência a um bloco já alocado (compartilhamento entre inodes) */
+int blockAddRef(uint32_t block_index) {
+    if (block_index == 0 || block_index >= computed_data_blocks) return -1;
+
+    uint16_t *refcount = &block_refcount[block_index];
+    uint16_t refs = __atomic_load_n(refcount, __ATOMIC_ACQUIRE);
+    do {
+        uint16_t count = refs & BLOCK_REF_MASK;
+        if (count == 0 || count == BLOCK_REF_MASK) return -1;     // livre ou contador saturado
+    } while (!__atomic_compare_exchange_n(refcount, &refs, refs + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_store_n(&refcount_dirty, 1, __ATOMIC_RELEASE);
+    return 0;
+}
 
+/* Número de inodes que referenciam o bloco */
+uint16_t blockRefCount(uint32_t block_index) {
+    if (block_index >= computed_data_blocks) return 0;
+    return __atomic_load_n(&block_refcount[block_index], __ATOMIC_ACQUIRE) & BLOCK_REF_MASK;
+}
+
+/* Marca o bloco como referenciado pelo índice de deduplicação.
+   A marca some quando o bloco é liberado, invalidando entradas antigas do índice */
+void blockSetIndexed(uint32_t block_index) {
+    if (block_index == 0 || block_index >= computed_data_blocks) return;
+
+    uint16_t *refcount = &block_refcount[block_index];
+    uint16_t refs = __atomic_load_n(refcount, __ATOMIC_ACQUIRE);
+    do {
+        if ((refs & BLOCK_REF_MASK) == 0) return;
+    } while (!__atomic_compare_exchange_n(refcount, &refs, refs | BLOCK_REF_INDEXED, 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_store_n(&refcount_dirty, 1, __ATOMIC_RELEASE);
+}
+
+int blockIsIndexed(uint32_t block_index) {
+    if (block_index >= computed_data_blocks) return 0;
+    return (__atomic_load_n(&block_refcount[block_index], __ATOMIC_ACQUIRE) & BLOCK_REF_INDEXED) != 0;
+}
+
+/* Aoca novo inode no grupo (ou no primeiro grupo seguinte com inodes livres) */
+int allocateInode(int group) {
+    int inode_index;
+    return allocateInodes(group, &inode_index, 1) == 1 ? inode_index : -1;
+}
+
+/* Reserva até count inodes livres, a partir do grupo indicado, numa única varredura de cada
+   fatia do bitmap (palavras cheias são puladas). Retorna quantos foram reservados */
+int allocateInodes(int group, int *out, int count) {
+    if (group_count == 0) return 0;
+    if (group < 0 || (uint32_t)group >= group_count) group = 0;
+
+    int shard = allocShard();
+    int found = 0;
+    for (uint32_t n = 0; n < group_count && found < count; n++) {
+        uint32_t g = (group + n) % group_count;
+        const fs_group_desc_t *desc = &groups[g];
+        // a fatia 0 procura do início do grupo e reaproveita os inodes de número mais baixo
+        uint32_t start = (uint32_t)((desc->inode_count / 64) * shard / ALLOC_SHARDS);
+        while (found < count) {
+            int i = bitmapClaim(inode_bitmap, desc->first_inode, desc->inode_count, start);
+            if (i < 0) break;
+            memset(&inode_table[i], 0, sizeof(inode_t));
+            __atomic_fetch_sub(&alloc_shards[shard].groups[g].free_inodes, 1, __ATOMIC_RELAXED);
+            out[found++] = i;
+            start = (i - desc->first_inode) / 64;
+        }
+    }
+    return found;
+}
+
+/* Solta até max_blocks blocos do inode. A cadeia é consumida pela frente: quando os blocos do
+   inode acabam, ele herda os blocos e o next_inode do primeiro encadeado, que é liberado, então
+   a cadeia nunca é percorrida de uma vez e cada bloco continua com um único dono.
+   Retorna 1 quando não sobrou bloco nem cadeia (falta só liberar o próprio inode) */
+int freeInodeBlocks(int inode_index, uint32_t max_blocks) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return 1;
     inode_t *inode = &inode_table[inode_index];
 
-    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
-        int block = inode->blocks[i];
-        if (block > 0)
-            freeBlock(block);
+    // nós da árvore B+ de um diretório grande não ficam em blocks[]
+    if (inode->type == FILE_DIRECTORY && (inode->flags & INODE_FLAG_DIR_BTREE)) {
+        btreeFree(inode_index);
+        inode->flags &= ~INODE_FLAG_DIR_BTREE;
     }
 
-    if (inode->next_inode)
-        freeInode(inode->next_inode);
+    uint32_t freed = 0;
+    for (;;) {
+        for (int i = 0; i < BLOCKS_PER_INODE && freed < max_blocks; i++) {
+            if (inode->blocks[i] == 0) continue;
+            freeBlock(inode->blocks[i]);
+            inode->blocks[i] = 0;
+            freed++;
+        }
+        if (freed >= max_blocks) return 0;
+
+        int next = inode->next_inode;
+        if (next <= 0 || next >= MAX_INODES) {
+            inode->next_inode = 0;
+            return 1;
+        }
+        inode_t *chained = &inode_table[next];
+        memcpy(inode->blocks, chained->blocks, sizeof(inode->blocks));
+        inode->next_inode = chained->next_inode;
+
+        // encadeados não têm nome: nada deles no cache de diretórios
+        memset(chained, 0, sizeof(inode_t));
+        bitRelease(inode_bitmap, next);
+        countFreeInodes(next, 1);
+    }
+}
+
+/* Libera os blocos e o inode (e os inodes encadeados). Com released, só marca o inode no
+   conjunto em vez de já tirá-lo do cache de diretórios */
+static void releaseInode(int inode_index, uint8_t *released) {
+    if (inode_index < 0 || inode_index >= MAX_INODES)
+        return;
+
+    freeInodeBlocks(inode_index, UINT32_MAX);
+
+    // zera antes de devolver ao bitmap: depois disso outra thread pode realocá-lo
+    memset(&inode_table[inode_index], 0, sizeof(inode_t));
+    bitRelease(inode_bitmap, inode_index);
+    countFreeInodes(inode_index, 1);
+
+    userdbInodeReleased(inode_index);
+    if (released) released[inode_index / 8] |= (1 << (inode_index % 8));
+    else dcachePurgeInode(inode_index);
+}
+
+/* Libera inode existent */
+void freeInode(int inode_index) {
+    releaseInode(inode_index, NULL);
+}
 
-    uint32_t byte = inode_index / 8;
-    uint8_t bit = inode_index % 8;
-    inode_bitmap[byte] &= ~(1 << bit);
+/* Libera vários inodes de uma vez (rm -r): blocos e bitmaps mudam só em memória, o cache de
+   diretórios é varrido uma única vez no fim e quem chama grava os metadados com um sync_fs */
+void freeInodes(const int *inodes, int count) {
+    uint8_t released[(MAX_INODES + 7) / 8] = {0};
 
-    memset(inode, 0, sizeof(inode_t));
+    for (int i = 0; i < count; i++) {
+        int index = inodes[i];
+        if (index < 0 || index >= MAX_INODES) continue;
+        if (!inodeAllocated(index)) continue;     // já liberado (órfãos ainda não)
+        releaseInode(index, released);
+    }
+    dcachePurgeInodes(released);
 }
 
 /* ---- leitura e escrita ---- */
-/* Le bloco */
+/* Le bloco. Leituras e escritas são posicionais (pread/pwrite no descritor, sem a posição
+   compartilhada do FILE), então várias threads acessam o disco ao mesmo tempo. Um bloco sujo
+   no cache de escrita é lido de lá */
 int readBlock(uint32_t block_index, void *buffer){
     if (!disk || block_index >= computed_data_blocks) return -1;
+    if (writebackGet(block_index, buffer)) return 0;
     off_t offset = off_data_region + (off_t)block_index * BLOCK_SIZE;
-    fseek(disk, offset, SEEK_SET);
-    size_t read_bytes = fread(buffer, 1, BLOCK_SIZE, disk);
-    return (read_bytes == BLOCK_SIZE) ? 0 : -1;
+    ssize_t read_bytes = pread(fileno(disk), buffer, BLOCK_SIZE, offset);
+    if (read_bytes != BLOCK_SIZE) return -1;
+    return verify_block(block_index, buffer);
 }
 
-/* Escreve bloco */
+/* Escreve bloco: vai para o cache de escrita, e a thread de writeback grava depois */
 int writeBlock(uint32_t block_index, const void *buffer){
     if (!disk || block_index >= computed_data_blocks) return -1;
-    off_t offset = off_data_region + (off_t)block_index * BLOCK_SIZE;
-    fseek(disk, offset, SEEK_SET);
-    size_t written_bytes = fwrite(buffer, 1, BLOCK_SIZE, disk);
-    fflush(disk);
-    fsync(fileno(disk));
-    return (written_bytes == BLOCK_SIZE) ? 0 : -1;
-}
\ No newline at end of file
+    return writebackPut(block_index, buffer);
+}
+
+/* Le count blocos contíguos com um único acesso ao disco */
+int readBlocks(uint32_t first_block, uint32_t count, void *buffer) {
+    if (!disk || count == 0 || first_block + count > computed_data_blocks) return -1;
+    off_t offset = off_data_region + (off_t)first_block * BLOCK_SIZE;
+    ssize_t read_bytes = pread(fileno(disk), buffer, (size_t)count * BLOCK_SIZE, offset);
+    if (read_bytes != (ssize_t)((size_t)count * BLOCK_SIZE)) return -1;
+    for (uint32_t i = 0; i < count; i++) {
+        char *block = (char *)buffer + (size_t)i * BLOCK_SIZE;
+        if (writebackGet(first_block + i, block)) continue;
+        if (verify_block(first_block + i, block) != 0) return -1;
+    }
+    return 0;
+}
+
+/* Escreve count blocos contíguos no cache de escrita; a passada de writeback os grava de novo
+   com um único acesso, porque ordena os blocos e junta os vizinhos */
+int writeBlocks(uint32_t first_block, uint32_t count, const void *buffer) {
+    if (!disk || count == 0 || first_block + count > computed_data_blocks) return -1;
+    for (uint32_t i = 0; i < count; i++) {
+        const char *block = (const char *)buffer + (size_t)i * BLOCK_SIZE;
+        if (writebackPut(first_block + i, block) != 0) return -1;
+    }
+    return 0;
+}
+/* ---- Scrub: verificação completa dos checksums ---- */
+#define SCRUB_CHUNK_BLOCKS 256
+#define SCRUB_MAX_THREADS 16
+
+typedef struct {
+    int fd;
+    uint32_t first_block;
+    uint32_t end_block;
+    uint32_t blocks_checked;
+    uint32_t blocks_unverified;
+    uint32_t data_errors;
+    uint64_t bytes_read;
+} scrub_worker_t;
+
+static int chunk_has_allocated(uint32_t first, uint32_t count) {
+    for (uint32_t b = first; b < first + count; b++)
+        if (blockInUse(b)) return 1;
+    return 0;
+}
+
+/* Cada thread lê sua faixa de blocos com pread em lotes, pulando lotes sem blocos alocados */
+static void *scrub_worker(void *arg) {
+    scrub_worker_t *w = arg;
+    char *buffer = malloc((size_t)SCRUB_CHUNK_BLOCKS * BLOCK_SIZE);
+    if (!buffer) return NULL;
+
+    for (uint32_t first = w->first_block; first < w->end_block; first += SCRUB_CHUNK_BLOCKS) {
+        uint32_t count = w->end_block - first < SCRUB_CHUNK_BLOCKS ? w->end_block - first : SCRUB_CHUNK_BLOCKS;
+        if (!chunk_has_allocated(first, count)) continue;
+
+        size_t bytes = (size_t)count * BLOCK_SIZE;
+        off_t offset = off_data_region + (off_t)first * BLOCK_SIZE;
+        if (pread(w->fd, buffer, bytes, offset) != (ssize_t)bytes) {
+            fprintf(stderr, "[ERRO] Falha de leitura nos blocos %u-%u\n", first, first + count - 1);
+            w->data_errors += count;
+            continue;
+        }
+        w->bytes_read += bytes;
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t b = first + i;
+            if (!blockInUse(b) || b == 0) continue;
+            if (block_csums[b] == 0) { w->blocks_unverified++; continue; }
+            w->blocks_checked++;
+            uint32_t crc = crc32c(0, buffer + (size_t)i * BLOCK_SIZE, BLOCK_SIZE);
+            if (crc != block_csums[b]) {
+                fprintf(stderr, "[ERRO] Checksum inválido no bloco %u (esperado %08x, lido %08x)\n",
+                        b, block_csums[b], crc);
+                w->data_errors++;
+            }
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/* Relê os metadados gravados no disco e compara com os checksums persistidos */
+static uint32_t scrub_metadata(int fd, uint64_t *bytes_read) {
+    meta_region_t regions[META_REGION_COUNT];
+    list_meta_regions(regions);
+
+    char buffer[BLOCK_SIZE];
+    uint32_t idx = 0, errors = 0;
+    for (int r = 0; r < META_REGION_COUNT; r++) {
+        for (size_t off = 0; off < regions[r].bytes; off += BLOCK_SIZE, idx++) {
+            size_t len = regions[r].bytes - off < BLOCK_SIZE ? regions[r].bytes - off : BLOCK_SIZE;
+            if (pread(fd, buffer, len, regions[r].offset + (off_t)off) != (ssize_t)len ||
+                crc32c(0, buffer, len) != meta_csums[idx]) {
+                fprintf(stderr, "[ERRO] Checksum inválido nos metadados: %s, bloco %zu\n",
+                        regions[r].name, off / BLOCK_SIZE);
+                errors++;
+            }
+            *bytes_read += len;
+        }
+    }
+    return errors;
+}
+
+int scrub_fs(int nthreads, scrub_report_t *report) {
+    if (!disk || !report) return -1;
+    memset(report, 0, sizeof(*report));
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > SCRUB_MAX_THREADS) nthreads = SCRUB_MAX_THREADS;
+
+    // garante que disco e checksums persistidos reflitam o estado em memória
+    if (flush_fs() != 0) return -1;
+    int fd = fileno(disk);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    report->meta_errors = scrub_metadata(fd, &report->bytes_read);
+
+    // faixas contíguas alinhadas ao lote, uma por thread
+    uint32_t chunks = (computed_data_blocks + SCRUB_CHUNK_BLOCKS - 1) / SCRUB_CHUNK_BLOCKS;
+    uint32_t chunks_per_thread = (chunks + nthreads - 1) / nthreads;
+    scrub_worker_t workers[SCRUB_MAX_THREADS];
+    pthread_t threads[SCRUB_MAX_THREADS];
+    int threaded[SCRUB_MAX_THREADS];
+    int started = 0;
+
+    for (int t = 0; t < nthreads; t++) {
+        uint32_t first = (uint32_t)t * chunks_per_thread * SCRUB_CHUNK_BLOCKS;
+        if (first >= computed_data_blocks) break;
+        uint32_t end_block = first + chunks_per_thread * SCRUB_CHUNK_BLOCKS;
+        if (end_block > computed_data_blocks) end_block = computed_data_blocks;
+
+        workers[t] = (scrub_worker_t){ .fd = fd, .first_block = first, .end_block = end_block };
+        threaded[t] = pthread_create(&threads[t], NULL, scrub_worker, &workers[t]) == 0;
+        // sem thread extra: a faixa é verificada aqui mesmo
+        if (!threaded[t]) scrub_worker(&workers[t]);
+        started++;
+    }
+
+    for (int t = 0; t < started; t++) {
+        if (threaded[t]) pthread_join(threads[t], NULL);
+        report->blocks_checked += workers[t].blocks_checked;
+        report->blocks_unverified += workers[t].blocks_unverified;
+        report->data_errors += workers[t].data_errors;
+        report->bytes_read += workers[t].bytes_read;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    report->threads = started;
+    report->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return (report->data_errors || report->meta_errors) ? 1 : 0;
+}
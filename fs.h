@@ -12,8 +12,9 @@
 
 #define DISK_NAME "disk.dat"
 #define FS_MAGIC 0xF5F5F5F5
+#define FS_VERSION 11
 #define DISK_SIZE_MB 64
-#define MAX_INODES 128
+#define MAX_INODES 4096
 #define BLOCK_SIZE 512
 #define BLOCKS_PER_INODE 12
 #define MAX_BLOCKS ((DISK_SIZE_MB * 1024 * 1024) / BLOCK_SIZE)
@@ -22,19 +23,110 @@
 #define ROOT_INODE 0
 #define ROOT_UID 0
 
+/* Funcionalidades opcionais (campo features do header) */
+#define FS_FEATURE_DEDUP (1u << 0)
+#define FS_FEATURE_USERDB (1u << 1)     // usuários na base binária (userdb.c), passwd/shadow viram visões
+
+/* Índice de deduplicação: tabela hash associativa por conjunto */
+#define DEDUP_INDEX_BUCKETS 8192
+#define DEDUP_BUCKET_WAYS 4
+
+/* Flags por inode */
+#define INODE_FLAG_COMPRESSED (1u << 0)
+#define INODE_FLAG_DIR_BTREE (1u << 1)
+#define INODE_FLAG_USERDB_VIEW (1u << 2)    // conteúdo gerado a partir da base binária de usuários
+#define INODE_FLAG_ORPHAN (1u << 3)         // apagado, esperando a liberação (orphan.h)
+
+/* Diretórios: o formato linear é usado até DIR_LINEAR_MAX_BLOCKS blocos de entradas.
+   Acima disso o diretório vira uma árvore B+ ordenada por nome: blocks[0] do inode é a raiz,
+   os nós apontam para os filhos pelo número físico do bloco (sem cadeia next_inode) e as
+   folhas, encadeadas da esquerda para a direita, guardam as entradas em ordem.
+   Em disco cada entrada é um registro de tamanho variável (dir_record_t, como no ext2),
+   empacotado no início do bloco (ou da área da folha); o primeiro rec_len 0 marca o fim */
+#define DIR_LINEAR_MAX_BLOCKS 2
+#define DIR_RECORD_SIZE(name_len) ((sizeof(dir_record_t) + (name_len) + 3) & ~(size_t)3)
+#define DIR_MAX_RECORDS_PER_BLOCK (BLOCK_SIZE / DIR_RECORD_SIZE(1))
+#define DIR_BTREE_MAGIC 0x45525442 // "BTRE"
+#define DIR_BTREE_MAX_DEPTH 8
+#define DIR_BTREE_LEAF_BYTES (BLOCK_SIZE - sizeof(dir_btree_header_t))
+#define DIR_BTREE_KEYS (DIR_BTREE_LEAF_BYTES / sizeof(dir_btree_key_t))
+
+/* Compressão: o arquivo é dividido em clusters de CLUSTER_BLOCKS slots do inode.
+   Cada cluster guarda um header e até CLUSTER_DATA_SIZE bytes do arquivo (comprimidos ou não);
+   slots não usados pelo cluster ficam com 0 */
+#define CLUSTER_BLOCKS 4
+#define CLUSTERS_PER_INODE (BLOCKS_PER_INODE / CLUSTER_BLOCKS)
+#define CLUSTER_DATA_SIZE (CLUSTER_BLOCKS * BLOCK_SIZE - sizeof(cluster_header_t))
+
+/* Grupos de alocação: os blocos de dados são divididos em faixas de GROUP_BLOCKS blocos, e os
+   inodes em faixas do mesmo número de grupos. Cada grupo tem a sua fatia do bitmap de blocos,
+   a sua fatia do bitmap e da tabela de inodes e os seus contadores de livres. Um arquivo recebe
+   o inode no grupo do diretório pai e os blocos no grupo do próprio inode; diretórios novos vão
+   para o grupo mais vazio, espalhando as árvores de usuários diferentes pelo disco */
+#define GROUP_BLOCKS 8192
+#define MAX_GROUPS 32
+
+/* Entrada da tabela de refcount: 15 bits de contagem + flag "bloco está no índice de dedup" */
+#define BLOCK_REF_MASK 0x7FFF
+#define BLOCK_REF_INDEXED 0x8000
+
+typedef struct {
+    uint32_t first_block;       // primeiro bloco de dados do grupo
+    uint32_t block_count;
+    uint32_t first_inode;
+    uint32_t inode_count;
+    uint32_t off_block_bitmap;  // fatias do grupo nas regiões de metadados
+    uint32_t off_inode_bitmap;
+    uint32_t off_inode_table;
+    uint32_t free_blocks;       // contadores no último sync (a montagem recalcula pelos bitmaps)
+    uint32_t free_inodes;
+} fs_group_desc_t;
+
 typedef struct {
     uint32_t magic; // identificador do FS
+    uint32_t version; // versão do formato em disco
+    uint32_t features; // FS_FEATURE_*
     uint32_t block_bitmap_bytes;
     uint32_t inode_bitmap_bytes;
     uint32_t inode_table_bytes;
+    uint32_t block_refcount_bytes;
+    uint32_t dedup_index_bytes;
+    uint32_t csum_region_bytes;
     uint32_t meta_blocks;
     uint32_t data_blocks;
     uint32_t off_block_bitmap;
     uint32_t off_inode_bitmap;
     uint32_t off_inode_table;
+    uint32_t off_block_refcount;
+    uint32_t off_dedup_index;
+    uint32_t off_csum_region;
     uint32_t off_data_region;
+    uint32_t userdb_first_block;    // região contígua da base binária de usuários (0 blocos = sem base)
+    uint32_t userdb_blocks;
+    uint32_t orphan_head;           // primeiro inode da lista de órfãos (0 = vazia)
+    uint32_t group_count;
+    fs_group_desc_t groups[MAX_GROUPS];
+    uint32_t header_csum; // CRC32C do header (calculado com este campo zerado)
 } fs_header_t;
 
+typedef struct {
+    uint64_t hash;      // hash do conteúdo do bloco
+    uint32_t block;     // bloco com esse conteúdo (0 = entrada vazia)
+    uint32_t reserved;
+} dedup_entry_t;
+
+typedef enum {
+    CLUSTER_RAW,    // dados guardados sem compressão
+    CLUSTER_LZ      // dados comprimidos com o codec LZ
+} cluster_method_t;
+
+typedef struct {
+    uint16_t raw_len;       // bytes do arquivo no cluster
+    uint16_t stored_len;    // bytes gravados após o header
+    uint8_t method;         // cluster_method_t
+    uint8_t reserved[3];
+} cluster_header_t;
+
 typedef enum {
     FILE_REGULAR,
     FILE_DIRECTORY,
@@ -65,24 +157,67 @@ typedef struct {
     permission_t permissions;
     uint32_t blocks[BLOCKS_PER_INODE];
     uint32_t next_inode;
-    uint32_t link_target_index;     
+    uint32_t link_target_index;     // alvo do link; num órfão, o próximo da lista de órfãos
+    uint32_t flags;                 // INODE_FLAG_*
 } inode_t;
 
+/* Entrada de diretório em disco: cabeçalho de 8 bytes seguido do nome (sem '\0') */
+typedef struct {
+    uint32_t inode_index;
+    uint16_t rec_len;       // tamanho do registro: DIR_RECORD_SIZE(name_len)
+    uint8_t name_len;
+    uint8_t file_type;      // inode_type_t do alvo, para filtrar e listar sem ler o inode
+    char name[];
+} dir_record_t;
+
+/* Entrada de diretório desempacotada, entregue aos visitantes de dirForEach */
 typedef struct {
     char name[MAX_NAMESIZE];
     uint32_t inode_index;
+    uint8_t type;           // inode_type_t
 } dir_entry_t;
 
+/* Bloco de diretório linear (alinhado para acessar os registros) */
+typedef union {
+    char raw[BLOCK_SIZE];
+    uint32_t align;
+} dir_block_t;
+
+typedef struct {
+    uint32_t magic;         // DIR_BTREE_MAGIC
+    uint16_t count;         // entradas (folha) ou chaves (nó interno) usadas
+    uint8_t level;          // 0 = folha; a raiz tem o maior nível
+    uint8_t reserved;
+    uint32_t next_leaf;     // (folha) próxima folha em ordem de nome, 0 = última
+    uint16_t used;          // (folha) bytes ocupados pelos registros
+    uint16_t reserved2;
+} dir_btree_header_t;
+
+typedef struct {
+    char name[MAX_NAMESIZE];    // menor nome coberto pelo filho (a chave 0 cobre o início da faixa)
+    uint32_t block;             // bloco físico do filho
+} dir_btree_key_t;
+
+typedef struct {
+    dir_btree_header_t header;
+    union {
+        char records[DIR_BTREE_LEAF_BYTES];         // folha: registros ordenados por nome
+        dir_btree_key_t keys[DIR_BTREE_KEYS];       // nó interno
+    };
+} dir_btree_node_t;
+
+/* Entrada de diretório já com os atributos do inode (lotes de dirIterNext) */
 typedef struct {
     char name[MAX_NAMESIZE];
     inode_type_t type;
-    char creator[MAX_NAMESIZE];
-    char owner[MAX_NAMESIZE];
+    uint32_t creator_uid;
+    uint32_t owner_uid;
     uint32_t size;
     time_t creation_date;       
     time_t modification_date;   
     uint16_t permissions;
     uint32_t inode_index;
+    uint32_t link_target_index;     // alvo, se a entrada é um link simbólico
 } fs_entry_t;
 
 typedef struct {
@@ -90,31 +225,108 @@ typedef struct {
     int count;
 } fs_dir_list_t;
 
+typedef struct {
+    uint32_t threads;
+    uint32_t blocks_checked;     // blocos de dados verificados
+    uint32_t blocks_unverified;  // blocos alocados sem checksum registrado
+    uint32_t data_errors;
+    uint32_t meta_errors;
+    uint64_t bytes_read;
+    double seconds;
+} scrub_report_t;
+
 
 /* Funções principais */
 int init_fs(void);
 int mount_fs(void);
+/* sync_fs e sync_inode só marcam os metadados: a thread de writeback grava blocos e metadados
+   até WRITEBACK_EXPIRE_MS depois, e uma queda nesse intervalo perde as últimas alterações.
+   flush_fs grava tudo na hora (scrub e unmount) */
 int sync_fs(void);
 void sync_inode(int inode_num);
+int flush_fs(void);
 int unmount_fs(void);
+int set_fs_features(uint32_t features);
+int scrub_fs(int nthreads, scrub_report_t *report);
 
 /* Utilitarios */
 const char *format_time(time_t t, char *buf, size_t buflen);
 int show_inode_info(int inode_index);
 
-/* Alocação */
-int allocateBlock(void);
+/* Alocação. Blocos e inodes são pedidos a um grupo (inodeGroup do dono, ou groupForDirectory
+   para um diretório novo); com o grupo cheio, a busca segue pelos grupos seguintes */
+int inodeGroup(int inode_index);
+int blockGroup(uint32_t block_index);
+int groupForDirectory(int parent_inode);
+int allocateBlock(int group);
+int allocateBlockRun(int group, uint32_t max_count, uint32_t *out_first);
+int allocateBlockExtent(uint32_t count, uint32_t *out_first);
 void freeBlock(int block_index);
-int allocateInode(void);
+int blockAddRef(uint32_t block_index);
+uint16_t blockRefCount(uint32_t block_index);
+void blockSetIndexed(uint32_t block_index);
+int blockIsIndexed(uint32_t block_index);
+int blockInUse(uint32_t block_index);
+uint32_t freeBlockCount(void);
+int allocateInode(int group);
+int allocateInodes(int group, int *out, int count);
 void freeInode(int inode_index);
+void freeInodes(const int *inodes, int count);
+int freeInodeBlocks(int inode_index, uint32_t max_blocks);
+
+/* Concorrência: cada inode tem uma trava de leitura/escrita que protege seus campos, os inodes
+   encadeados (next_inode) e, num diretório, os blocos de entradas (lineares ou da árvore B+).
+   Buscas e leituras (dirFindEntry, dirForEach, readContentFromInode) pegam a trava de leitura e
+   rodam em paralelo; quem altera pega a de escrita, então escritas em arquivos diferentes não
+   se serializam. O acesso ao disco é posicional (pread/pwrite), e as escritas passam pelo cache
+   de escrita (writeback.h).
+
+   Ordem das travas (quem segura uma só pode pegar as que vêm depois):
+     1. rename_lock (fs_operations.c): renameEntry e removeTree, que mudam a forma da árvore
+     2. userdb_lock (userdb.c)
+     3. travas de inode: ancestral antes de descendente; sem essa relação, índice menor primeiro
+     4. cwd_lock (fs_operations.c): diretórios atuais das sessões, tomada por rmdir e rm -r
+        até os inodes virarem órfãos
+     5. meta_lock (fs.c): gravação dos metadados, um sync por vez
+     6. dedup_lock (dedup.c): buckets do índice de deduplicação
+     7. flush_lock (writeback.c): uma passada de gravação dos blocos sujos por vez
+     8. caches de diretórios (dcache.c), de clusters (compress.c) e de escrita (wb_lock em
+        writeback.c) e lista de órfãos (orphan_lock em orphan.c), que não pegam nenhuma outra
+   O alocador não tem trava: bitmaps e refcount mudam com operações atômicas (fs.c) e podem ser
+   usados segurando qualquer uma das travas acima.
+   As travas de inode não são recursivas: as funções públicas de fs_operations.c pegam a trava
+   e chamam versões internas que supõem a trava já tomada.
+   Sem trava, de propósito: o sync copia a tabela de inodes e o índice de deduplicação sem parar
+   os escritores (uma cópia rasgada é regravada no próximo sync), e listagens leem tipo e
+   tamanho dos filhos sem pegar a trava de cada um */
+void inodeLockRead(int inode_index);
+void inodeLockWrite(int inode_index);
+void inodeUnlock(int inode_index);
+void inodeLockPair(int a, int b);
+void inodeUnlockPair(int a, int b);
+int inodeInUse(int inode_index);
+int inodeAllocated(int inode_index);
 
 /* Leitura e escrita nos blocos */
 int readBlock(uint32_t block_index, void *buffer);
 int writeBlock(uint32_t block_index, const void *buffer);
+int readBlocks(uint32_t first_block, uint32_t count, void *buffer);
+int writeBlocks(uint32_t first_block, uint32_t count, const void *buffer);
+/* Para a passada de writeback: grava no disco os checksums de blocos que ela acabou de gravar e
+   registra o de um bloco em memória, que sempre corresponde ao conteúdo em disco */
+int writeBlockCsums(uint32_t first_block, uint32_t count, const uint32_t *csums);
+void setBlockCsum(uint32_t block_index, uint32_t csum);
 
 
 /* Variáveis globais */
 extern unsigned char *block_bitmap;
+extern uint16_t *block_refcount;
+extern dedup_entry_t *dedup_index;
+extern int dedup_index_dirty;
+extern uint32_t fs_features;
+extern uint32_t userdb_first_block;
+extern uint32_t userdb_blocks;
+extern uint32_t orphan_head;
 extern unsigned char *inode_bitmap;
 extern inode_t *inode_table;
 extern FILE *disk;
@@ -123,6 +335,9 @@ extern FILE *disk;
 extern size_t computed_block_bitmap_bytes;
 extern size_t computed_inode_bitmap_bytes;
 extern size_t computed_inode_table_bytes;
+extern size_t computed_block_refcount_bytes;
+extern size_t computed_dedup_index_bytes;
+extern size_t computed_csum_region_bytes;
 extern uint32_t computed_meta_blocks;
 extern uint32_t computed_data_blocks;
 
@@ -1,233 +1,746 @@
 #include "fs.h"
+#include "fs_operations.h"
+#include "dedup.h"
+#include "compress.h"
+#include "btree.h"
+#include "dcache.h"
+#include "walk.h"
+#include "userdb.h"
+#include "orphan.h"
+#include "writeback.h"
+#include <unistd.h>
+#include <pthread.h>
 #define UNREFERENCED(x) (void)(x)
 
+/* Serializa as operações que mudam a forma da árvore (renameEntry, removeTree), como o
+   s_vfs_rename_mutex do Linux: com ela, quem é ancestral de quem não muda e as travas dos
+   diretórios envolvidos podem ser pegas do ancestral para o descendente (ordem em fs.h) */
+static pthread_mutex_t rename_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ---- diretórios atuais das sessões ----
+   cwd_pins conta as sessões paradas em cada diretório. rmdir e rm -r conferem a contagem e
+   tornam os inodes órfãos sem soltar cwd_lock, e dirPin confere o inode com ela tomada: ou o cd
+   vê o diretório já apagado, ou a remoção vê a sessão dentro dele. Assim um diretório em uso
+   nunca vai para a liberação, e o número dele não é reaproveitado debaixo de uma sessão */
+static pthread_mutex_t cwd_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t cwd_pins[MAX_INODES];
+
+int dirPin(int dir_inode) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES) return -1;
+    pthread_mutex_lock(&cwd_lock);
+    int ok = inodeInUse(dir_inode) && inode_table[dir_inode].type == FILE_DIRECTORY;
+    if (ok) cwd_pins[dir_inode]++;
+    pthread_mutex_unlock(&cwd_lock);
+    return ok ? 0 : -1;
+}
+
+void dirUnpin(int dir_inode) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES) return;
+    pthread_mutex_lock(&cwd_lock);
+    if (cwd_pins[dir_inode] > 0) cwd_pins[dir_inode]--;
+    pthread_mutex_unlock(&cwd_lock);
+}
+
+/* Algum dos inodes é o diretório atual de uma sessão? Chamada com cwd_lock */
+static int anyPinnedLocked(const int *inodes, int count) {
+    for (int i = 0; i < count; i++)
+        if (cwd_pins[inodes[i]] > 0) return 1;
+    return 0;
+}
+
 /* ---- diretórios ---- */
-/* Tenta encontrar elemento em um diretório */
-int dirFindEntry(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
-    if (dir_inode < 0 || dir_inode >= MAX_INODES || !name || !out_inode) 
-        return -1;
-    
+/* Trava o diretório e confere que ele ainda existe: entre resolver o caminho e receber a trava
+   ele pode ter sido apagado, e o número reaproveitado. Retorna 0 com a trava tomada, -1 sem ela */
+static int lockLiveDir(int dir_inode, int write) {
+    if (write) inodeLockWrite(dir_inode);
+    else inodeLockRead(dir_inode);
+    if (inodeInUse(dir_inode) && inode_table[dir_inode].type == FILE_DIRECTORY) return 0;
+    inodeUnlock(dir_inode);
+    return -1;
+}
 
-    if (strlen(name) >= sizeof(((dir_entry_t*)0)->name)) {
-        // nome muito grande para o campo do dir_entry_t
-        return -1;
-    }
+/* Tipo compatível com o procurado (FILE_SYMLINK e FILE_ANY aceitam qualquer um) */
+static int typeCompatible(inode_type_t actual, inode_type_t wanted) {
+    return actual == wanted || wanted == FILE_SYMLINK || wanted == FILE_ANY;
+}
 
-    int current_inode = dir_inode;
+/* ---- registros em disco ---- */
+/* Registro no deslocamento offset da área; NULL no fim (rec_len 0) ou se o registro é inválido */
+const dir_record_t *dirRecordAt(const void *area, size_t capacity, size_t offset) {
+    if (offset + sizeof(dir_record_t) > capacity) return NULL;
 
-    while (current_inode >= 0) {
-        inode_t *dir = &inode_table[current_inode];
-        if (dir->type != FILE_DIRECTORY) return -1;        
+    const dir_record_t *rec = (const dir_record_t *)((const char *)area + offset);
+    if (rec->rec_len == 0 || rec->name_len == 0) return NULL;
+    if (rec->rec_len < DIR_RECORD_SIZE(rec->name_len) || offset + rec->rec_len > capacity) return NULL;
+    return rec;
+}
 
-        for (int i = 0; i < BLOCKS_PER_INODE; i++) {
-            if (dir->blocks[i] == 0) continue;
+/* Bytes ocupados pelos registros no início da área */
+size_t dirRecordsUsed(const void *area, size_t capacity) {
+    size_t offset = 0;
+    const dir_record_t *rec;
+    while ((rec = dirRecordAt(area, capacity, offset)) != NULL) offset += rec->rec_len;
+    return offset;
+}
 
-            // buffer alocado dinamicamente para não sobrecarregar a pilha
-            dir_entry_t *buffer = malloc(BLOCK_SIZE);
-            if (!buffer) return -1;
+/* Compara o nome do registro (sem '\0') com name, na mesma ordem de strcmp */
+int dirRecordCompare(const dir_record_t *rec, const char *name) {
+    size_t len = strlen(name);
+    size_t common = rec->name_len < len ? rec->name_len : len;
+    int res = memcmp(rec->name, name, common);
+    if (res != 0) return res;
+    return (int)rec->name_len - (int)len;
+}
 
-            if (readBlock(dir->blocks[i], buffer) != 0) {
-                free(buffer);
-                return -1;
-            }
+/* Registro com o nome procurado e de tipo compatível (o tipo vem do próprio registro) */
+int dirRecordMatches(const dir_record_t *rec, const char *name, inode_type_t type) {
+    return rec->name_len == strlen(name) && memcmp(rec->name, name, rec->name_len) == 0 &&
+           typeCompatible(rec->file_type, type);
+}
 
-            int entries = BLOCK_SIZE / sizeof(dir_entry_t);
-            for (int j = 0; j < entries; j++) {
-                if (strcmp(buffer[j].name, name) == 0 &&
-                    (inode_table[buffer[j].inode_index].type == type || type == FILE_SYMLINK || type == FILE_ANY)) {
-                        
-                    *out_inode = buffer[j].inode_index;
-                    free(buffer);
-                    return 0;
-                }
+void dirRecordToEntry(const dir_record_t *rec, dir_entry_t *out) {
+    size_t len = rec->name_len < MAX_NAMESIZE - 1 ? rec->name_len : MAX_NAMESIZE - 1;
+    memcpy(out->name, rec->name, len);
+    out->name[len] = '\0';
+    out->inode_index = rec->inode_index;
+    out->type = rec->file_type;
+}
+
+/* Insere um registro no deslocamento offset, empurrando os seguintes. Retorna -1 se não há espaço */
+int dirRecordInsert(void *area, size_t capacity, size_t *used, size_t offset,
+                    const char *name, int inode_index, inode_type_t type) {
+    size_t name_len = strlen(name);
+    size_t size = DIR_RECORD_SIZE(name_len);
+    if (name_len == 0 || name_len > UINT8_MAX || offset > *used || *used + size > capacity) return -1;
+
+    char *base = area;
+    memmove(base + offset + size, base + offset, *used - offset);
+
+    dir_record_t *rec = (dir_record_t *)(base + offset);
+    memset(rec, 0, size);
+    rec->inode_index = inode_index;
+    rec->rec_len = size;
+    rec->name_len = name_len;
+    rec->file_type = type;
+    memcpy(rec->name, name, name_len);
+
+    *used += size;
+    return 0;
+}
+
+/* Remove o registro em offset, compactando a área (o fim volta a ser zerado) */
+void dirRecordRemove(void *area, size_t *used, size_t offset) {
+    char *base = area;
+    size_t size = ((const dir_record_t *)(base + offset))->rec_len;
+
+    memmove(base + offset, base + offset + size, *used - offset - size);
+    *used -= size;
+    memset(base + *used, 0, size);
+}
+
+static int isBtreeDir(int dir_inode) {
+    return (inode_table[dir_inode].flags & INODE_FLAG_DIR_BTREE) != 0;
+}
+
+/* ---- formato linear: até DIR_LINEAR_MAX_BLOCKS blocos de registros no próprio inode ---- */
+static int linearFind(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
+    inode_t *dir = &inode_table[dir_inode];
+    dir_block_t buffer;
+
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] == 0) continue;
+        if (readBlock(dir->blocks[i], &buffer) != 0) return -1;
+
+        size_t offset = 0;
+        const dir_record_t *rec;
+        while ((rec = dirRecordAt(buffer.raw, BLOCK_SIZE, offset)) != NULL) {
+            if (dirRecordMatches(rec, name, type)) {
+                *out_inode = rec->inode_index;
+                return 0;
             }
-            free(buffer);
+            offset += rec->rec_len;
         }
-        if (dir->next_inode == 0)
-            break;
-
-        current_inode = dir->next_inode;
     }
-
     return -1;
 }
 
-/* Adiciona elemento a um diretorio */
-int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_index) {
-    if (dir_inode < 0 || dir_inode >= MAX_INODES || !name)
-        return -1;
+/* Dica por diretório: slot + 1 de um bloco linear onde cabe qualquer nome (0 = desconhecida).
+   Fica só em memória; a próxima varredura completa a reconstrói */
+static uint8_t dir_free_hint[MAX_INODES];
 
-    // evita duplicados
-    int found;
-    if (dirFindEntry(dir_inode, name, type, &found) == 0)
-        return -1;
+/* Acrescenta o registro ao fim do bloco e atualiza a dica. Retorna 1 se não cabe */
+static int linearInsertInBlock(int dir_inode, int slot, dir_block_t *buffer, size_t used,
+                               const char *name, int inode_index) {
+    inode_type_t type = inode_table[inode_index].type;
+    if (dirRecordInsert(buffer->raw, BLOCK_SIZE, &used, used, name, inode_index, type) != 0) return 1;
 
-    int current_inode = dir_inode;
+    dir_free_hint[dir_inode] = BLOCK_SIZE - used >= DIR_RECORD_SIZE(MAX_NAMESIZE - 1) ? slot + 1 : 0;
+    return writeBlock(inode_table[dir_inode].blocks[slot], buffer);
+}
 
-    while (current_inode >= 0) {
-        inode_t *dir = &inode_table[current_inode];
-        if (dir->type != FILE_DIRECTORY)
-            return -1;
+/* Procura o nome e um bloco com espaço na mesma passada. Retorna 1 (e o inode existente em
+   *out_inode) se o nome já existe, 0 se a entrada foi criada. Com known_absent (cache negativo)
+   a busca por duplicados é dispensada e a dica de espaço livre é tentada antes de qualquer varredura */
+static int linearLookupOrAdd(int dir_inode, const char *name, inode_type_t type, int inode_index,
+                             int known_absent, int *out_inode) {
+    inode_t *dir = &inode_table[dir_inode];
+    dir_block_t buffer, free_block;
+    size_t need = DIR_RECORD_SIZE(strlen(name)), free_used = 0;
+    int used_blocks = 0, empty_slot = -1, free_slot = -1;
+
+    int hint = dir_free_hint[dir_inode] - 1;
+    if (known_absent && hint >= 0 && dir->blocks[hint] != 0) {
+        if (readBlock(dir->blocks[hint], &buffer) != 0) return -1;
+        int res = linearInsertInBlock(dir_inode, hint, &buffer, dirRecordsUsed(buffer.raw, BLOCK_SIZE),
+                                      name, inode_index);
+        if (res <= 0) {
+            *out_inode = inode_index;
+            return res;
+        }
+    }
 
-        // aloca buffers no heap
-        dir_entry_t *buffer = malloc(BLOCK_SIZE);
-        dir_entry_t *empty = malloc(BLOCK_SIZE);
-        if (!buffer || !empty) {
-            free(buffer);
-            free(empty);
-            return -1;
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] == 0) {
+            if (empty_slot < 0) empty_slot = i;
+            continue;
         }
-        memset(empty, 0, BLOCK_SIZE);
-
-        // tenta colocar em todos os blocos existentes
-        for (int i = 2; i < BLOCKS_PER_INODE; i++) {
-            if (dir->blocks[i] == 0) {
-                // se bloco não existe, aloca
-                int new_block = allocateBlock();
-                if (new_block < 0) {
-                    free(buffer);
-                    free(empty);
-                    return -1;
-                }
-                dir->blocks[i] = new_block;
-                if (writeBlock(new_block, empty) != 0) {
-                    free(buffer);
-                    free(empty);
-                    return -1;
-                }
+        used_blocks++;
+        if (readBlock(dir->blocks[i], &buffer) != 0) return -1;
+
+        size_t offset = 0;
+        const dir_record_t *rec;
+        while ((rec = dirRecordAt(buffer.raw, BLOCK_SIZE, offset)) != NULL) {
+            if (!known_absent && dirRecordMatches(rec, name, type)) {
+                *out_inode = rec->inode_index;
+                return 1;
             }
+            offset += rec->rec_len;
+        }
+        if (free_slot < 0 && offset + need <= BLOCK_SIZE) {
+            free_slot = i;
+            free_used = offset;
+            free_block = buffer;
+            if (known_absent) break;
+        }
+    }
 
-            if (readBlock(dir->blocks[i], buffer) != 0) {
-                free(buffer);
-                free(empty);
-                return -1;
-            }
+    *out_inode = inode_index;
+    if (free_slot >= 0)
+        return linearInsertInBlock(dir_inode, free_slot, &free_block, free_used, name, inode_index) == 0 ? 0 : -1;
 
-            for (int j = 0; j < BLOCK_SIZE / sizeof(dir_entry_t); j++) {
-                if (buffer[j].inode_index == 0) {
-                    strncpy(buffer[j].name, name, sizeof(buffer[j].name) - 1);
-                    buffer[j].name[sizeof(buffer[j].name) - 1] = '\0';
-                    buffer[j].inode_index = inode_index;
+    // sem espaço: diretórios grandes passam a usar a árvore B+
+    if (used_blocks >= DIR_LINEAR_MAX_BLOCKS || empty_slot < 0) {
+        dir_free_hint[dir_inode] = 0;
+        if (btreeConvert(dir_inode) != 0) return -1;
+        return btreeAdd(dir_inode, name, inode_index);
+    }
 
-                    if (writeBlock(dir->blocks[i], buffer) != 0) {
-                        free(buffer);
-                        free(empty);
-                        return -1;
-                    }
+    int new_block = allocateBlock(inodeGroup(dir_inode));
+    if (new_block < 0) return -1;
+    memset(&buffer, 0, sizeof(buffer));
+    size_t used = 0;
+    dirRecordInsert(buffer.raw, BLOCK_SIZE, &used, 0, name, inode_index, inode_table[inode_index].type);
+    if (writeBlock(new_block, &buffer) != 0) {
+        freeBlock(new_block);
+        return -1;
+    }
+    dir->blocks[empty_slot] = new_block;
+    dir_free_hint[dir_inode] = empty_slot + 1;
+    return 0;
+}
 
-                    dir->size += sizeof(dir_entry_t);
-                    dir->modification_date = time(NULL);
+static int linearRemove(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
+    inode_t *dir = &inode_table[dir_inode];
+    dir_block_t buffer;
 
-                    free(buffer);
-                    free(empty);
-                    return 0;
-                }
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] == 0) continue;
+        if (readBlock(dir->blocks[i], &buffer) != 0) return -1;
+
+        size_t offset = 0;
+        const dir_record_t *rec;
+        while ((rec = dirRecordAt(buffer.raw, BLOCK_SIZE, offset)) != NULL) {
+            if (dirRecordMatches(rec, name, type)) {
+                *out_inode = rec->inode_index;
+                size_t used = dirRecordsUsed(buffer.raw, BLOCK_SIZE);
+                dirRecordRemove(buffer.raw, &used, offset);
+                if (BLOCK_SIZE - used >= DIR_RECORD_SIZE(MAX_NAMESIZE - 1)) dir_free_hint[dir_inode] = i + 1;
+                return writeBlock(dir->blocks[i], &buffer);
             }
+            offset += rec->rec_len;
         }
+    }
+    return -1;
+}
 
-        // todos os blocos do inode cheio → cria next_inode
-        if (dir->next_inode == 0) {
-            int next = allocateInode();
-            if (next < 0) {
-                free(buffer);
-                free(empty);
-                return -1;
+/* Aponta a entrada existente para outro inode, regravando só o bloco dela */
+static int linearSetInode(int dir_inode, const char *name, inode_type_t type, int inode_index) {
+    inode_t *dir = &inode_table[dir_inode];
+    dir_block_t buffer;
+
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] == 0) continue;
+        if (readBlock(dir->blocks[i], &buffer) != 0) return -1;
+
+        size_t offset = 0;
+        const dir_record_t *rec;
+        while ((rec = dirRecordAt(buffer.raw, BLOCK_SIZE, offset)) != NULL) {
+            if (dirRecordMatches(rec, name, type)) {
+                dir_record_t *target = (dir_record_t *)(buffer.raw + offset);
+                target->inode_index = inode_index;
+                target->file_type = inode_table[inode_index].type;
+                return writeBlock(dir->blocks[i], &buffer);
             }
+            offset += rec->rec_len;
+        }
+    }
+    return -1;
+}
 
-            inode_t *next_inode = &inode_table[next];
-            memset(next_inode, 0, sizeof(inode_t));
-            next_inode->type = FILE_DIRECTORY;
+static int linearForEach(int dir_inode, dir_visit_fn visit, void *ctx) {
+    inode_t *dir = &inode_table[dir_inode];
+    dir_block_t buffer;
+    dir_entry_t entry;
 
-            int new_block = allocateBlock();
-            if (new_block < 0) {
-                free(buffer);
-                free(empty);
-                return -1;
-            }
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] == 0) continue;
+        if (readBlock(dir->blocks[i], &buffer) != 0) return -1;
+
+        size_t offset = 0;
+        const dir_record_t *rec;
+        while ((rec = dirRecordAt(buffer.raw, BLOCK_SIZE, offset)) != NULL) {
+            dirRecordToEntry(rec, &entry);
+            int res = visit(&entry, ctx);
+            if (res != 0) return res;
+            offset += rec->rec_len;
+        }
+    }
+    return 0;
+}
 
-            next_inode->blocks[0] = new_block;
-            if (writeBlock(new_block, empty) != 0) {
-                free(buffer);
-                free(empty);
-                return -1;
-            }
+static int compareEntryNames(const void *a, const void *b) {
+    return strcmp(((const dir_entry_t *)a)->name, ((const dir_entry_t *)b)->name);
+}
 
-            dir->next_inode = next;
+/* Diretório linear é pequeno: junta as entradas com o prefixo e ordena antes de visitar */
+static int linearForEachPrefix(int dir_inode, const char *prefix, dir_visit_fn visit, void *ctx) {
+    inode_t *dir = &inode_table[dir_inode];
+    dir_entry_t matches[DIR_LINEAR_MAX_BLOCKS * DIR_MAX_RECORDS_PER_BLOCK];
+    dir_block_t buffer;
+    size_t len = strlen(prefix), count = 0;
+
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] == 0) continue;
+        if (readBlock(dir->blocks[i], &buffer) != 0) return -1;
+
+        size_t offset = 0;
+        const dir_record_t *rec;
+        while ((rec = dirRecordAt(buffer.raw, BLOCK_SIZE, offset)) != NULL) {
+            offset += rec->rec_len;
+            if (rec->name_len < len || memcmp(rec->name, prefix, len) != 0) continue;
+            if (count == sizeof(matches) / sizeof(matches[0])) return -1;
+            dirRecordToEntry(rec, &matches[count++]);
         }
+    }
 
-        free(buffer);
-        free(empty);
-        current_inode = dir->next_inode;
+    qsort(matches, count, sizeof(dir_entry_t), compareEntryNames);
+    for (size_t k = 0; k < count; k++) {
+        int res = visit(&matches[k], ctx);
+        if (res != 0) return res;
     }
+    return 0;
+}
 
-    return -1;
+/* ---- versões internas: supõem a trava do diretório já tomada ---- */
+static int dirFindLocked(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
+    if (inode_table[dir_inode].type != FILE_DIRECTORY) return -1;
+
+    // o cache responde sem ler o disco; se o tipo não bate, pode existir outra entrada com o nome
+    int cached;
+    dcache_result_t hit = dcacheLookup(dir_inode, name, &cached);
+    if (hit == DCACHE_NEGATIVE) return -1;
+    if (hit == DCACHE_HIT && typeCompatible(inode_table[cached].type, type)) {
+        *out_inode = cached;
+        return 0;
+    }
+
+    int res = isBtreeDir(dir_inode) ? btreeFind(dir_inode, name, type, out_inode)
+                                      : linearFind(dir_inode, name, type, out_inode);
+    if (res == 0)
+        dcacheInsert(dir_inode, name, *out_inode);
+    else if (type == FILE_ANY || type == FILE_SYMLINK)
+        dcacheInsertNegative(dir_inode, name);   // busca sem filtro de tipo: o nome não existe
+    return res;
 }
 
-/* Remove elemento de um diretorio */
-int dirRemoveEntry(int dir_inode, const char *name, inode_type_t type) {
-    if (dir_inode < 0 || dir_inode >= MAX_INODES || !name)
+static int dirLookupOrAddLocked(int dir_inode, const char *name, inode_type_t type, int inode_index,
+                                int *out_inode) {
+    if (inode_table[dir_inode].type != FILE_DIRECTORY)
         return -1;
 
-    UNREFERENCED(type);
-    int current_inode = dir_inode;
+    int cached;
+    dcache_result_t hit = dcacheLookup(dir_inode, name, &cached);
+    if (hit == DCACHE_HIT && typeCompatible(inode_table[cached].type, type)) {
+        *out_inode = cached;
+        return 1;
+    }
 
-    while (current_inode >= 0) {
-        inode_t *dir = &inode_table[current_inode];
-        if (dir->type != FILE_DIRECTORY)
-            return -1;
+    int res = isBtreeDir(dir_inode)
+        ? btreeLookupOrAdd(dir_inode, name, type, inode_index, out_inode)
+        : linearLookupOrAdd(dir_inode, name, type, inode_index, hit == DCACHE_NEGATIVE, out_inode);
+    if (res < 0) return -1;
+    dcacheInsert(dir_inode, name, *out_inode);
+    if (res == 1) return 1;
 
-        // buffer dinâmico
-        dir_entry_t *buffer = malloc(BLOCK_SIZE);
-        if (!buffer)
-            return -1;
+    inode_table[dir_inode].size += DIR_RECORD_SIZE(strlen(name));
+    inode_table[dir_inode].modification_date = time(NULL);
+    return 0;
+}
 
-        for (int i = 0; i < BLOCKS_PER_INODE; i++) {
-            uint32_t block_index = dir->blocks[i];
-            if (block_index == 0)
-                continue;
+static int dirUnlinkLocked(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
+    if (inode_table[dir_inode].type != FILE_DIRECTORY)
+        return -1;
 
-            if (readBlock(block_index, buffer) != 0) {
-                free(buffer);
-                return -1;
-            }
+    int res = isBtreeDir(dir_inode) ? btreeRemove(dir_inode, name, type, out_inode)
+                                      : linearRemove(dir_inode, name, type, out_inode);
+    if (res != 0) return -1;
+    dcacheInvalidate(dir_inode, name);
+
+    inode_table[dir_inode].size -= DIR_RECORD_SIZE(strlen(name));
+    inode_table[dir_inode].modification_date = time(NULL);
+    return 0;
+}
+
+static int dirSetEntryInodeLocked(int dir_inode, const char *name, inode_type_t type, int inode_index) {
+    if (inode_table[dir_inode].type != FILE_DIRECTORY)
+        return -1;
+
+    int res = isBtreeDir(dir_inode) ? btreeSetInode(dir_inode, name, type, inode_index)
+                                      : linearSetInode(dir_inode, name, type, inode_index);
+    if (res != 0) return -1;
+    dcacheInsert(dir_inode, name, inode_index);
+    return 0;
+}
+
+static int dirForEachLocked(int dir_inode, dir_visit_fn visit, void *ctx) {
+    if (inode_table[dir_inode].type != FILE_DIRECTORY) return -1;
+
+    if (isBtreeDir(dir_inode))
+        return btreeForEach(dir_inode, visit, ctx);
+    return linearForEach(dir_inode, visit, ctx);
+}
+
+/* ---- interface: pegam a trava do diretório (leitura para buscas, escrita para alterações) ---- */
+/* Tenta encontrar elemento em um diretório */
+int dirFindEntry(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES || !name || !out_inode) 
+        return -1;
+
+    if (strlen(name) >= MAX_NAMESIZE) {
+        // nome maior que o aceito pelo resto do sistema (inode_t.name, cache)
+        return -1;
+    }
+
+    // o cache é atualizado ainda com a trava: uma entrada negativa nunca sobrevive a uma inserção
+    if (lockLiveDir(dir_inode, 0) != 0) return -1;
+    int res = dirFindLocked(dir_inode, name, type, out_inode);
+    inodeUnlock(dir_inode);
+    return res;
+}
+
+/* Busca o nome e, se não existir, cria a entrada, tudo em uma única passada pelo diretório.
+   Retorna 0 se a entrada foi criada, 1 se o nome já existia (inode existente em *out_inode) */
+int dirLookupOrAdd(int dir_inode, const char *name, inode_type_t type, int inode_index, int *out_inode) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES || !name || name[0] == '\0' || !out_inode)
+        return -1;
+    if (strlen(name) >= MAX_NAMESIZE)
+        return -1;
+
+    if (lockLiveDir(dir_inode, 1) != 0) return -1;
+    int res = dirLookupOrAddLocked(dir_inode, name, type, inode_index, out_inode);
+    inodeUnlock(dir_inode);
+    return res;
+}
+
+/* Adiciona elemento a um diretorio (falha se o nome já existe) */
+int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_index) {
+    int existing;
+    return dirLookupOrAdd(dir_inode, name, type, inode_index, &existing) == 0 ? 0 : -1;
+}
 
-            for (int j = 0; j < BLOCK_SIZE / sizeof(dir_entry_t); j++) {
-                if (buffer[j].inode_index != 0 && strcmp(buffer[j].name, name) == 0) {
-                    int target_inode = buffer[j].inode_index;
-
-                    // limpa entrada
-                    buffer[j].inode_index = 0;
-                    buffer[j].name[0] = '\0';
-
-                    if (writeBlock(block_index, buffer) != 0) {
-                        free(buffer);
-                        return -1;
-                    }
-
-                    // limpa dados do inode alvo
-                    inode_t *target = &inode_table[target_inode];
-                    for (int k = 0; k < BLOCKS_PER_INODE; k++) {
-                        if (target->blocks[k] != 0) {
-                            freeBlock(target->blocks[k]);
-                            target->blocks[k] = 0;
-                        }
-                    }
-                    freeInode(target_inode);
-
-                    inode_table[dir_inode].size -= sizeof(dir_entry_t);
-                    inode_table[dir_inode].modification_date = time(NULL);
-
-                    free(buffer);
-                    return 0;
+/* ---- inserção em lote ---- */
+/* Lê os blocos lineares uma vez, põe cada entrada no primeiro bloco com espaço e grava cada
+   bloco alterado uma única vez. Retorna quantas entradas foram tratadas (as seguintes não cabem
+   no formato linear), -1 em erro */
+static int linearAddEntries(int dir_inode, dir_entry_t *entries, int count, int *results) {
+    inode_t *dir = &inode_table[dir_inode];
+    dir_block_t blocks[BLOCKS_PER_INODE];
+    size_t used[BLOCKS_PER_INODE] = {0};
+    int present[BLOCKS_PER_INODE] = {0}, dirty[BLOCKS_PER_INODE] = {0};
+    int used_blocks = 0;
+
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (dir->blocks[i] == 0) continue;
+        if (readBlock(dir->blocks[i], &blocks[i]) != 0) return -1;
+        used[i] = dirRecordsUsed(blocks[i].raw, BLOCK_SIZE);
+        present[i] = 1;
+        used_blocks++;
+    }
+
+    int k;
+    for (k = 0; k < count; k++) {
+        dir_entry_t *entry = &entries[k];
+        const dir_record_t *match = NULL;
+        for (int i = 0; i < BLOCKS_PER_INODE && !match; i++) {
+            if (!present[i]) continue;
+            size_t offset = 0;
+            const dir_record_t *rec;
+            while ((rec = dirRecordAt(blocks[i].raw, BLOCK_SIZE, offset)) != NULL) {
+                if (dirRecordMatches(rec, entry->name, entry->type)) {
+                    match = rec;
+                    break;
                 }
+                offset += rec->rec_len;
             }
         }
+        if (match) {
+            entry->inode_index = match->inode_index;
+            results[k] = 1;
+            continue;
+        }
+
+        inode_type_t type = inode_table[entry->inode_index].type;
+        int slot = -1;
+        for (int i = 0; i < BLOCKS_PER_INODE && slot < 0; i++)
+            if (present[i] && dirRecordInsert(blocks[i].raw, BLOCK_SIZE, &used[i], used[i],
+                                              entry->name, entry->inode_index, type) == 0)
+                slot = i;
+
+        // bloco novo (ainda só em memória) enquanto o formato linear comportar
+        for (int i = 0; i < BLOCKS_PER_INODE && slot < 0 && used_blocks < DIR_LINEAR_MAX_BLOCKS; i++) {
+            if (present[i]) continue;
+            memset(&blocks[i], 0, sizeof(blocks[i]));
+            present[i] = 1;
+            used_blocks++;
+            dirRecordInsert(blocks[i].raw, BLOCK_SIZE, &used[i], 0, entry->name, entry->inode_index, type);
+            slot = i;
+        }
+        if (slot < 0) break;
 
-        free(buffer);
-        current_inode = dir->next_inode;
+        dirty[slot] = 1;
+        results[k] = 0;
     }
 
-    return -1;
+    int hint = 0;
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (!dirty[i]) continue;
+        if (dir->blocks[i] == 0) {
+            int block = allocateBlock(inodeGroup(dir_inode));
+            if (block < 0) return -1;
+            dir->blocks[i] = block;
+        }
+        if (writeBlock(dir->blocks[i], &blocks[i]) != 0) return -1;
+    }
+    for (int i = 0; i < BLOCKS_PER_INODE && !hint; i++)
+        if (dir->blocks[i] != 0 && BLOCK_SIZE - used[i] >= DIR_RECORD_SIZE(MAX_NAMESIZE - 1))
+            hint = i + 1;
+    dir_free_hint[dir_inode] = hint;
+    return k;
+}
+
+/* Adiciona várias entradas, já ordenadas por nome, numa só passada pelo diretório.
+   results[k]: 0 adicionada, 1 o nome já existia (inode existente em entries[k].inode_index),
+   -1 não processada por causa de um erro. Retorna 0, -1 em erro */
+static int dirAddEntriesLocked(int dir_inode, dir_entry_t *entries, int count, int *results) {
+    if (inode_table[dir_inode].type != FILE_DIRECTORY) return -1;
+
+    int res = 0, done = 0;
+    if (!isBtreeDir(dir_inode)) {
+        done = linearAddEntries(dir_inode, entries, count, results);
+        if (done < 0) {
+            for (int k = 0; k < count; k++) results[k] = -1;
+            res = -1;
+        }
+        else if (done < count) {
+            dir_free_hint[dir_inode] = 0;
+            if (btreeConvert(dir_inode) != 0) res = -1;
+        }
+    }
+    if (res == 0 && done < count)
+        res = btreeAddEntries(dir_inode, entries + done, count - done, results + done);
+
+    // o que entrou antes de um erro continua contado
+    for (int k = 0; k < count; k++) {
+        if (results[k] < 0) continue;
+        dcacheInsert(dir_inode, entries[k].name, entries[k].inode_index);
+        if (results[k] == 0) inode_table[dir_inode].size += DIR_RECORD_SIZE(strlen(entries[k].name));
+    }
+    inode_table[dir_inode].modification_date = time(NULL);
+    return res;
+}
+
+int dirAddEntries(int dir_inode, dir_entry_t *entries, int count, int *results) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES || !entries || !results || count < 0) return -1;
+    for (int k = 0; k < count; k++) {
+        if (entries[k].name[0] == '\0' || strlen(entries[k].name) >= MAX_NAMESIZE) return -1;
+        results[k] = -1;
+    }
+
+    if (lockLiveDir(dir_inode, 1) != 0) return -1;
+    int res = dirAddEntriesLocked(dir_inode, entries, count, results);
+    inodeUnlock(dir_inode);
+    return res;
+}
+
+/* Tira a entrada do diretório sem liberar o inode alvo (devolvido em *out_inode) */
+int dirUnlinkEntry(int dir_inode, const char *name, inode_type_t type, int *out_inode) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES || !name || !out_inode)
+        return -1;
+
+    if (lockLiveDir(dir_inode, 1) != 0) return -1;
+    int res = dirUnlinkLocked(dir_inode, name, type, out_inode);
+    inodeUnlock(dir_inode);
+    return res;
+}
+
+/* Remove elemento de um diretorio; os blocos do alvo são liberados depois (orphan.h) */
+int dirRemoveEntry(int dir_inode, const char *name, inode_type_t type) {
+    int target_inode;
+    if (dirUnlinkEntry(dir_inode, name, type, &target_inode) != 0) return -1;
+
+    inodeLockWrite(target_inode);
+    orphanAdd(target_inode);
+    inodeUnlock(target_inode);
+    return 0;
+}
+
+/* Troca o inode para o qual uma entrada existente aponta (usado no ".." de um diretório movido) */
+int dirSetEntryInode(int dir_inode, const char *name, inode_type_t type, int inode_index) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES || !name || inode_index < 0 || inode_index >= MAX_INODES)
+        return -1;
+
+    if (lockLiveDir(dir_inode, 1) != 0) return -1;
+    int res = dirSetEntryInodeLocked(dir_inode, name, type, inode_index);
+    inodeUnlock(dir_inode);
+    return res;
+}
+
+/* Visita todas as entradas ocupadas de um diretório. Retorna o valor != 0 do visitante
+   que interrompeu a iteração, -1 em erro de leitura. O visitante roda com a trava de leitura
+   do diretório e não pode alterá-lo */
+int dirForEach(int dir_inode, dir_visit_fn visit, void *ctx) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES || !visit) return -1;
+
+    if (lockLiveDir(dir_inode, 0) != 0) return -1;
+    int res = dirForEachLocked(dir_inode, visit, ctx);
+    inodeUnlock(dir_inode);
+    return res;
+}
+
+/* Como dirForEach, mas em ordem de nome e só com as entradas que começam com prefix ("" = todas) */
+int dirForEachPrefix(int dir_inode, const char *prefix, dir_visit_fn visit, void *ctx) {
+    if (dir_inode < 0 || dir_inode >= MAX_INODES || !prefix || !visit) return -1;
+
+    if (lockLiveDir(dir_inode, 0) != 0) return -1;
+    int res = isBtreeDir(dir_inode) ? btreeForEachPrefix(dir_inode, prefix, visit, ctx)
+                                    : linearForEachPrefix(dir_inode, prefix, visit, ctx);
+    inodeUnlock(dir_inode);
+    return res;
+}
+
+/* ---- leitura em lotes ---- */
+static int collectEntry(const dir_entry_t *entry, void *ctx) {
+    dir_iter_t *it = ctx;
+    it->sorted[it->sorted_count++] = *entry;
+    return 0;
+}
+
+/* Prepara a leitura das entradas que começam com prefix ("" = todas). O iterador segura a
+   trava de leitura do diretório até dirIterClose, então quem o abriu não pode alterar o mesmo
+   diretório antes de fechá-lo */
+int dirIterOpen(dir_iter_t *it, int dir_inode, const char *prefix) {
+    if (!it || dir_inode < 0 || dir_inode >= MAX_INODES || !prefix) return -1;
+
+    memset(it, 0, sizeof(*it));
+    it->dir_inode = dir_inode;
+    if (lockLiveDir(dir_inode, 0) != 0) return -1;
+    it->locked = 1;
+
+    // nenhum nome é maior que MAX_NAMESIZE - 1
+    it->prefix_len = strlen(prefix);
+    if (it->prefix_len >= MAX_NAMESIZE) {
+        it->done = 1;
+        return 0;
+    }
+    strcpy(it->prefix, prefix);
+
+    if (isBtreeDir(dir_inode)) {
+        if (btreeIterOpen(it) == 0) return 0;
+        dirIterClose(it);
+        return -1;
+    }
+
+    // diretório linear é pequeno: lê tudo agora, já ordenado
+    it->sorted = malloc(DIR_LINEAR_MAX_BLOCKS * DIR_MAX_RECORDS_PER_BLOCK * sizeof(dir_entry_t));
+    if (!it->sorted || linearForEachPrefix(dir_inode, prefix, collectEntry, it) != 0) {
+        dirIterClose(it);
+        return -1;
+    }
+    return 0;
+}
+
+/* Preenche batch->entries (espaço para DIR_ITER_BATCH entradas) com o próximo lote.
+   Retorna batch->count, 0 no fim, -1 em erro */
+int dirIterNext(dir_iter_t *it, fs_dir_list_t *batch) {
+    if (!it || !batch || !batch->entries) return -1;
+    batch->count = 0;
+
+    dir_entry_t names[DIR_ITER_BATCH];
+    int n = 0;
+    if (it->window) {
+        n = btreeIterRead(it, names, DIR_ITER_BATCH);
+        if (n < 0) return -1;
+    } else {
+        while (n < DIR_ITER_BATCH && it->sorted_pos < it->sorted_count)
+            names[n++] = it->sorted[it->sorted_pos++];
+    }
+
+    // os inodes de um lote ficam espalhados pela tabela: adianta todos antes de copiar
+    for (int i = 0; i < n; i++) {
+        if (names[i].inode_index >= MAX_INODES) return -1;
+        __builtin_prefetch(&inode_table[names[i].inode_index]);
+    }
+
+    for (int i = 0; i < n; i++) {
+        const inode_t *inode = &inode_table[names[i].inode_index];
+        fs_entry_t *out = &batch->entries[i];
+
+        strcpy(out->name, names[i].name);
+        out->type = names[i].type;
+        out->creator_uid = inode->creator_uid;
+        out->owner_uid = inode->owner_uid;
+        out->size = inode->size;
+        out->creation_date = inode->creation_date;
+        out->modification_date = inode->modification_date;
+        out->permissions = inode->permissions;
+        out->inode_index = names[i].inode_index;
+        out->link_target_index = inode->link_target_index;
+    }
+    batch->count = n;
+    return n;
+}
+
+void dirIterClose(dir_iter_t *it) {
+    if (!it) return;
+    free(it->sorted);
+    free(it->window);
+    it->sorted = NULL;
+    it->window = NULL;
+    it->done = 1;
+    if (it->locked) {
+        inodeUnlock(it->dir_inode);
+        it->locked = 0;
+    }
 }
 
 /* Verifica permissoes */
@@ -243,50 +756,117 @@ int hasPermission(const inode_t *inode, int user_id, permission_t perm) {
     return (mode & perm) != 0;   // booleano
 }
 
-/* Cria diretorio */
+/* chmod: só o dono (ou root) muda as permissões. O dono é conferido com a trava, no mesmo inode
+   que será alterado. Retorna 0, -1 se o inode já não existe ou -2 se quem pede não é o dono */
+int setInodePermissions(int inode_index, uint8_t permissions, int user_id) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
+
+    int res = -1;
+    inodeLockWrite(inode_index);
+    if (inodeInUse(inode_index)) {
+        inode_t *inode = &inode_table[inode_index];
+        if (inode->owner_uid != user_id && user_id != ROOT_UID) {
+            res = -2;
+        } else {
+            inode->permissions = permissions;
+            res = 0;
+        }
+    }
+    inodeUnlock(inode_index);
+
+    if (res == 0) sync_fs();
+    return res;
+}
+
+/* chown (quem chama confere que é root) */
+int setInodeOwner(int inode_index, int owner_uid) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
+
+    inodeLockWrite(inode_index);
+    int res = inodeInUse(inode_index) ? 0 : -1;
+    if (res == 0) inode_table[inode_index].owner_uid = owner_uid;
+    inodeUnlock(inode_index);
+
+    if (res == 0) sync_fs();
+    return res;
+}
+
+/* Campos de um inode recém-alocado (arquivo ou diretório vazio, rwx só para o dono) */
+static void initNewInode(inode_t *inode, inode_type_t type, const char *name, int user_id, time_t now) {
+    inode->type = type;
+    strncpy(inode->name, name, MAX_NAMESIZE-1);
+    inode->name[MAX_NAMESIZE-1] = '\0';
+    inode->creation_date = now;
+    inode->modification_date = now;
+    inode->size = 0;
+    inode->creator_uid = user_id;
+    inode->owner_uid = user_id;
+    inode->permissions = PERM_RWX << 3 | PERM_NONE;
+    inode->link_target_index = -1;
+}
+
+/* Cria diretorio. Retorna 0 se criou, 1 se já existia (inode em *output_inode, se informado) */
 int createDirectory(int parent_inode, const char *name, int user_id, int* output_inode){
     if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
-    int dummy_output;
-    if (dirFindEntry(parent_inode, name, FILE_DIRECTORY, &dummy_output) == 0) return -1;
 
-    inode_t *parent= &inode_table[parent_inode];
-
-    int new_inode_index = allocateInode();
+    int new_inode_index = allocateInode(groupForDirectory(parent_inode));
     if (new_inode_index < 0) return -1;
 
     inode_t *new_inode = &inode_table[new_inode_index];
+    initNewInode(new_inode, FILE_DIRECTORY, name, user_id, time(NULL));
 
-    time_t now = time(NULL);
-
-    new_inode->type = FILE_DIRECTORY;
-    strncpy(new_inode->name, name, MAX_NAMESIZE-1);
-    new_inode->name[MAX_NAMESIZE-1] = '\0';
-    new_inode->creation_date = now;
-    new_inode->modification_date = now;
-    new_inode->size = 0;
-    new_inode->creator_uid = user_id;
-    new_inode->owner_uid = user_id;
-    new_inode->permissions = PERM_RWX << 3 | PERM_NONE;
-    new_inode->link_target_index = -1;
-
-    int block = allocateBlock();
-    if (block < 0) return -1;
+    int block = allocateBlock(inodeGroup(new_inode_index));
+    if (block < 0) {
+        freeInode(new_inode_index);
+        return -1;
+    }
     new_inode->blocks[0] = block;
 
-    dir_entry_t entries[BLOCK_SIZE / sizeof(dir_entry_t)] = {0};
+    dir_block_t entries = {0};
+    size_t used = 0;
 
-    strncpy(entries[0].name, ".", sizeof(entries[0].name));
-    entries[0].inode_index = new_inode_index;
-    strncpy(entries[1].name, "..", sizeof(entries[1].name));
-    entries[1].inode_index = parent_inode;
+    dirRecordInsert(entries.raw, BLOCK_SIZE, &used, used, ".", new_inode_index, FILE_DIRECTORY);
+    dirRecordInsert(entries.raw, BLOCK_SIZE, &used, used, "..", parent_inode, FILE_DIRECTORY);
+    new_inode->size = used;
 
-    if (writeBlock(block, entries) != 0) return -1;
-    
-    if (dirAddEntry(parent_inode, name, FILE_DIRECTORY, new_inode_index) != 0) return -1;
+    // "." e ".." vão para o disco antes de o nome aparecer no pai (barreira no cache de escrita)
+    int existing, res = -1;
+    if (writeBlock(block, &entries) == 0) {
+        writebackBarrier();
+        res = dirLookupOrAdd(parent_inode, name, FILE_DIRECTORY, new_inode_index, &existing);
+    }
+    if (res != 0) {
+        freeInode(new_inode_index);
+        if (res == 1 && output_inode) *output_inode = existing;
+        return res;
+    }
+
+    if (output_inode) *output_inode = new_inode_index;
     sync_fs();
     return 0;
 }
 
+/* Segue links simbólicos (até 16) a partir de inode_index. Cada link é lido com a trava tomada e
+   conferido: num link apagado, link_target_index já é o elo da lista de órfãos. Retorna 0 com o
+   primeiro inode que não é link em *out, -1 se algum elo sumiu */
+static int followSymlinks(int inode_index, int *out) {
+    for (int depth = 0; depth <= 16; depth++) {
+        // sem trava para o que não é link: quem usar o inode confere com a trava dele
+        if (inode_table[inode_index].type != FILE_SYMLINK) {
+            *out = inode_index;
+            return 0;
+        }
+
+        inodeLockRead(inode_index);
+        int live = inodeInUse(inode_index) && inode_table[inode_index].type == FILE_SYMLINK;
+        int next = (int)inode_table[inode_index].link_target_index;
+        inodeUnlock(inode_index);
+        if (!live || next < 0 || next >= MAX_INODES) return -1;
+        inode_index = next;
+    }
+    return -1;  // evita loops
+}
+
 /* Cria diretorios recursivamente s*/
 int createDirectoriesRecursively(const char *path, int current_inode, int user_id) {
     if (!path) return -1;
@@ -323,130 +903,455 @@ int createDirectoriesRecursively(const char *path, int current_inode, int user_i
         }
 
         int next_inode;
-        // tentamos achar token no diretório atual (aceitamos FILE_DIRECTORY ou FILE_SYMLINK -> seguido)
-        if (dirFindEntry(cur, token, FILE_DIRECTORY, &next_inode) != 0) {
-            // não existe -> criar diretório aqui
-            if (createDirectory(cur, token, user_id, NULL) != 0) {
-                return -1;
-            }
-            // recuperar inode do diretório criado
-            if (dirFindEntry(cur, token, FILE_DIRECTORY, &next_inode) != 0) return -1;
+        // tentamos achar token no diretório atual (aceitamos FILE_DIRECTORY ou FILE_SYMLINK -> seguido);
+        // se não existir, cria o diretório aqui e já recebe o inode criado
+        if (dirFindEntry(cur, token, FILE_DIRECTORY, &next_inode) != 0 &&
+            createDirectory(cur, token, user_id, &next_inode) < 0) {
+            return -1;
         }
 
         // se for symlink, resolva link_target_index (resolvePath já faz isso, mas como estamos passo a passo:)
-        int depth = 0;
-        while (inode_table[next_inode].type == FILE_SYMLINK) {
-            next_inode = inode_table[next_inode].link_target_index;
-            if (++depth > 16) return -1;
-        }
-
-        cur = next_inode;
+        if (followSymlinks(next_inode, &cur) != 0) return -1;
     }
 
     return 0;
 }
 
-/* Deleta diretorio existente */
+/* Interrompe a iteração na primeira entrada que não seja "." ou ".." */
+static int visitNonDotEntry(const dir_entry_t *entry, void *ctx) {
+    UNREFERENCED(ctx);
+    return strcmp(entry->name, ".") != 0 && strcmp(entry->name, "..") != 0;
+}
+
+/* Deleta diretorio existente. Retorna 0, -1 em erro (ou diretório não vazio) ou
+   DIR_BUSY se ele é o diretório atual de alguma sessão */
 int deleteDirectory(int parent_inode, const char *name, int user_id){
     if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return -1;
+
+    int target_inode, unlinked, res = -1;
+    if (lockLiveDir(parent_inode, 1) != 0) return -1;
+    if (dirFindLocked(parent_inode, name, FILE_DIRECTORY, &target_inode) == 0) {
+        inodeLockWrite(target_inode);
+        pthread_mutex_lock(&cwd_lock);
+        // diretorio nao vazio (ou erro de leitura); a trava de escrita impede criações no meio
+        if (cwd_pins[target_inode] > 0) {
+            res = DIR_BUSY;
+        } else if (inode_table[target_inode].type == FILE_DIRECTORY &&
+                   dirForEachLocked(target_inode, visitNonDotEntry, NULL) == 0 &&
+                   dirUnlinkLocked(parent_inode, name, FILE_DIRECTORY, &unlinked) == 0) {
+            // vira órfão ainda com a trava: quem a esperava encontra um inode fora de uso
+            orphanAdd(target_inode);
+            res = 0;
+        }
+        pthread_mutex_unlock(&cwd_lock);
+        inodeUnlock(target_inode);
+    }
+    inodeUnlock(parent_inode);
+
+    if (res == 0) sync_fs();
+    return res;
+}
+
+/* ---- remoção recursiva ---- */
+typedef struct {
+    int *inodes;
+    int count;          // incrementado pelas threads do percurso
+    int user_id;
+} remove_tree_t;
+
+#define REMOVE_TREE_DENIED (-2)
+
+static int collectForRemoval(int parent_inode, const fs_entry_t *entry, const inode_t *inode,
+                             int depth, void *ctx) {
+    UNREFERENCED(inode); UNREFERENCED(depth);
+    remove_tree_t *rm = ctx;
+
+    // listar e apagar entradas exige R, W e X no diretório que as contém
+    const inode_t *parent = &inode_table[parent_inode];
+    if (rm->user_id != ROOT_UID && (!hasPermission(parent, rm->user_id, PERM_READ) ||
+                                    !hasPermission(parent, rm->user_id, PERM_WRITE) ||
+                                    !hasPermission(parent, rm->user_id, PERM_EXEC)))
+        return REMOVE_TREE_DENIED;
+
+    int slot = __atomic_fetch_add(&rm->count, 1, __ATOMIC_RELAXED);
+    if (slot >= MAX_INODES) return -1;
+    rm->inodes[slot] = entry->inode_index;
+    return 0;
+}
 
+/* Percorre a árvore do alvo e a solta do pai. Chamada com rename_lock e a trava de escrita do
+   pai, que segura as mudanças no topo; as threads do percurso pegam a de leitura de cada diretório.
+   Os inodes da árvore viram órfãos de uma vez e a thread de liberação solta os blocos depois */
+static int removeTreeLocked(int parent_inode, const char *name, remove_tree_t *rm) {
     int target_inode;
-    if (dirFindEntry(parent_inode, name, FILE_DIRECTORY, &target_inode) != 0) return -1;
+    if (dirFindLocked(parent_inode, name, FILE_ANY, &target_inode) != 0) return -1;
+    if (target_inode == ROOT_INODE) return -1;
+    inode_type_t type = inode_table[target_inode].type;
+    rm->inodes[rm->count++] = target_inode;
+
+    if (type == FILE_DIRECTORY) {
+        int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        int res = walkTree(target_inode, nthreads, collectForRemoval, rm, NULL);
+        if (res != 0) return res == REMOVE_TREE_DENIED ? REMOVE_TREE_DENIED : -1;
+    }
 
-    inode_t *target = &inode_table[target_inode];
-    if (target->type != FILE_DIRECTORY) return -1;
+    // o topo sai do pai e vira órfão com a própria trava, como em deleteFile
+    int unlinked, res = -1;
+    inodeLockWrite(target_inode);
+    pthread_mutex_lock(&cwd_lock);
+    if (anyPinnedLocked(rm->inodes, rm->count)) {
+        res = DIR_BUSY;
+    } else if (dirUnlinkLocked(parent_inode, name, type, &unlinked) == 0) {
+        orphanAddMany(rm->inodes, rm->count);
+        res = 0;
+    }
+    pthread_mutex_unlock(&cwd_lock);
+    inodeUnlock(target_inode);
+    return res;
+}
 
-    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
-        if (target->blocks[i] == 0) continue;
+/* Remove a entrada e, se for diretório, tudo abaixo dela. A árvore é percorrida antes de
+   qualquer mudança, então falta de permissão em qualquer ponto não apaga nada. Só a entrada
+   do topo sai do diretório pai: os diretórios de dentro são liberados inteiros, os inodes
+   vão em lote para a lista de órfãos e os metadados são gravados uma única vez.
+   Só os diretórios atuais das sessões são contados: se algum está na árvore nada é apagado,
+   mas quem estiver criando ou lendo dentro dela durante a remoção não é impedido, e o que for
+   criado ali no meio fica sem nome.
+   Retorna 0, -1 em erro, -2 se faltar permissão em algum diretório da árvore ou DIR_BUSY se
+   ela contém o diretório atual de alguma sessão */
+int removeTree(int parent_inode, const char *name, int user_id) {
+    if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return -1;
 
-        char *raw = malloc(BLOCK_SIZE);
-        if (!raw) return -1;
+    remove_tree_t rm = { malloc(MAX_INODES * sizeof(int)), 0, user_id };
+    if (!rm.inodes) return -1;
 
-        if (readBlock(target->blocks[i], raw) != 0) {
-            free(raw);
-            return -1;
-        }
-        dir_entry_t *entries = (dir_entry_t *) raw;
-        size_t num_entries = BLOCK_SIZE / sizeof(dir_entry_t);
-        if (!entries) return -1;
+    int res = -1;
+    pthread_mutex_lock(&rename_lock);
+    if (lockLiveDir(parent_inode, 1) == 0) {
+        res = removeTreeLocked(parent_inode, name, &rm);
+        inodeUnlock(parent_inode);
+    }
+    pthread_mutex_unlock(&rename_lock);
 
-        for (size_t j = 0; j < num_entries; j++) {
-            if (entries[j].inode_index != 0 &&
-                strcmp(entries[j].name, ".") != 0 &&
-                strcmp(entries[j].name, "..") != 0) {
-                    free(raw);
-                    return -1; // diretorio nao vazio
-            }
-        }
-        free(raw);
+    free(rm.inodes);
+    if (res == 0) sync_fs();
+    return res;
+}
+
+/* dir_inode está dentro da árvore de root_dir (ou é o próprio)? Sobe pelos ".." até a raiz */
+int isInSubtree(int root_dir, int dir_inode) {
+    for (int depth = 0; depth < MAX_INODES; depth++) {
+        if (dir_inode == root_dir) return 1;
+        if (dir_inode == ROOT_INODE) return 0;
+
+        int parent;
+        if (dirFindEntry(dir_inode, "..", FILE_DIRECTORY, &parent) != 0) return 1;   // na dúvida, recusa
+        dir_inode = parent;
     }
+    return 1;
+}
 
-    if (dirRemoveEntry(parent_inode, name, FILE_DIRECTORY) != 0) return -1;
-    freeInode(target_inode);
-    sync_fs();
-    return 0;
+/* Troca as entradas com as travas de escrita dos dois pais já tomadas. Trava ainda o inode
+   movido (nome e "..") e o arquivo substituído, que são filhos dos pais e nunca ancestrais */
+static int renameLocked(int src_parent, const char *src_name, int dst_parent, const char *dst_name,
+                        int src_inode) {
+    // os pais podem ter sido apagados antes de receberem a trava
+    if (!inodeInUse(src_parent) || !inodeInUse(dst_parent)) return -1;
+    if (inode_table[dst_parent].type != FILE_DIRECTORY) return -1;
+
+    // a entrada pode ter mudado antes de os pais serem travados
+    int found;
+    if (dirFindLocked(src_parent, src_name, FILE_ANY, &found) != 0 || found != src_inode) return -1;
+    inode_type_t type = inode_table[src_inode].type;
+    userdbInodeChanged(src_inode);
+    if (src_parent == dst_parent && strcmp(src_name, dst_name) == 0) return 0;
+
+    int replaced = -1;
+    if (dirFindLocked(dst_parent, dst_name, type, &replaced) == 0) {
+        if (replaced == src_inode) return 0;
+        if (type == FILE_DIRECTORY || inode_table[replaced].type == FILE_DIRECTORY) return -1;
+    } else {
+        replaced = -1;
+    }
 
+    int other = replaced >= 0 ? replaced : src_inode;
+    int res = -1, removed;
+    inodeLockPair(src_inode, other);
+
+    // o nome substituído passa a apontar para o inode movido num passo só e o antigo vira órfão
+    // logo depois: ele nunca fica sem nome e fora da lista de órfãos, nem em memória nem no disco
+    if (replaced >= 0) {
+        if (dirSetEntryInodeLocked(dst_parent, dst_name, type, src_inode) != 0) goto out;
+        orphanAdd(replaced);
+    } else if (dirLookupOrAddLocked(dst_parent, dst_name, type, src_inode, &found) != 0) {
+        goto out;
+    }
+    // só diretórios mudam o "..", e eles nunca substituem outra entrada
+    if (type == FILE_DIRECTORY && src_parent != dst_parent &&
+        dirSetEntryInodeLocked(src_inode, "..", FILE_DIRECTORY, dst_parent) != 0) goto out;
+    // a entrada nova chega ao disco antes de a antiga sair (renameEntry)
+    writebackBarrier();
+    if (dirUnlinkLocked(src_parent, src_name, type, &removed) != 0) {
+        // o arquivo substituído volta para o nome dele (a trava dele segura a thread de liberação)
+        if (replaced >= 0 && dirSetEntryInodeLocked(dst_parent, dst_name, type, replaced) == 0)
+            orphanCancel(replaced);
+        goto out;
+    }
+
+    strncpy(inode_table[src_inode].name, dst_name, MAX_NAMESIZE - 1);
+    inode_table[src_inode].name[MAX_NAMESIZE - 1] = '\0';
+    res = 0;
+out:
+    inodeUnlockPair(src_inode, other);
+    return res;
 }
 
-/* Cria arquivo */
-int createFile(int parent_inode, const char *name, int user_id){
-    if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
-    int dummy_output;
-    if (dirFindEntry(parent_inode, name, FILE_REGULAR, &dummy_output) == 0) return -1;
+/* Renomeia ou move uma entrada entre diretórios sem tocar nos dados, qualquer que seja o tamanho.
+   Um arquivo (ou link) de mesmo nome no destino é substituído; diretórios só vão para nomes livres
+   e nunca para dentro de si mesmos. A entrada nova é gravada antes de a antiga sair, então uma
+   queda no meio deixa no máximo dois nomes para o mesmo inode, nunca nenhum */
+int renameEntry(int src_parent, const char *src_name, int dst_parent, const char *dst_name) {
+    if (src_parent < 0 || src_parent >= MAX_INODES || dst_parent < 0 || dst_parent >= MAX_INODES) return -1;
+    if (!src_name || !dst_name || dst_name[0] == '\0' || strlen(dst_name) >= MAX_NAMESIZE) return -1;
+    if (strcmp(src_name, ".") == 0 || strcmp(src_name, "..") == 0) return -1;
+    if (strcmp(dst_name, ".") == 0 || strcmp(dst_name, "..") == 0) return -1;
+
+    pthread_mutex_lock(&rename_lock);
+    // com rename_lock o parentesco dos diretórios não muda: as subidas por ".." (que pegam
+    // travas de leitura) são feitas antes de qualquer trava de escrita
+    int res = -1, src_inode;
+    if (dirFindEntry(src_parent, src_name, FILE_ANY, &src_inode) != 0 ||
+        (inode_table[src_inode].type == FILE_DIRECTORY && isInSubtree(src_inode, dst_parent))) {
+        pthread_mutex_unlock(&rename_lock);
+        return -1;
+    }
 
-    inode_t *parent= &inode_table[parent_inode];
+    // ancestral primeiro; pais sem parentesco na ordem dos índices
+    int first = src_parent, second = dst_parent;
+    if (src_parent != dst_parent &&
+        (isInSubtree(dst_parent, src_parent) || (!isInSubtree(src_parent, dst_parent) && dst_parent < src_parent))) {
+        first = dst_parent;
+        second = src_parent;
+    }
+    inodeLockWrite(first);
+    if (second != first) inodeLockWrite(second);
+    res = renameLocked(src_parent, src_name, dst_parent, dst_name, src_inode);
+    if (second != first) inodeUnlock(second);
+    inodeUnlock(first);
+    pthread_mutex_unlock(&rename_lock);
+
+    if (res == 0) sync_fs();
+    return res;
+}
 
-    int new_inode_index = allocateInode();
+/* Cria arquivo. Retorna 0 se criou, 1 se já existia (inode em *output_inode, se informado) */
+int createFile(int parent_inode, const char *name, int user_id, int *output_inode){
+    if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
+
+    int new_inode_index = allocateInode(inodeGroup(parent_inode));
     if (new_inode_index < 0) return -1;
     inode_t *new_inode = &inode_table[new_inode_index];
+    initNewInode(new_inode, FILE_REGULAR, name, user_id, time(NULL));
+
+    int existing;
+    int res = dirLookupOrAdd(parent_inode, name, FILE_REGULAR, new_inode_index, &existing);
+    if (res != 0) {
+        freeInode(new_inode_index);
+        if (res == 1 && output_inode) *output_inode = existing;
+        return res;
+    }
 
-    time_t now = time(NULL);
-
-    new_inode->type = FILE_REGULAR;
-    strncpy(new_inode->name, name, MAX_NAMESIZE-1);
-    new_inode->name[MAX_NAMESIZE-1] = '\0';
-    new_inode->creation_date = now;
-    new_inode->modification_date = now;
-    new_inode->size = 0;
-    new_inode->creator_uid = user_id;
-    new_inode->owner_uid = user_id;
-    new_inode->permissions = PERM_RWX << 3 | PERM_NONE;
-    new_inode->link_target_index = -1;
-
-    if (dirAddEntry(parent_inode, name, FILE_REGULAR, new_inode_index) != 0) return -1;
+    if (output_inode) *output_inode = new_inode_index;
     sync_fs();
     return 0;
 }
 
+/* ---- criação em lote ---- */
+static int compareRequestNames(const void *a, const void *b) {
+    const create_request_t *x = a, *y = b;
+    int res = strcmp(x->name, y->name);
+    return res != 0 ? res : (int)x->type - (int)y->type;
+}
+
+/* Grava os blocos "." e ".." dos diretórios novos, juntando blocos vizinhos numa só escrita */
+static int writeNewDirBlocks(const uint32_t *blocks, const dir_block_t *contents, int count) {
+    int start = 0;
+    while (start < count) {
+        int run = 1;
+        while (start + run < count && blocks[start + run] == blocks[start] + run &&
+               run < COPY_BATCH_BLOCKS)
+            run++;
+        if (writeBlocks(blocks[start], run, &contents[start]) != 0) return -1;
+        start += run;
+    }
+    return 0;
+}
+
+/* Cria vários arquivos e diretórios (reqs[k].type) no mesmo diretório: os inodes são reservados
+   juntos no grupo do pai (os diretórios também, para os blocos saírem contíguos), os blocos dos diretórios novos são gravados juntos e as entradas
+   entram no pai numa única passada. reqs é reordenado por nome; reqs[k].result recebe 0 (criado),
+   1 (já existia, inode em reqs[k].inode_index) ou -1. Quem chama faz o sync_fs.
+   Retorna 0, -1 se algo falhou */
+int createEntries(int parent_inode, create_request_t *reqs, int count, int user_id) {
+    if (parent_inode < 0 || parent_inode >= MAX_INODES || !reqs || count <= 0) return -1;
+    if (inode_table[parent_inode].type != FILE_DIRECTORY) return -1;
+
+    for (int k = 0; k < count; k++) {
+        reqs[k].result = -1;
+        reqs[k].inode_index = -1;
+    }
+    qsort(reqs, count, sizeof(create_request_t), compareRequestNames);
+
+    int *inodes = malloc(count * sizeof(int));
+    int *results = malloc(count * sizeof(int));
+    dir_entry_t *entries = malloc(count * sizeof(dir_entry_t));
+    uint32_t *dir_blocks = malloc(count * sizeof(uint32_t));
+    dir_block_t *dir_contents = malloc(count * sizeof(dir_block_t));
+    int res = -1, allocated = 0, dirs = 0;
+    if (!inodes || !results || !entries || !dir_blocks || !dir_contents) goto out;
+
+    allocated = allocateInodes(inodeGroup(parent_inode), inodes, count);
+    if (allocated < count) goto out;
+
+    time_t now = time(NULL);
+    for (int k = 0; k < count; k++) {
+        inode_t *inode = &inode_table[inodes[k]];
+        initNewInode(inode, reqs[k].type, reqs[k].name, reqs[k].owner_uid >= 0 ? reqs[k].owner_uid : user_id, now);
+
+        strcpy(entries[k].name, reqs[k].name);
+        entries[k].inode_index = inodes[k];
+        entries[k].type = reqs[k].type;
+        if (reqs[k].type != FILE_DIRECTORY) continue;
+
+        int block = allocateBlock(inodeGroup(inodes[k]));
+        if (block < 0) goto out;
+        inode->blocks[0] = block;
+
+        dir_block_t *content = &dir_contents[dirs];
+        size_t used = 0;
+        memset(content, 0, sizeof(*content));
+        dirRecordInsert(content->raw, BLOCK_SIZE, &used, used, ".", inodes[k], FILE_DIRECTORY);
+        dirRecordInsert(content->raw, BLOCK_SIZE, &used, used, "..", parent_inode, FILE_DIRECTORY);
+        inode->size = used;
+        dir_blocks[dirs++] = block;
+    }
+
+    // "." e ".." vão para o disco antes de os nomes aparecerem no pai
+    if (writeNewDirBlocks(dir_blocks, dir_contents, dirs) != 0) goto out;
+    if (dirs > 0) writebackBarrier();
+    res = dirAddEntries(parent_inode, entries, count, results);
+
+    for (int k = 0; k < count; k++) {
+        reqs[k].result = results[k];
+        if (results[k] == 0) reqs[k].inode_index = inodes[k];
+        else if (results[k] == 1) reqs[k].inode_index = entries[k].inode_index;
+    }
+
+out:
+    // inodes reservados que não entraram no diretório voltam (com seus blocos)
+    if (inodes) {
+        int kept = 0;
+        for (int k = 0; k < allocated; k++)
+            if (reqs[k].result != 0) inodes[kept++] = inodes[k];
+        freeInodes(inodes, kept);
+    }
+    free(inodes);
+    free(results);
+    free(entries);
+    free(dir_blocks);
+    free(dir_contents);
+    return res;
+}
+
+/* Tira a entrada de um arquivo (ou link) do pai e põe o inode na lista de órfãos, sem esperar
+   a liberação dos blocos. Chamada com a trava de escrita do pai; o alvo vira órfão com a própria
+   trava, então leitores e escritores que a esperavam encontram o inode fora de uso (inodeInUse)
+   em vez de blocos pela metade */
+static int unlinkAndOrphan(int parent_inode, const char *name, int target_inode) {
+    int unlinked, res = -1;
+    inodeLockWrite(target_inode);
+    inode_type_t type = inode_table[target_inode].type;
+    if ((type == FILE_REGULAR || type == FILE_SYMLINK) &&
+        dirUnlinkLocked(parent_inode, name, type, &unlinked) == 0) {
+        orphanAdd(target_inode);
+        res = 0;
+    }
+    inodeUnlock(target_inode);
+    return res;
+}
+
 /* Deleta arquivo */
 int deleteFile(int parent_inode, const char *name, int user_id){
     if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
-    int target_inode;
-    if (dirFindEntry(parent_inode, name, FILE_REGULAR, &target_inode) == -1) return -1;
 
-    inode_t *target = &inode_table[target_inode];
+    int target_inode, res = -1;
+    if (lockLiveDir(parent_inode, 1) != 0) return -1;
+    if (dirFindLocked(parent_inode, name, FILE_REGULAR, &target_inode) == 0)
+        res = unlinkAndOrphan(parent_inode, name, target_inode);
+    inodeUnlock(parent_inode);
 
-    if (target->type != FILE_REGULAR && target->type != FILE_SYMLINK) return -1;
+    if (res == 0) sync_fs();
+    return res;
+}
 
-    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
-        if (target->blocks[i] != 0)
-            freeBlock(target->blocks[i]);
-    }
+/* Escreve um bloco de dados de arquivo. Se o bloco é compartilhado com outro inode
+   (reflink), faz copy-on-write: grava em um bloco novo e solta a referência ao antigo */
+static int writeDataBlock(uint32_t *slot_block, const void *buffer) {
+    uint32_t block_num = *slot_block;
+    if (blockRefCount(block_num) <= 1) return writeBlock(block_num, buffer);
 
-    if (dirRemoveEntry(parent_inode, name, target->type) == -1) return -1;
-    freeInode(target_inode);
-    sync_fs();
+    int new_block = allocateBlock(blockGroup(block_num));
+    if (new_block < 0) return -1;
+    if (writeBlock(new_block, buffer) != 0) {
+        freeBlock(new_block);
+        return -1;
+    }
+    freeBlock(block_num);
+    *slot_block = new_block;
     return 0;
 }
 
-/* Adiciona conteudo a um inode */
-int addContentToInode(int inode_index, const char *data, size_t data_size, int user_id) {
-    if (!data) return -1;
-    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
+/* Grava um bloco de dados cheio com deduplicação inline: se já existe um bloco idêntico
+   o slot passa a referenciá-lo; senão o bloco é gravado (num slot vazio, com um bloco novo do
+   grupo indicado) e registrado no índice */
+static int writeFullDataBlock(uint32_t *slot_block, int group, const char *buffer) {
+    uint64_t hash = hashBlock(buffer);
+    uint32_t shared;
+
+    // a referência ao bloco compartilhado já vem tomada; se for o próprio slot, sobra uma
+    if (dedupShareBlock(buffer, hash, &shared) == 0) {
+        if (*slot_block != 0) freeBlock(*slot_block);
+        *slot_block = shared;
+        return 0;
+    }
 
+    if (*slot_block == 0) {
+        int new_block = allocateBlock(group);
+        if (new_block < 0) return -1;
+        *slot_block = new_block;
+    }
+    if (writeDataBlock(slot_block, buffer) != 0) return -1;
+    dedupInsert(hash, *slot_block);
+    return 0;
+}
+
+/* Acrescenta os dados ao fim do arquivo, com a trava de escrita já tomada */
+int addContentToInodeLocked(int inode_index, const char *data, size_t data_size) {
     inode_t *inode = &inode_table[inode_index];
+    // visões da base binária de usuários são somente leitura
+    if (inode->flags & INODE_FLAG_USERDB_VIEW) return -1;
+    userdbInodeChanged(inode_index);
     // Permissão de escrita
 
+    // arquivos comprimidos são gravados em clusters
+    if (inode->flags & INODE_FLAG_COMPRESSED) {
+        if (compressedAppend(inode_index, data, data_size) != 0) return -1;
+        inode->modification_date = time(NULL);
+        return 0;
+    }
+
     size_t written = 0;
 
     // Vai até o último inode encadeado
@@ -487,7 +1392,10 @@ int addContentToInode(int inode_index, const char *data, size_t data_size, int u
 
         memcpy(block_buffer + inner_offset, data + written, to_write);
 
-        if (writeBlock(block_num, block_buffer) != 0) return -1;
+        // se o bloco ficou cheio, ele passa pela deduplicação inline
+        if ((fs_features & FS_FEATURE_DEDUP) && inner_offset + to_write == BLOCK_SIZE) {
+            if (writeFullDataBlock(&current->blocks[last_block_slot], inodeGroup(inode_index), block_buffer) != 0) return -1;
+        } else if (writeDataBlock(&current->blocks[last_block_slot], block_buffer) != 0) return -1;
 
         written += to_write;
         file_offset += to_write;
@@ -504,7 +1412,7 @@ int addContentToInode(int inode_index, const char *data, size_t data_size, int u
 
         // se inode atual cheio, alocar novo inode e usar seu slot 0
         if (slot == -1) {
-            int new_inode_idx = allocateInode();
+            int new_inode_idx = allocateInode(inodeGroup(inode_index));
             if (new_inode_idx < 0) return -1;
             current->next_inode = new_inode_idx;
             current = &inode_table[new_inode_idx];
@@ -514,20 +1422,24 @@ int addContentToInode(int inode_index, const char *data, size_t data_size, int u
             slot = 0;
         }
 
-        // aloca bloco para esse slot
-        if (current->blocks[slot] == 0) {
-            int new_block = allocateBlock();
-            if (new_block < 0) return -1;
-            current->blocks[slot] = new_block;
-        }
-
         // escrever até encher o bloco (ou o que sobrar)
         size_t to_write = (data_size - written >= BLOCK_SIZE) ? BLOCK_SIZE : (data_size - written);
         char block_buffer[BLOCK_SIZE] = {0};
         // se estiver escrevendo menos que um bloco completo, copiamos só os bytes a escrever
         memcpy(block_buffer, data + written, to_write);
 
-        if (writeBlock(current->blocks[slot], block_buffer) != 0) return -1;
+        if ((fs_features & FS_FEATURE_DEDUP) && to_write == BLOCK_SIZE) {
+            if (writeFullDataBlock(&current->blocks[slot], inodeGroup(inode_index), block_buffer) != 0) return -1;
+        } else {
+            // aloca bloco para esse slot
+            if (current->blocks[slot] == 0) {
+                int new_block = allocateBlock(inodeGroup(inode_index));
+                if (new_block < 0) return -1;
+                current->blocks[slot] = new_block;
+            }
+
+            if (writeBlock(current->blocks[slot], block_buffer) != 0) return -1;
+        }
 
         written += to_write;
         file_offset += to_write;
@@ -536,26 +1448,319 @@ int addContentToInode(int inode_index, const char *data, size_t data_size, int u
     // atualiza metadados do inode raiz (tamanho e timestamp)
     inode->size = file_offset;
     inode->modification_date = time(NULL);
+    return 0;
+}
+
+/* Adiciona conteudo a um inode. Os metadados são gravados depois de soltar a trava, para que
+   escritores de arquivos diferentes só disputem o próprio sync */
+int addContentToInode(int inode_index, const char *data, size_t data_size, int user_id) {
+    if (!data) return -1;
+    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
+
+    inodeLockWrite(inode_index);
+    // o arquivo pode ter sido apagado enquanto esperávamos a trava
+    int res = inodeInUse(inode_index) ? addContentToInodeLocked(inode_index, data, data_size) : -1;
+    inodeUnlock(inode_index);
 
     // persiste mudanças
-    return sync_fs();
+    return res == 0 ? sync_fs() : -1;
 }
 
-/* Le conteudo de um inode */
-int readContentFromInode(int inode_number, char *buffer, size_t buffer_size, size_t *out_bytes, int user_id) {
-    if (!buffer || !out_bytes) return -1;
+/* Libera todos os blocos e inodes encadeados de um arquivo, deixando-o vazio
+   (com a trava de escrita do inode já tomada) */
+int truncateInodeLocked(int inode_index) {
+    inode_t *inode = &inode_table[inode_index];
+    if (inode->flags & INODE_FLAG_USERDB_VIEW) return -1;
+    userdbInodeChanged(inode_index);
 
-    int target_inode = inode_number;
-    int depth = 0;
+    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+        if (inode->blocks[i] != 0) {
+            freeBlock(inode->blocks[i]);
+            inode->blocks[i] = 0;
+        }
+    }
+    if (inode->next_inode) freeInode(inode->next_inode);
+    inode->next_inode = 0;
+    inode->size = 0;
+    inode->modification_date = time(NULL);
+    return 0;
+}
 
-    // Segue links simbólicos, com limite de 16
-    while (inode_table[target_inode].type == FILE_SYMLINK) {
-        target_inode = inode_table[target_inode].link_target_index;
-        if (++depth > 16) return -1; // evita loop infinito
+int truncateInode(int inode_index) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
+
+    inodeLockWrite(inode_index);
+    int res = inodeInUse(inode_index) ? truncateInodeLocked(inode_index) : -1;
+    inodeUnlock(inode_index);
+    return res;
+}
+
+/* Cursor sobre os blocos de dados de um arquivo (inode + next_inode) */
+typedef struct {
+    int inode;
+    int slot;
+} block_cursor_t;
+
+/* Avança o cursor para o próximo bloco alocado. Retorna 0 se encontrou, -1 no fim */
+static int nextDataBlock(block_cursor_t *cursor, uint32_t *out_block) {
+    for (;;) {
+        inode_t *current = &inode_table[cursor->inode];
+        while (cursor->slot < BLOCKS_PER_INODE) {
+            uint32_t block = current->blocks[cursor->slot++];
+            if (block != 0) {
+                *out_block = block;
+                return 0;
+            }
+        }
+        if (current->next_inode == 0) return -1;
+        cursor->inode = current->next_inode;
+        cursor->slot = 0;
+    }
+}
+
+/* Conta os blocos de dados de um arquivo (inode + next_inode) */
+static uint32_t countBlocksLocked(int inode_index) {
+    uint32_t count = 0;
+    int current = inode_index;
+    for (;;) {
+        inode_t *inode = &inode_table[current];
+        for (int i = 0; i < BLOCKS_PER_INODE; i++)
+            if (inode->blocks[i] != 0) count++;
+        if (inode->next_inode == 0) break;
+        current = inode->next_inode;
+    }
+    return count;
+}
+
+uint32_t countInodeBlocks(int inode_index) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return 0;
+
+    inodeLockRead(inode_index);
+    uint32_t count = inodeInUse(inode_index) ? countBlocksLocked(inode_index) : 0;
+    inodeUnlock(inode_index);
+    return count;
+}
+
+/* Pré-aloca no destino (vazio) um bloco para cada slot ocupado da origem, na mesma posição
+   (arquivos comprimidos têm slots vazios dentro dos clusters), preferindo sequências contíguas */
+static int preallocateLike(int src_index, int dst_index) {
+    uint32_t remaining = countBlocksLocked(src_index);
+    uint32_t run_first = 0;
+    int run_left = 0;
+
+    inode_t *src = &inode_table[src_index];
+    inode_t *dst = &inode_table[dst_index];
+
+    for (;;) {
+        for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+            if (src->blocks[i] == 0) continue;
+            if (run_left == 0) {
+                run_left = allocateBlockRun(inodeGroup(dst_index), remaining, &run_first);
+                if (run_left <= 0) return -1;
+            }
+            dst->blocks[i] = run_first++;
+            run_left--;
+            remaining--;
+        }
+        if (src->next_inode == 0) break;
+
+        int next = allocateInode(inodeGroup(dst_index));
+        if (next < 0) {
+            while (run_left-- > 0) freeBlock(run_first++);
+            return -1;
+        }
+        dst->next_inode = next;
+        dst = &inode_table[next];
+        dst->type = FILE_REGULAR;
+        src = &inode_table[src->next_inode];
+    }
+    return 0;
+}
+
+/* Lê ou escreve um lote de blocos agrupando os que são contíguos no disco */
+static int transferBlockRuns(const uint32_t *blocks, size_t count, char *buffer, int write) {
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && blocks[i + run] == blocks[i] + run) run++;
+
+        int res = write ? writeBlocks(blocks[i], run, buffer + i * BLOCK_SIZE)
+                        : readBlocks(blocks[i], run, buffer + i * BLOCK_SIZE);
+        if (res != 0) return -1;
+        i += run;
+    }
+    return 0;
+}
+
+/* Origem sem blocos próprios (visão da base de usuários): o destino recebe o texto gerado.
+   Usa as funções públicas, então é chamada sem nenhuma trava */
+static int copyGeneratedContent(int src_index, int dst_index) {
+    size_t size = inode_table[src_index].size, bytes = 0;
+    char *content = malloc(size + 1);
+    if (!content) return -1;
+
+    truncateInode(dst_index);
+    int res = readContentFromInode(src_index, content, size + 1, &bytes, ROOT_UID) == 0 &&
+              addContentToInode(dst_index, content, bytes, ROOT_UID) == 0 ? 0 : -1;
+    free(content);
+    return res;
+}
+
+/* Origem (leitura) e destino (escrita) de uma cópia, na ordem dos índices */
+static void lockCopyPair(int src_index, int dst_index) {
+    if (src_index < dst_index) inodeLockRead(src_index);
+    inodeLockWrite(dst_index);
+    if (src_index > dst_index) inodeLockRead(src_index);
+}
+
+static int copyLocked(int src_index, int dst_index) {
+    inode_t *src = &inode_table[src_index];
+    inode_t *dst = &inode_table[dst_index];
+    size_t nblocks = countBlocksLocked(src_index);
+
+    truncateInodeLocked(dst_index);
+    if (preallocateLike(src_index, dst_index) != 0) {
+        truncateInodeLocked(dst_index);
+        return -1;
+    }
+
+    char *buffer = malloc(COPY_BATCH_BLOCKS * BLOCK_SIZE);
+    if (!buffer) {
+        truncateInodeLocked(dst_index);
+        return -1;
+    }
+
+    uint32_t src_blocks[COPY_BATCH_BLOCKS], dst_blocks[COPY_BATCH_BLOCKS];
+    block_cursor_t src_cursor = { src_index, 0 };
+    block_cursor_t dst_cursor = { dst_index, 0 };
+    size_t copied = 0;
+    int res = 0;
+
+    while (copied < nblocks) {
+        // monta um lote de pares (bloco origem, bloco destino)
+        size_t batch = 0;
+        while (batch < COPY_BATCH_BLOCKS && copied + batch < nblocks) {
+            if (nextDataBlock(&src_cursor, &src_blocks[batch]) != 0 ||
+                nextDataBlock(&dst_cursor, &dst_blocks[batch]) != 0) {
+                res = -1;
+                break;
+            }
+            batch++;
+        }
+        if (res != 0 || batch == 0) break;
+
+        if (transferBlockRuns(src_blocks, batch, buffer, 0) != 0 ||
+            transferBlockRuns(dst_blocks, batch, buffer, 1) != 0) {
+            res = -1;
+            break;
+        }
+        copied += batch;
+    }
+    free(buffer);
+
+    if (res != 0) {
+        truncateInodeLocked(dst_index);
+        return -1;
     }
 
+    dst->size = src->size;
+    dst->flags = src->flags;
+    dst->modification_date = time(NULL);
+    return 0;
+}
+
+/* Copia o conteúdo de um arquivo para outro bloco a bloco, com memória limitada.
+   Os blocos do destino são pré-alocados antes da cópia. */
+int copyInodeContent(int src_index, int dst_index, int user_id) {
+    UNREFERENCED(user_id);
+    if (src_index < 0 || src_index >= MAX_INODES) return -1;
+    if (dst_index < 0 || dst_index >= MAX_INODES || src_index == dst_index) return -1;
+    if (inode_table[dst_index].flags & INODE_FLAG_USERDB_VIEW) return -1;
+    if (inode_table[src_index].flags & INODE_FLAG_USERDB_VIEW) return copyGeneratedContent(src_index, dst_index);
+
+    lockCopyPair(src_index, dst_index);
+    int res = inodeInUse(src_index) && inodeInUse(dst_index) &&
+              !(inode_table[dst_index].flags & INODE_FLAG_USERDB_VIEW) ? copyLocked(src_index, dst_index) : -1;
+    inodeUnlockPair(src_index, dst_index);
+
+    sync_fs();
+    return res;
+}
+
+static int reflinkLocked(int src_index, int dst_index) {
+    inode_t *src = &inode_table[src_index];
+    truncateInodeLocked(dst_index);
+
+    // espelha a posição de cada slot (inclusive os vazios dos clusters comprimidos)
+    inode_t *src_current = src;
+    inode_t *current = &inode_table[dst_index];
+    int res = 0;
+
+    while (res == 0) {
+        for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+            uint32_t block = src_current->blocks[i];
+            if (block == 0) continue;
+
+            if (blockAddRef(block) != 0) {
+                // contador saturado: cai para uma cópia física deste bloco
+                char buffer[BLOCK_SIZE];
+                int copy = allocateBlock(inodeGroup(dst_index));
+                if (copy < 0) { res = -1; break; }
+                if (readBlock(block, buffer) != 0 || writeBlock(copy, buffer) != 0) {
+                    freeBlock(copy);
+                    res = -1;
+                    break;
+                }
+                block = copy;
+            }
+            current->blocks[i] = block;
+        }
+        if (res != 0 || src_current->next_inode == 0) break;
+
+        int next = allocateInode(inodeGroup(dst_index));
+        if (next < 0) { res = -1; break; }
+        current->next_inode = next;
+        current = &inode_table[next];
+        current->type = FILE_REGULAR;
+        src_current = &inode_table[src_current->next_inode];
+    }
+
+    if (res != 0) {
+        truncateInodeLocked(dst_index);
+        return -1;
+    }
+
+    inode_table[dst_index].size = src->size;
+    inode_table[dst_index].flags = src->flags;
+    inode_table[dst_index].modification_date = time(NULL);
+    return 0;
+}
+
+/* Clona um arquivo sem copiar dados: o destino passa a referenciar os mesmos blocos
+   da origem. Escritas posteriores em qualquer um dos dois fazem copy-on-write. */
+int reflinkInodeContent(int src_index, int dst_index, int user_id) {
+    UNREFERENCED(user_id);
+    if (src_index < 0 || src_index >= MAX_INODES) return -1;
+    if (dst_index < 0 || dst_index >= MAX_INODES || src_index == dst_index) return -1;
+    if (inode_table[dst_index].flags & INODE_FLAG_USERDB_VIEW) return -1;
+    if (inode_table[src_index].flags & INODE_FLAG_USERDB_VIEW) return copyGeneratedContent(src_index, dst_index);
+
+    lockCopyPair(src_index, dst_index);
+    int res = inodeInUse(src_index) && inodeInUse(dst_index) &&
+              !(inode_table[dst_index].flags & INODE_FLAG_USERDB_VIEW) ? reflinkLocked(src_index, dst_index) : -1;
+    inodeUnlockPair(src_index, dst_index);
+
+    sync_fs();
+    return res;
+}
+
+/* Lê o arquivo inteiro para buffer, com a trava de leitura já tomada */
+static int readContentLocked(int target_inode, char *buffer, size_t buffer_size, size_t *out_bytes) {
     inode_t *inode = &inode_table[target_inode];
 
+    if (inode->flags & INODE_FLAG_COMPRESSED)
+        return compressedRead(target_inode, buffer, buffer_size, out_bytes);
+
     size_t total_size = inode->size;
     if (buffer_size < total_size + 1) return -1; // espaço para '\0'
 
@@ -592,21 +1797,56 @@ int readContentFromInode(int inode_number, char *buffer, size_t buffer_size, siz
     return 0;
 }
 
-/* Cria link simbolico */
-int createSymlink(int parent_inode, int target_index, const char *link_name, int user_id) {
-    // 1. Verifica se link_name já existe
-    int dummy_output;
-    if (!dirFindEntry(parent_inode, link_name, FILE_SYMLINK, &dummy_output)) return -1; // erro, já existe
-    
+/* Le conteudo de um inode */
+int readContentFromInode(int inode_number, char *buffer, size_t buffer_size, size_t *out_bytes, int user_id) {
+    if (!buffer || !out_bytes) return -1;
+    if (inode_number < 0 || inode_number >= MAX_INODES) return -1;
+
+    int target_inode = inode_number;
+    int depth = 0;
 
-    inode_t *parent = &inode_table[parent_inode];
+    // Segue links simbólicos, com limite de 16. Cada elo é conferido com a trava tomada: o inode
+    // pode ter sido apagado depois de resolvido, e num órfão link_target_index já é a lista
+    for (;;) {
+        inodeLockRead(target_inode);
+        if (!inodeInUse(target_inode)) {
+            inodeUnlock(target_inode);
+            return -1;
+        }
+        if (inode_table[target_inode].type != FILE_SYMLINK) break;
+
+        int next = (int)inode_table[target_inode].link_target_index;
+        inodeUnlock(target_inode);
+        if (next < 0 || next >= MAX_INODES) return -1;
+        if (++depth > 16) return -1; // evita loop infinito
+        target_inode = next;
+    }
 
-    // 2. Aloca um novo i-node
-    int inode_index = allocateInode();
+    // a permissão é conferida de novo no inode travado, que é o que será lido
+    if (user_id != ROOT_UID && !hasPermission(&inode_table[target_inode], user_id, PERM_READ)) {
+        inodeUnlock(target_inode);
+        return -1;
+    }
+
+    // visões não têm blocos: o texto vem da base de usuários, que tem trava própria (anterior
+    // às de inode na ordem), então a do inode é solta antes
+    if (inode_table[target_inode].flags & INODE_FLAG_USERDB_VIEW) {
+        inodeUnlock(target_inode);
+        return userdbViewRead(target_inode, buffer, buffer_size, out_bytes);
+    }
+    int res = readContentLocked(target_inode, buffer, buffer_size, out_bytes);
+    inodeUnlock(target_inode);
+    return res;
+}
+
+/* Cria link simbolico */
+int createSymlink(int parent_inode, int target_index, const char *link_name, int user_id) {
+    // 1. Aloca um novo i-node
+    int inode_index = allocateInode(inodeGroup(parent_inode));
+    if (inode_index < 0) return -1;
     inode_t *inode = &inode_table[inode_index];
-    if (!inode) return -1;
 
-    // 3. Preenche campos
+    // 2. Preenche campos
     strncpy(inode->name, link_name, MAX_NAMESIZE-1);
     inode->name[MAX_NAMESIZE-1] = '\0';
     inode->type = FILE_SYMLINK;
@@ -618,7 +1858,9 @@ int createSymlink(int parent_inode, int target_index, const char *link_name, int
     inode->owner_uid = user_id;
     inode->permissions = inode_table[target_index].permissions;
 
-    if (dirAddEntry(parent_inode, link_name, FILE_SYMLINK, inode_index) != 0){
+    // 3. Insere no diretório; a mesma passada detecta se link_name já existe
+    int existing;
+    if (dirLookupOrAdd(parent_inode, link_name, FILE_SYMLINK, inode_index, &existing) != 0){
         freeInode(inode_index);
         return -1;
     }
@@ -629,15 +1871,21 @@ int createSymlink(int parent_inode, int target_index, const char *link_name, int
 
 int deleteSymlink(int parent_inode, int target_inode_idx, int user_id) {
     if (parent_inode < 0 || parent_inode >= MAX_INODES || !target_inode_idx) return -1;
+    if (target_inode_idx < 0 || target_inode_idx >= MAX_INODES) return -1;
+    if (inode_table[target_inode_idx].type != FILE_SYMLINK) return -1;
 
-    inode_t *target = &inode_table[target_inode_idx];
+    char name[MAX_NAMESIZE];
+    strcpy(name, inode_table[target_inode_idx].name);
 
-    if (target->type != FILE_SYMLINK) return -1;
+    // o nome pode ter passado para outro inode depois de resolvido
+    int found, res = -1;
+    if (lockLiveDir(parent_inode, 1) != 0) return -1;
+    if (dirFindLocked(parent_inode, name, FILE_SYMLINK, &found) == 0 && found == target_inode_idx)
+        res = unlinkAndOrphan(parent_inode, name, target_inode_idx);
+    inodeUnlock(parent_inode);
 
-    if (dirRemoveEntry(parent_inode, target->name, target->type) == -1) return -1;
-    freeInode(target_inode_idx);
-    sync_fs();
-    return 0;
+    if (res == 0) sync_fs();
+    return res;
 }
 
 /* Encontra inode a partir de um path */
@@ -675,14 +1923,7 @@ int resolvePath(const char *path, int current_inode, int *inode_out) {
         int type = next_slash ? FILE_DIRECTORY : FILE_ANY;
 
         if (dirFindEntry(current, token, type, &next_inode) != 0) return -1;
-
-        int depth = 0;
-        while (inode_table[next_inode].type == FILE_SYMLINK) {
-            next_inode = inode_table[next_inode].link_target_index;
-            if (++depth > 16) return -1; // evita loops
-        }
-
-        current = next_inode;
+        if (followSymlinks(next_inode, &current) != 0) return -1;
     }
 
     *inode_out = current;
@@ -2,21 +2,100 @@
 #define FS_OPERATIONS_H
 #include "fs.h"
 
+/* Número máximo de blocos mantidos em memória por lote durante uma cópia */
+#define COPY_BATCH_BLOCKS 32
+
 /* Diretórios */
+/* Visitante de dirForEach: retornar != 0 interrompe a iteração */
+typedef int (*dir_visit_fn)(const dir_entry_t *entry, void *ctx);
+
 int dirFindEntry(int dir_inode, const char *name, inode_type_t type, int *out_inode);
 int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_index);
+int dirAddEntries(int dir_inode, dir_entry_t *entries, int count, int *results);
+int dirLookupOrAdd(int dir_inode, const char *name, inode_type_t type, int inode_index, int *out_inode);
 int dirRemoveEntry(int dir_inode, const char *name, inode_type_t type);
+int dirUnlinkEntry(int dir_inode, const char *name, inode_type_t type, int *out_inode);
+int dirSetEntryInode(int dir_inode, const char *name, inode_type_t type, int inode_index);
+int dirForEach(int dir_inode, dir_visit_fn visit, void *ctx);
+int dirForEachPrefix(int dir_inode, const char *prefix, dir_visit_fn visit, void *ctx);
+
+/* Leitura em lotes (readdir-plus): entradas em ordem de nome, já com os atributos do inode */
+#define DIR_ITER_BATCH 64           // entradas devolvidas por chamada de dirIterNext
+#define DIR_ITER_READAHEAD 16       // folhas da árvore B+ lidas de uma vez
+
+typedef struct {
+    int dir_inode;
+    int locked;                 // segura a trava de leitura do diretório
+    char prefix[MAX_NAMESIZE];
+    size_t prefix_len;
+    int done;
+
+    // diretório linear: entradas do prefixo, já ordenadas
+    dir_entry_t *sorted;
+    size_t sorted_count;
+    size_t sorted_pos;
+
+    // árvore B+: posição na folha atual e janela de blocos lidos antecipadamente
+    uint32_t leaf_block;
+    size_t offset;
+    uint32_t hops;
+    dir_btree_node_t *window;
+    uint32_t window_first;
+    uint32_t window_count;
+} dir_iter_t;
+
+int dirIterOpen(dir_iter_t *it, int dir_inode, const char *prefix);
+int dirIterNext(dir_iter_t *it, fs_dir_list_t *batch);
+void dirIterClose(dir_iter_t *it);
+
+/* Registros de diretório empacotados (blocos lineares e folhas da árvore B+) */
+const dir_record_t *dirRecordAt(const void *area, size_t capacity, size_t offset);
+size_t dirRecordsUsed(const void *area, size_t capacity);
+int dirRecordCompare(const dir_record_t *rec, const char *name);
+int dirRecordMatches(const dir_record_t *rec, const char *name, inode_type_t type);
+void dirRecordToEntry(const dir_record_t *rec, dir_entry_t *out);
+int dirRecordInsert(void *area, size_t capacity, size_t *used, size_t offset,
+                    const char *name, int inode_index, inode_type_t type);
+void dirRecordRemove(void *area, size_t *used, size_t offset);
 
 /* Permissões */
 int hasPermission(const inode_t *inode, int user_id, permission_t perm);
+int setInodePermissions(int inode_index, uint8_t permissions, int user_id);
+int setInodeOwner(int inode_index, int owner_uid);
 
 /* Manipulação de conteúdos */
 int createDirectory(int parent_inode, const char *name, int user_id, int* output_inode);
 int deleteDirectory(int parent_inode, const char *name, int user_id);
-int createFile(int parent_inode, const char *name, int user_id);
+
+/* Diretório atual de uma sessão: enquanto marcado, rmdir e rm -r recusam apagá-lo (DIR_BUSY).
+   dirPin falha se o inode já não é um diretório em uso */
+#define DIR_BUSY (-3)
+int dirPin(int dir_inode);
+void dirUnpin(int dir_inode);
+int createFile(int parent_inode, const char *name, int user_id, int *output_inode);
+
+/* Criação em lote (bulk-create) */
+typedef struct {
+    char name[MAX_NAMESIZE];
+    inode_type_t type;          // FILE_REGULAR ou FILE_DIRECTORY
+    int owner_uid;              // dono do inode novo (-1: quem cria)
+    int inode_index;            // saída: inode criado ou o que já existia
+    int result;                 // saída: 0 criado, 1 já existia, -1 erro
+} create_request_t;
+
+int createEntries(int parent_inode, create_request_t *reqs, int count, int user_id);
 int deleteFile(int parent_inode, const char *name, int user_id);
+int renameEntry(int src_parent, const char *src_name, int dst_parent, const char *dst_name);
+int removeTree(int parent_inode, const char *name, int user_id);
+int isInSubtree(int root_dir, int dir_inode);
 int addContentToInode(int inode_number, const char *data, size_t data_size, int user_id);
+int addContentToInodeLocked(int inode_index, const char *data, size_t data_size);     // trava já tomada
 int readContentFromInode(int inode_number, char *buffer, size_t buffer_size, size_t *out_bytes, int user_id);
+int truncateInode(int inode_index);
+int truncateInodeLocked(int inode_index);     // quem já segura a trava de escrita do inode
+uint32_t countInodeBlocks(int inode_index);
+int copyInodeContent(int src_index, int dst_index, int user_id);
+int reflinkInodeContent(int src_index, int dst_index, int user_id);
 
 int resolvePath(const char *path, int current_inode, int *inode_out);
 int createDirectoriesRecursively(const char *path, int current_inode, int user_id);
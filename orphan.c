@@ -0,0 +1,221 @@
+#include "orphan.h"
+#include "dcache.h"
+#include "userdb.h"
+#include <pthread.h>
+
+static int reclaimer_running = 0;
+static int stopping = 0;
+static pthread_t reclaimer;
+
+/* orphan_lock: orphan_head e os elos (link_target_index) dos órfãos. Folha na ordem de travas:
+   quem põe um órfão na lista já segura a trava do inode, e a thread só pega a trava do inode
+   com a lista solta */
+static pthread_mutex_t orphan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t orphan_wake = PTHREAD_COND_INITIALIZER;     // acorda a thread de liberação
+static pthread_cond_t orphan_idle = PTHREAD_COND_INITIALIZER;     // lista vazia (orphanFlush)
+
+static void pushLocked(int inode_index) {
+    inode_t *inode = &inode_table[inode_index];
+    inode->link_target_index = orphan_head;
+    __atomic_or_fetch(&inode->flags, INODE_FLAG_ORPHAN, __ATOMIC_RELAXED);
+    __atomic_store_n(&orphan_head, inode_index, __ATOMIC_RELAXED);
+}
+
+void orphanAdd(int inode_index) {
+    if (inode_index <= ROOT_INODE || inode_index >= MAX_INODES) return;
+
+    pthread_mutex_lock(&orphan_lock);
+    // já liberado ou já órfão: empilhar de novo fecharia um ciclo na lista
+    if (!inodeInUse(inode_index)) {
+        pthread_mutex_unlock(&orphan_lock);
+        return;
+    }
+    pushLocked(inode_index);
+    pthread_cond_signal(&orphan_wake);
+    pthread_mutex_unlock(&orphan_lock);
+
+    // o nome já não existe: o número sai do cache agora, mesmo sem o inode ter sido liberado
+    userdbInodeReleased(inode_index);
+    dcachePurgeInode(inode_index);
+}
+
+void orphanCancel(int inode_index) {
+    if (inode_index <= ROOT_INODE || inode_index >= MAX_INODES) return;
+
+    pthread_mutex_lock(&orphan_lock);
+    uint32_t *link = &orphan_head;
+    while (*link != 0 && *link != (uint32_t)inode_index) link = &inode_table[*link].link_target_index;
+    if (*link != 0) {
+        __atomic_store_n(link, inode_table[inode_index].link_target_index, __ATOMIC_RELAXED);
+        inode_table[inode_index].link_target_index = 0;
+        __atomic_and_fetch(&inode_table[inode_index].flags, ~INODE_FLAG_ORPHAN, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&orphan_lock);
+}
+
+void orphanAddMany(const int *inodes, int count) {
+    uint8_t orphaned[(MAX_INODES + 7) / 8] = {0};
+
+    pthread_mutex_lock(&orphan_lock);
+    for (int i = 0; i < count; i++) {
+        int index = inodes[i];
+        if (index <= ROOT_INODE || index >= MAX_INODES) continue;
+        if (!inodeInUse(index)) continue;     // já liberado ou já órfão
+        pushLocked(index);
+        orphaned[index / 8] |= (1 << (index % 8));
+    }
+    pthread_cond_signal(&orphan_wake);
+    pthread_mutex_unlock(&orphan_lock);
+
+    for (int i = 0; i < count; i++)
+        if (inodes[i] >= 0 && inodes[i] < MAX_INODES) userdbInodeReleased(inodes[i]);
+    dcachePurgeInodes(orphaned);
+}
+
+/* Tira da lista os órfãos marcados no conjunto (count deles) */
+static void unlinkOrphans(const uint8_t *set, int count) {
+    pthread_mutex_lock(&orphan_lock);
+    uint32_t *link = &orphan_head;
+    while (count > 0 && *link != 0) {
+        uint32_t index = *link;
+        if (set[index / 8] & (1 << (index % 8))) {
+            __atomic_store_n(link, inode_table[index].link_target_index, __ATOMIC_RELAXED);
+            count--;
+        } else {
+            link = &inode_table[index].link_target_index;
+        }
+    }
+    pthread_mutex_unlock(&orphan_lock);
+}
+
+/* Uma passada: pega até ORPHAN_BATCH_INODES órfãos do começo da lista, solta os blocos de cada
+   um em lotes (a trava do inode é devolvida entre um lote e outro) e só então os tira da lista
+   e devolve os inodes. Até lá eles continuam na lista em disco, e uma queda no meio recomeça
+   de onde a última gravação dos metadados parou */
+static int reclaimPass(void) {
+    int batch[ORPHAN_BATCH_INODES];
+    int count = 0;
+
+    pthread_mutex_lock(&orphan_lock);
+    for (uint32_t i = orphan_head; i != 0 && count < ORPHAN_BATCH_INODES; i = inode_table[i].link_target_index)
+        batch[count++] = i;
+    pthread_mutex_unlock(&orphan_lock);
+    if (count == 0) return 0;
+
+    // um órfão devolvido ao nome (orphanCancel) enquanto a passada esperava a trava fica de fora
+    uint8_t set[(MAX_INODES + 7) / 8] = {0};
+    int kept = 0;
+    for (int k = 0; k < count; k++) {
+        int done = 0, cancelled = 0;
+        while (!done && !cancelled) {
+            inodeLockWrite(batch[k]);
+            cancelled = !(__atomic_load_n(&inode_table[batch[k]].flags, __ATOMIC_RELAXED) & INODE_FLAG_ORPHAN);
+            if (!cancelled) done = freeInodeBlocks(batch[k], ORPHAN_BATCH_BLOCKS);
+            inodeUnlock(batch[k]);
+            if (!cancelled) sync_fs();
+        }
+        if (cancelled) continue;
+        set[batch[k] / 8] |= (1 << (batch[k] % 8));
+        batch[kept++] = batch[k];
+    }
+    count = kept;
+
+    unlinkOrphans(set, count);
+    freeInodes(batch, count);
+    sync_fs();
+    return count;
+}
+
+/* ---- thread de liberação ---- */
+static void *reclaimerMain(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&orphan_lock);
+    for (;;) {
+        // ao parar, esvazia a lista antes de sair
+        if (orphan_head == 0) {
+            pthread_cond_broadcast(&orphan_idle);
+            if (stopping) break;
+            pthread_cond_wait(&orphan_wake, &orphan_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&orphan_lock);
+        reclaimPass();
+        pthread_mutex_lock(&orphan_lock);
+    }
+    pthread_mutex_unlock(&orphan_lock);
+    return NULL;
+}
+
+int orphanStart(void) {
+    pthread_mutex_lock(&orphan_lock);
+    int res = 0;
+    if (!reclaimer_running) {
+        stopping = 0;
+        res = pthread_create(&reclaimer, NULL, reclaimerMain, NULL) == 0 ? 0 : -1;
+        reclaimer_running = res == 0;
+    }
+    pthread_mutex_unlock(&orphan_lock);
+    return res;
+}
+
+void orphanStop(void) {
+    pthread_mutex_lock(&orphan_lock);
+    int running = reclaimer_running;
+    stopping = 1;
+    pthread_cond_signal(&orphan_wake);
+    pthread_mutex_unlock(&orphan_lock);
+
+    if (running) {
+        pthread_join(reclaimer, NULL);
+        reclaimer_running = 0;
+    }
+    // sem thread (não iniciou): libera aqui mesmo
+    while (reclaimPass() > 0) {}
+}
+
+void orphanFlush(void) {
+    pthread_mutex_lock(&orphan_lock);
+    int running = reclaimer_running;
+    while (running && orphan_head != 0) pthread_cond_wait(&orphan_idle, &orphan_lock);
+    pthread_mutex_unlock(&orphan_lock);
+
+    if (!running)
+        while (reclaimPass() > 0) {}
+}
+
+/* ---- montagem ---- */
+/* A lista em disco é validada elo a elo (inode alocado e marcado como órfão) e cortada no
+   primeiro elo ruim. Uma gravação rasgada dos metadados pode deixar um órfão marcado fora da
+   lista, então a tabela também é varrida atrás deles */
+int orphanRecover(void) {
+    if (!inode_table) return 0;
+
+    int *found = malloc(MAX_INODES * sizeof(int));
+    if (!found) return 0;
+    uint8_t seen[(MAX_INODES + 7) / 8] = {0};
+    int count = 0;
+
+    for (uint32_t i = orphan_head; i != 0 && count < MAX_INODES; i = inode_table[i].link_target_index) {
+        if (!inodeAllocated(i) || !(inode_table[i].flags & INODE_FLAG_ORPHAN) ||
+            (seen[i / 8] & (1 << (i % 8)))) {
+            fprintf(stderr, "[AVISO] Lista de órfãos corrompida no inode %u; a tabela será varrida.\n", i);
+            break;
+        }
+        seen[i / 8] |= (1 << (i % 8));
+        found[count++] = i;
+    }
+    for (int i = ROOT_INODE + 1; i < MAX_INODES; i++) {
+        if (!inodeAllocated(i) || !(inode_table[i].flags & INODE_FLAG_ORPHAN)) continue;
+        if (seen[i / 8] & (1 << (i % 8))) continue;
+        found[count++] = i;
+    }
+
+    for (int k = 0; k < count; k++)
+        freeInodeBlocks(found[k], UINT32_MAX);
+    orphan_head = 0;
+    freeInodes(found, count);
+    if (count > 0) sync_fs();
+
+    free(found);
+    return count;
+}
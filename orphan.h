@@ -0,0 +1,31 @@
+#ifndef ORPHAN_H
+#define ORPHAN_H
+#include "fs.h"
+
+/* Liberação adiada de arquivos apagados: rm só tira a entrada do diretório e põe o inode na
+   lista de órfãos (orphan_head no header, encadeada por link_target_index e marcada com
+   INODE_FLAG_ORPHAN), e uma thread solta os blocos em lotes de ORPHAN_BATCH_BLOCKS, com a
+   trava do inode tomada só durante cada lote. A lista vai para o disco com os metadados, então
+   uma queda antes da liberação deixa os órfãos para a próxima montagem (orphanRecover) */
+#define ORPHAN_BATCH_BLOCKS 1024
+#define ORPHAN_BATCH_INODES 256
+
+int orphanStart(void);
+/* Para a thread depois de liberar todos os órfãos da lista */
+void orphanStop(void);
+
+/* Põe na lista um inode que acabou de sair do diretório (com a trava de escrita dele tomada) */
+void orphanAdd(int inode_index);
+/* Desfaz orphanAdd de um inode que voltou a ter nome (com a trava de escrita dele tomada desde
+   orphanAdd, então nenhum bloco foi liberado) */
+void orphanCancel(int inode_index);
+/* Como orphanAdd para um lote (rm -r), com uma só varredura no cache de diretórios */
+void orphanAddMany(const int *inodes, int count);
+
+/* Espera a thread esvaziar a lista (df conta o espaço dos arquivos apagados como livre) */
+void orphanFlush(void);
+
+/* Montagem: libera os órfãos deixados por uma queda. Retorna quantos foram liberados */
+int orphanRecover(void);
+
+#endif
@@ -0,0 +1,154 @@
+#include "server.h"
+#include "session.h"
+#include "utils.h"
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+typedef struct {
+    int fd;                 // conexão (-1 = slot livre); fechada só pelo laço de aceitação
+    int done;               // a thread da sessão terminou e pode ser recolhida
+    pthread_t thread;
+} session_slot_t;
+
+static session_slot_t slots[SERVER_MAX_SESSIONS];
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+/* Cópia do descritor da conexão como FILE: a sessão fecha as suas cópias, e o original fica
+   para o laço principal, que pode derrubar a conexão (shutdown) a qualquer momento */
+static FILE *openStream(int fd, const char *mode) {
+    int copy = dup(fd);
+    FILE *stream = copy >= 0 ? fdopen(copy, mode) : NULL;
+    if (!stream && copy >= 0) close(copy);
+    return stream;
+}
+
+static void *sessionMain(void *arg) {
+    session_slot_t *slot = arg;
+    FILE *in = openStream(slot->fd, "r"), *out = openStream(slot->fd, "w");
+
+    // login, uid, usuário e tickets do sudo são variáveis da thread: cada sessão tem os seus
+    if (in && out) {
+        sessionSetStreams(in, out);
+        if (try_login() == 0) run_shell();
+        sessionSetStreams(NULL, NULL);
+    }
+    if (in) fclose(in);
+    if (out) fclose(out);
+    __atomic_store_n(&slot->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Recolhe as sessões encerradas (ou todas, esperando cada uma terminar) */
+static void reapSessions(int wait_all) {
+    for (int i = 0; i < SERVER_MAX_SESSIONS; i++) {
+        if (slots[i].fd < 0) continue;
+        if (!wait_all && !__atomic_load_n(&slots[i].done, __ATOMIC_ACQUIRE)) continue;
+        pthread_join(slots[i].thread, NULL);
+        close(slots[i].fd);
+        slots[i].fd = -1;
+    }
+}
+
+static session_slot_t *freeSlot(void) {
+    for (int i = 0; i < SERVER_MAX_SESSIONS; i++)
+        if (slots[i].fd < 0) return &slots[i];
+    return NULL;
+}
+
+static int openListener(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Caminho do socket muito longo: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // um socket que aceita conexões é de outro daemon; um que recusa sobrou de um daemon que caiu
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s existe e não é um socket\n", path);
+            return -1;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int alive = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (alive) {
+            fprintf(stderr, "Já existe um daemon atendendo em %s\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SERVER_BACKLOG) != 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serverRun(const char *socket_path) {
+    int listen_fd = openListener(socket_path);
+    if (listen_fd < 0) return -1;
+
+    // sem SA_RESTART: o sinal interrompe o poll e o laço percebe o pedido de parada
+    struct sigaction sa = { .sa_handler = onSignal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    // um cliente que some no meio de uma resposta não pode derrubar o daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < SERVER_MAX_SESSIONS; i++) slots[i].fd = -1;
+    printf("[INFO] Aguardando sessões em %s\n", socket_path);
+    fflush(stdout);
+
+    while (!stopping) {
+        struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 1000) <= 0) {
+            reapSessions(0);
+            continue;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+
+        reapSessions(0);
+        session_slot_t *slot = freeSlot();
+        if (!slot) {
+            dprintf(fd, "Limite de %d sessões atingido. Tente mais tarde.\n", SERVER_MAX_SESSIONS);
+            close(fd);
+            continue;
+        }
+        slot->fd = fd;
+        slot->done = 0;
+        if (pthread_create(&slot->thread, NULL, sessionMain, slot) != 0) {
+            close(fd);
+            slot->fd = -1;
+        }
+    }
+
+    // parada: nenhuma conexão nova; as sessões abertas recebem fim de entrada e saem do laço
+    close(listen_fd);
+    unlink(socket_path);
+    for (int i = 0; i < SERVER_MAX_SESSIONS; i++)
+        if (slots[i].fd >= 0) shutdown(slots[i].fd, SHUT_RDWR);
+    reapSessions(1);
+    printf("[INFO] Daemon encerrado.\n");
+    return 0;
+}
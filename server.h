@@ -0,0 +1,17 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/* Daemon multi-sessão (main --daemon [socket]): o disco é montado uma vez e cada conexão no
+   socket Unix vira uma sessão com login, uid e diretório atual próprios, atendida por uma
+   thread que roda o mesmo laço de comandos do terminal. Tabela de inodes, dcache, cache de
+   clusters e base de usuários são compartilhados entre as sessões. O cliente (client/fsclient)
+   só repassa a entrada e a saída do terminal para o socket */
+#define SERVER_SOCKET "minifs.sock"
+#define SERVER_MAX_SESSIONS 256
+#define SERVER_BACKLOG 64
+
+/* Atende até receber SIGINT/SIGTERM; as sessões abertas são encerradas antes de retornar.
+   Quem chama monta o disco antes e desmonta depois */
+int serverRun(const char *socket_path);
+
+#endif
@@ -0,0 +1,31 @@
+#include "session.h"
+#include <stdarg.h>
+
+static __thread FILE *session_in = NULL;       // NULL = stdin/stdout do processo
+static __thread FILE *session_out = NULL;
+
+FILE *sessionIn(void) {
+    return session_in ? session_in : stdin;
+}
+
+FILE *sessionOut(void) {
+    return session_out ? session_out : stdout;
+}
+
+void sessionSetStreams(FILE *in, FILE *out) {
+    session_in = in;
+    session_out = out;
+}
+
+int sessionPrintf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int res = vfprintf(sessionOut(), format, args);
+    va_end(args);
+    return res;
+}
+
+char *sessionGets(char *buffer, int size) {
+    fflush(sessionOut());
+    return fgets(buffer, size, sessionIn());
+}
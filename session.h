@@ -0,0 +1,17 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include <stdio.h>
+
+/* Entrada e saída da sessão atual. No terminal são stdin e stdout; no daemon (server.c) cada
+   thread de sessão aponta para o próprio socket, e os comandos escrevem e leem por aqui */
+FILE *sessionIn(void);
+FILE *sessionOut(void);
+void sessionSetStreams(FILE *in, FILE *out);
+
+int sessionPrintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/* Lê uma linha como fgets (NULL no fim da entrada). A saída pendente é enviada antes, para que
+   o cliente veja o prompt que está sendo respondido */
+char *sessionGets(char *buffer, int size);
+
+#endif
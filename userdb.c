@@ -0,0 +1,837 @@
+#include "userdb.h"
+#include "fs_operations.h"
+#include <pthread.h>
+
+typedef struct {
+    char name[MAX_NAMESIZE];
+    int uid;
+    char hash[USERDB_HASH_SIZE];    // "" = sem linha no shadow
+    int next_by_name;
+    int next_by_uid;
+} user_record_t;
+
+static user_record_t *users = NULL;
+static int user_count = 0, user_cap = 0;
+static int by_name[USERDB_BUCKETS];
+static int by_uid[USERDB_BUCKETS];
+static int next_uid = 0;
+static int loaded = 0;
+static int changes = 0;                         // escritas externas em passwd/shadow
+static __thread int writing = 0;                // esta thread escreve pela base: não invalida
+static int passwd_inode = -1, shadow_inode = -1;
+
+/* Tomada por toda a interface, antes de qualquer trava de inode (a base lê e grava passwd e
+   shadow pelas funções comuns de conteúdo). Os ganchos userdbInodeChanged/Released rodam com
+   a trava de um inode tomada e por isso não a usam: loaded, changes e os inodes dos arquivos
+   são lidos e escritos com atômicos */
+static pthread_mutex_t userdb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ---- tabelas ---- */
+static uint32_t nameHash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+static uint32_t uidHash(int uid) {
+    return (uint32_t)uid * 0x9E3779B1u >> 20;
+}
+
+static void userdbReset(void) {
+    for (int b = 0; b < USERDB_BUCKETS; b++) by_name[b] = by_uid[b] = -1;
+    user_count = 0;
+    next_uid = 0;
+    __atomic_store_n(&passwd_inode, -1, __ATOMIC_RELAXED);
+    __atomic_store_n(&shadow_inode, -1, __ATOMIC_RELAXED);
+}
+
+static user_record_t *findByName(const char *name) {
+    for (int i = by_name[nameHash(name) % USERDB_BUCKETS]; i >= 0; i = users[i].next_by_name)
+        if (strcmp(users[i].name, name) == 0) return &users[i];
+    return NULL;
+}
+
+static user_record_t *findByUid(int uid) {
+    for (int i = by_uid[uidHash(uid) % USERDB_BUCKETS]; i >= 0; i = users[i].next_by_uid)
+        if (users[i].uid == uid) return &users[i];
+    return NULL;
+}
+
+/* O primeiro registro de um nome vale (como na varredura linear que ele substitui) */
+static int insertUser(const char *name, int uid) {
+    if (strlen(name) >= MAX_NAMESIZE || findByName(name)) return -1;
+
+    if (user_count == user_cap) {
+        int cap = user_cap ? user_cap * 2 : 64;
+        user_record_t *grown = realloc(users, cap * sizeof(user_record_t));
+        if (!grown) return -1;
+        users = grown;
+        user_cap = cap;
+    }
+
+    user_record_t *user = &users[user_count];
+    strcpy(user->name, name);
+    user->uid = uid;
+    user->hash[0] = '\0';
+
+    uint32_t nb = nameHash(name) % USERDB_BUCKETS, ub = uidHash(uid) % USERDB_BUCKETS;
+    user->next_by_name = by_name[nb];
+    by_name[nb] = user_count;
+    user->next_by_uid = by_uid[ub];
+    by_uid[ub] = user_count;
+    user_count++;
+
+    if (uid >= next_uid) next_uid = uid + 1;
+    return 0;
+}
+
+/* ---- carga ---- */
+/* Lê um dos arquivos inteiro (NULL se não existe). O inode fica registrado para invalidação */
+static char *readUserFile(const char *path, int *out_inode) {
+    int inode_index;
+    if (resolvePath(path, ROOT_INODE, &inode_index) != 0) return NULL;
+    if (inode_table[inode_index].type != FILE_REGULAR) return NULL;
+    __atomic_store_n(out_inode, inode_index, __ATOMIC_RELAXED);
+
+    size_t size = inode_table[inode_index].size, bytes = 0;
+    char *content = malloc(size + 1);
+    if (!content) return NULL;
+    if (size > 0 && readContentFromInode(inode_index, content, size + 1, &bytes, ROOT_UID) != 0) {
+        free(content);
+        return NULL;
+    }
+    content[bytes] = '\0';
+    return content;
+}
+
+/* Próxima linha do buffer (terminada em '\n' ou no fim); a linha é cortada no próprio buffer */
+static char *nextLine(char **cursor) {
+    char *line = *cursor;
+    if (!line || *line == '\0') return NULL;
+    char *end = strchr(line, '\n');
+    if (end) {
+        *end = '\0';
+        *cursor = end + 1;
+    } else {
+        *cursor = line + strlen(line);
+    }
+    return line;
+}
+
+static void userdbLoad(void) {
+    int seen = __atomic_load_n(&changes, __ATOMIC_ACQUIRE);
+    userdbReset();
+
+    // passwd: <nome>:x:<uid>
+    char *passwd = readUserFile(USERDB_PASSWD_PATH, &passwd_inode);
+    char *cursor = passwd, *line;
+    while ((line = nextLine(&cursor)) != NULL) {
+        char *colon1 = strchr(line, ':');
+        char *colon2 = colon1 ? strchr(colon1 + 1, ':') : NULL;
+        if (!colon2) continue;
+        *colon1 = '\0';
+        insertUser(line, atoi(colon2 + 1));
+    }
+    free(passwd);
+
+    // shadow: <nome>:<hash da senha>
+    char *shadow = readUserFile(USERDB_SHADOW_PATH, &shadow_inode);
+    cursor = shadow;
+    while ((line = nextLine(&cursor)) != NULL) {
+        char *colon = strchr(line, ':');
+        if (!colon) continue;
+        *colon = '\0';
+        user_record_t *user = findByName(line);
+        if (user && user->hash[0] == '\0') {
+            strncpy(user->hash, colon + 1, USERDB_HASH_SIZE - 1);
+            user->hash[USERDB_HASH_SIZE - 1] = '\0';
+        }
+    }
+    free(shadow);
+
+    // enquanto um dos arquivos não existe (disco sendo criado) a base é relida a cada consulta;
+    // uma escrita externa durante a leitura também deixa a base para ser relida
+    __atomic_store_n(&loaded, passwd_inode >= 0 && shadow_inode >= 0 &&
+                              __atomic_load_n(&changes, __ATOMIC_ACQUIRE) == seen, __ATOMIC_RELEASE);
+}
+
+static void ensureLoaded(void) {
+    if (!__atomic_load_n(&loaded, __ATOMIC_ACQUIRE)) userdbLoad();
+}
+
+/* ---- base binária ---- */
+static userdb_super_t super;
+static int super_loaded = 0;
+static __thread char found_name[MAX_NAMESIZE];     // retornos de userdbNameOf/userdbPasswordHash,
+static __thread char found_hash[USERDB_HASH_SIZE]; // um par por thread
+
+static int binaryMode(void) {
+    return (fs_features & FS_FEATURE_USERDB) != 0;
+}
+
+/* Superbloco da região: lido na primeira consulta e mantido em memória */
+static int readSuper(void) {
+    if (super_loaded) return 0;
+    char block[BLOCK_SIZE];
+    if (userdb_blocks == 0 || readBlock(userdb_first_block, block) != 0) return -1;
+    memcpy(&super, block, sizeof(super));
+    if (super.magic != USERDB_MAGIC) return -1;
+    super_loaded = 1;
+    return 0;
+}
+
+static int writeSuper(void) {
+    char block[BLOCK_SIZE] = {0};
+    memcpy(block, &super, sizeof(super));
+    return writeBlock(userdb_first_block, block);
+}
+
+static uint32_t recordBlock(uint32_t uid) {
+    return userdb_first_block + 1 + uid / USERDB_RECORDS_PER_BLOCK;
+}
+
+static uint32_t indexBlock(uint32_t bucket) {
+    return userdb_first_block + 1 + super.record_blocks + bucket;
+}
+
+static int binaryRecord(int uid, userdb_record_t *out) {
+    if (uid < 0 || readSuper() != 0 || (uint32_t)uid >= super.capacity) return -1;
+    userdb_record_block_t block;
+    if (readBlock(recordBlock(uid), &block) != 0) return -1;
+    *out = block.records[uid % USERDB_RECORDS_PER_BLOCK];
+    return (out->flags & USERDB_RECORD_USED) ? 0 : -1;
+}
+
+/* Procura o nome no índice. Retorna 1 (achou) ou 0 (primeiro slot vazio da sondagem), com o
+   bloco lido e a posição; -1 em erro ou índice cheio */
+static int binaryFindSlot(const char *name, userdb_index_block_t *block, uint32_t *out_bucket, int *out_slot) {
+    if (readSuper() != 0 || super.index_blocks == 0) return -1;
+
+    uint32_t bucket = nameHash(name) % super.index_blocks;
+    for (uint32_t probes = 0; probes < super.index_blocks; probes++) {
+        if (readBlock(indexBlock(bucket), block) != 0) return -1;
+        for (int s = 0; s < (int)USERDB_SLOTS_PER_BLOCK; s++) {
+            const userdb_slot_t *slot = &block->slots[s];
+            if (slot->uid_plus_one == 0 || strncmp(slot->name, name, MAX_NAMESIZE) == 0) {
+                *out_bucket = bucket;
+                *out_slot = s;
+                return slot->uid_plus_one != 0;
+            }
+        }
+        bucket = (bucket + 1) % super.index_blocks;
+    }
+    return -1;
+}
+
+static int binaryUidOf(const char *name) {
+    userdb_index_block_t block;
+    uint32_t bucket;
+    int slot;
+    if (binaryFindSlot(name, &block, &bucket, &slot) != 1) return -1;
+    return (int)block.slots[slot].uid_plus_one - 1;
+}
+
+static int passwdLine(char *out, size_t cap, const char *name, int uid) {
+    return snprintf(out, cap, "%s:x:%d\n", name, uid);
+}
+
+static int shadowLine(char *out, size_t cap, const char *name, const char *hash) {
+    return hash[0] ? snprintf(out, cap, "%s:%s\n", name, hash) : 0;
+}
+
+/* O tamanho das visões acompanha a base, para ls e cat. Uma visão removida perde a flag
+   junto com o inode, então o número guardado no superbloco nunca é confundido com outro arquivo */
+static void updateViews(void) {
+    uint32_t views[2] = { super.passwd_inode, super.shadow_inode };
+    uint32_t sizes[2] = { super.passwd_bytes, super.shadow_bytes };
+    for (int v = 0; v < 2; v++) {
+        if (views[v] >= MAX_INODES) continue;
+        inodeLockWrite(views[v]);
+        if (inode_table[views[v]].flags & INODE_FLAG_USERDB_VIEW) {
+            inode_table[views[v]].size = sizes[v];
+            inode_table[views[v]].modification_date = time(NULL);
+        }
+        inodeUnlock(views[v]);
+    }
+}
+
+static int isView(uint32_t inode_index) {
+    return inode_index < MAX_INODES && (inode_table[inode_index].flags & INODE_FLAG_USERDB_VIEW);
+}
+
+static int binaryAppend(const char *name, int uid, const char *password_hash) {
+    if (readSuper() != 0 || uid < 0 || (uint32_t)uid >= super.capacity) return -1;
+
+    userdb_record_t existing;
+    if (binaryRecord(uid, &existing) == 0) return -1;
+
+    userdb_index_block_t index;
+    uint32_t bucket;
+    int slot;
+    if (binaryFindSlot(name, &index, &bucket, &slot) != 0) return -1;
+
+    // registro primeiro: o slot no índice é o que torna o usuário visível
+    userdb_record_block_t records;
+    if (readBlock(recordBlock(uid), &records) != 0) return -1;
+    userdb_record_t *record = &records.records[uid % USERDB_RECORDS_PER_BLOCK];
+    memset(record, 0, sizeof(*record));
+    strncpy(record->name, name, MAX_NAMESIZE - 1);
+    record->uid = uid;
+    record->flags = USERDB_RECORD_USED;
+    strncpy(record->hash, password_hash, USERDB_HASH_SIZE - 1);
+    if (writeBlock(recordBlock(uid), &records) != 0) return -1;
+
+    strncpy(index.slots[slot].name, name, MAX_NAMESIZE - 1);
+    index.slots[slot].name[MAX_NAMESIZE - 1] = '\0';
+    index.slots[slot].uid_plus_one = uid + 1;
+    if (writeBlock(indexBlock(bucket), &index) != 0) return -1;
+
+    super.count++;
+    if ((uint32_t)uid >= super.next_uid) super.next_uid = uid + 1;
+    super.passwd_bytes += passwdLine(NULL, 0, record->name, uid);
+    super.shadow_bytes += shadowLine(NULL, 0, record->name, record->hash);
+    if (writeSuper() != 0) return -1;
+
+    updateViews();
+    return sync_fs();
+}
+
+/* Grava as faixas contíguas de blocos marcados em dirty (first + i para o bloco i do buffer) */
+static int writeDirtyRuns(uint32_t first, const char *buffer, const uint8_t *dirty, uint32_t count) {
+    for (uint32_t b = 0; b < count;) {
+        if (!dirty[b]) { b++; continue; }
+        uint32_t end = b;
+        while (end < count && dirty[end]) end++;
+        if (writeBlocks(first + b, end - b, buffer + (size_t)b * BLOCK_SIZE) != 0) return -1;
+        b = end;
+    }
+    return 0;
+}
+
+static int binaryAppendMany(const userdb_entry_t *entries, int count) {
+    if (readSuper() != 0) return -1;
+
+    uint32_t lo = UINT32_MAX, hi = 0;
+    for (int i = 0; i < count; i++) {
+        if (entries[i].uid < 0 || (uint32_t)entries[i].uid >= super.capacity) return -1;
+        if ((uint32_t)entries[i].uid < lo) lo = entries[i].uid;
+        if ((uint32_t)entries[i].uid > hi) hi = entries[i].uid;
+    }
+
+    // índice inteiro e a faixa de registros dos uids novos, alterados em memória
+    uint32_t rec_first = lo / USERDB_RECORDS_PER_BLOCK, rec_count = hi / USERDB_RECORDS_PER_BLOCK - rec_first + 1;
+    userdb_index_block_t *index = malloc((size_t)super.index_blocks * BLOCK_SIZE);
+    userdb_record_block_t *records = malloc((size_t)rec_count * BLOCK_SIZE);
+    uint8_t *index_dirty = calloc(super.index_blocks, 1);
+    int res = index && records && index_dirty &&
+              readBlocks(indexBlock(0), super.index_blocks, index) == 0 &&
+              readBlocks(recordBlock(lo), rec_count, records) == 0 ? 0 : -1;
+
+    uint32_t passwd_bytes = 0, shadow_bytes = 0, next = super.next_uid;
+    for (int i = 0; i < count && res == 0; i++) {
+        const userdb_entry_t *entry = &entries[i];
+        userdb_record_t *record = &records[entry->uid / USERDB_RECORDS_PER_BLOCK - rec_first]
+                                      .records[entry->uid % USERDB_RECORDS_PER_BLOCK];
+        if (record->flags & USERDB_RECORD_USED) {
+            res = -1;
+            break;
+        }
+
+        uint32_t bucket = nameHash(entry->name) % super.index_blocks;
+        userdb_slot_t *free_slot = NULL;
+        for (uint32_t probes = 0; probes < super.index_blocks && !free_slot && res == 0; probes++) {
+            for (int s = 0; s < (int)USERDB_SLOTS_PER_BLOCK; s++) {
+                userdb_slot_t *slot = &index[bucket].slots[s];
+                if (slot->uid_plus_one == 0) {
+                    free_slot = slot;
+                    index_dirty[bucket] = 1;
+                    break;
+                }
+                if (strncmp(slot->name, entry->name, MAX_NAMESIZE) == 0) {
+                    res = -1;
+                    break;
+                }
+            }
+            if (!free_slot) bucket = (bucket + 1) % super.index_blocks;
+        }
+        if (res != 0 || !free_slot) {
+            res = -1;
+            break;
+        }
+
+        memset(record, 0, sizeof(*record));
+        strncpy(record->name, entry->name, MAX_NAMESIZE - 1);
+        record->uid = entry->uid;
+        record->flags = USERDB_RECORD_USED;
+        strncpy(record->hash, entry->hash, USERDB_HASH_SIZE - 1);
+
+        strncpy(free_slot->name, entry->name, MAX_NAMESIZE - 1);
+        free_slot->name[MAX_NAMESIZE - 1] = '\0';
+        free_slot->uid_plus_one = entry->uid + 1;
+
+        if ((uint32_t)entry->uid >= next) next = entry->uid + 1;
+        passwd_bytes += passwdLine(NULL, 0, record->name, record->uid);
+        shadow_bytes += shadowLine(NULL, 0, record->name, record->hash);
+    }
+
+    // registros antes do índice, que é o que torna os usuários visíveis
+    if (res == 0 && (writeBlocks(recordBlock(lo), rec_count, records) != 0 ||
+                     writeDirtyRuns(indexBlock(0), (const char *)index, index_dirty, super.index_blocks) != 0))
+        res = -1;
+    free(index);
+    free(records);
+    free(index_dirty);
+    if (res != 0) {
+        super_loaded = 0;
+        return -1;
+    }
+
+    super.count += count;
+    super.next_uid = next;
+    super.passwd_bytes += passwd_bytes;
+    super.shadow_bytes += shadow_bytes;
+    if (writeSuper() != 0) return -1;
+
+    updateViews();
+    return sync_fs();
+}
+
+/* Gera o texto de uma das visões percorrendo os registros em ordem de uid */
+static int generateView(int shadow, char *buffer, size_t buffer_size, size_t *out_bytes) {
+    if (readSuper() != 0) return -1;
+    size_t total = shadow ? super.shadow_bytes : super.passwd_bytes;
+    if (buffer_size < total + 1) return -1;
+
+    userdb_record_block_t *batch = malloc(USERDB_VIEW_BATCH * sizeof(userdb_record_block_t));
+    if (!batch) return -1;
+
+    size_t offset = 0;
+    uint32_t used_blocks = (super.next_uid + USERDB_RECORDS_PER_BLOCK - 1) / USERDB_RECORDS_PER_BLOCK;
+    int res = 0;
+    for (uint32_t b = 0; b < used_blocks && res == 0; b += USERDB_VIEW_BATCH) {
+        uint32_t n = used_blocks - b < USERDB_VIEW_BATCH ? used_blocks - b : USERDB_VIEW_BATCH;
+        if (readBlocks(userdb_first_block + 1 + b, n, batch) != 0) {
+            res = -1;
+            break;
+        }
+        for (uint32_t i = 0; i < n * USERDB_RECORDS_PER_BLOCK; i++) {
+            const userdb_record_t *record = &batch[i / USERDB_RECORDS_PER_BLOCK].records[i % USERDB_RECORDS_PER_BLOCK];
+            if (!(record->flags & USERDB_RECORD_USED)) continue;
+
+            size_t left = total + 1 - offset;
+            int len = shadow ? shadowLine(buffer + offset, left, record->name, record->hash)
+                             : passwdLine(buffer + offset, left, record->name, record->uid);
+            if (len < 0 || (size_t)len >= left) {
+                res = -1;
+                break;
+            }
+            offset += len;
+        }
+    }
+    free(batch);
+    if (res != 0) return -1;
+
+    buffer[offset] = '\0';
+    *out_bytes = offset;
+    return 0;
+}
+
+/* ---- operações (com userdb_lock tomada) ---- */
+static int validName(const char *name) {
+    return name[0] != '\0' && strlen(name) < MAX_NAMESIZE && !strchr(name, ':') && !strchr(name, '\n');
+}
+
+static int uidOfLocked(const char *name) {
+    if (!name) return -1;
+    if (binaryMode()) return binaryUidOf(name);
+    ensureLoaded();
+    user_record_t *user = findByName(name);
+    return user ? user->uid : -1;
+}
+
+static const char *nameOfLocked(int uid) {
+    if (binaryMode()) {
+        userdb_record_t record;
+        if (binaryRecord(uid, &record) != 0) return NULL;
+        memcpy(found_name, record.name, MAX_NAMESIZE);
+        found_name[MAX_NAMESIZE - 1] = '\0';
+        return found_name;
+    }
+    ensureLoaded();
+    user_record_t *user = findByUid(uid);
+    if (!user) return NULL;
+    memcpy(found_name, user->name, MAX_NAMESIZE);
+    return found_name;
+}
+
+static const char *passwordHashLocked(const char *name) {
+    if (!name) return NULL;
+    if (binaryMode()) {
+        userdb_record_t record;
+        if (binaryRecord(binaryUidOf(name), &record) != 0 || record.hash[0] == '\0') return NULL;
+        memcpy(found_hash, record.hash, USERDB_HASH_SIZE);
+        found_hash[USERDB_HASH_SIZE - 1] = '\0';
+        return found_hash;
+    }
+    ensureLoaded();
+    user_record_t *user = findByName(name);
+    if (!user || user->hash[0] == '\0') return NULL;
+    memcpy(found_hash, user->hash, USERDB_HASH_SIZE);
+    return found_hash;
+}
+
+static int nextUidLocked(void) {
+    if (binaryMode()) return readSuper() == 0 ? (int)super.next_uid : -1;
+    ensureLoaded();
+    return next_uid;
+}
+
+static void invalidateLocked(void) {
+    __atomic_store_n(&loaded, 0, __ATOMIC_RELEASE);
+    super_loaded = 0;
+}
+
+static int appendLocked(const char *name, int uid, const char *password_hash) {
+    if (!name || !password_hash || !validName(name)) return -1;
+    if (binaryMode()) return binaryAppend(name, uid, password_hash);
+
+    ensureLoaded();
+    if (passwd_inode < 0 || shadow_inode < 0 || findByName(name)) return -1;
+
+    char passwd_entry[MAX_NAMESIZE + 16], shadow_entry[MAX_NAMESIZE + USERDB_HASH_SIZE + 2];
+    passwdLine(passwd_entry, sizeof(passwd_entry), name, uid);
+    snprintf(shadow_entry, sizeof(shadow_entry), "%s:%s\n", name, password_hash);
+
+    writing = 1;
+    int res = addContentToInode(passwd_inode, passwd_entry, strlen(passwd_entry), ROOT_UID) == 0 &&
+              addContentToInode(shadow_inode, shadow_entry, strlen(shadow_entry), ROOT_UID) == 0 ? 0 : -1;
+    writing = 0;
+
+    if (res != 0 || insertUser(name, uid) != 0) {
+        invalidateLocked();
+        return -1;
+    }
+    user_record_t *user = findByName(name);
+    strncpy(user->hash, password_hash, USERDB_HASH_SIZE - 1);
+    user->hash[USERDB_HASH_SIZE - 1] = '\0';
+    return 0;
+}
+
+static int appendManyLocked(const userdb_entry_t *entries, int count) {
+    if (!entries || count < 0) return -1;
+    if (count == 0) return 0;
+    for (int i = 0; i < count; i++)
+        if (!validName(entries[i].name) || strchr(entries[i].hash, '\n')) return -1;
+    if (binaryMode()) return binaryAppendMany(entries, count);
+
+    ensureLoaded();
+    if (passwd_inode < 0 || shadow_inode < 0) return -1;
+    for (int i = 0; i < count; i++)
+        if (findByName(entries[i].name)) return -1;
+
+    size_t passwd_cap = (size_t)count * (MAX_NAMESIZE + 16);
+    size_t shadow_cap = (size_t)count * (MAX_NAMESIZE + USERDB_HASH_SIZE + 2);
+    char *passwd = malloc(passwd_cap), *shadow = malloc(shadow_cap);
+    size_t passwd_len = 0, shadow_len = 0;
+    int res = passwd && shadow ? 0 : -1;
+
+    for (int i = 0; i < count && res == 0; i++) {
+        passwd_len += passwdLine(passwd + passwd_len, passwd_cap - passwd_len, entries[i].name, entries[i].uid);
+        shadow_len += snprintf(shadow + shadow_len, shadow_cap - shadow_len, "%s:%s\n", entries[i].name, entries[i].hash);
+    }
+
+    // uma escrita em cada arquivo para o lote inteiro
+    writing = 1;
+    if (res == 0 && (addContentToInode(passwd_inode, passwd, passwd_len, ROOT_UID) != 0 ||
+                     addContentToInode(shadow_inode, shadow, shadow_len, ROOT_UID) != 0))
+        res = -1;
+    writing = 0;
+    free(passwd);
+    free(shadow);
+
+    for (int i = 0; i < count && res == 0; i++) {
+        if (insertUser(entries[i].name, entries[i].uid) != 0) {
+            res = -1;
+            break;
+        }
+        user_record_t *user = findByName(entries[i].name);
+        strncpy(user->hash, entries[i].hash, USERDB_HASH_SIZE - 1);
+        user->hash[USERDB_HASH_SIZE - 1] = '\0';
+    }
+    if (res != 0) invalidateLocked();
+    return res;
+}
+
+static int viewReadLocked(int inode_index, char *buffer, size_t buffer_size, size_t *out_bytes) {
+    if (!binaryMode() || readSuper() != 0 || !isView(inode_index)) return -1;
+    if ((uint32_t)inode_index == super.passwd_inode) return generateView(0, buffer, buffer_size, out_bytes);
+    if ((uint32_t)inode_index == super.shadow_inode) return generateView(1, buffer, buffer_size, out_bytes);
+    return -1;
+}
+
+static int statusLocked(userdb_super_t *out) {
+    if (!out) return -1;
+    if (binaryMode()) {
+        if (readSuper() != 0) return -1;
+        *out = super;
+        if (!isView(out->passwd_inode)) out->passwd_inode = USERDB_NO_VIEW;
+        if (!isView(out->shadow_inode)) out->shadow_inode = USERDB_NO_VIEW;
+        return 0;
+    }
+    ensureLoaded();
+    memset(out, 0, sizeof(*out));
+    out->count = user_count;
+    out->next_uid = next_uid;
+    out->passwd_inode = passwd_inode >= 0 ? (uint32_t)passwd_inode : USERDB_NO_VIEW;
+    out->shadow_inode = shadow_inode >= 0 ? (uint32_t)shadow_inode : USERDB_NO_VIEW;
+    return 0;
+}
+
+/* ---- conversão ---- */
+/* Monta a região inteira em memória a partir da base em texto e grava com uma escrita só.
+   passwd e shadow passam a ser visões: perdem os blocos e o conteúdo é gerado na leitura */
+static int toBinaryLocked(uint32_t capacity) {
+    if (binaryMode()) return 0;
+    if (capacity == 0 || capacity > USERDB_MAX_CAPACITY) return -1;
+
+    userdbLoad();
+    if (!loaded || (uint32_t)next_uid > capacity) return -1;
+
+    uint32_t record_blocks = (capacity + USERDB_RECORDS_PER_BLOCK - 1) / USERDB_RECORDS_PER_BLOCK;
+    uint32_t index_blocks = capacity * 4 / 3 / USERDB_SLOTS_PER_BLOCK + 1;     // ocupação <= 75%
+    uint32_t total = 1 + record_blocks + index_blocks;
+
+    char *region = calloc(total, BLOCK_SIZE);
+    if (!region) return -1;
+    userdb_super_t *head = (userdb_super_t *)region;
+    userdb_record_block_t *records = (userdb_record_block_t *)(region + BLOCK_SIZE);
+    userdb_index_block_t *index = (userdb_index_block_t *)(region + (1 + record_blocks) * BLOCK_SIZE);
+
+    head->magic = USERDB_MAGIC;
+    head->capacity = capacity;
+    head->next_uid = next_uid;
+    head->record_blocks = record_blocks;
+    head->index_blocks = index_blocks;
+    head->passwd_inode = passwd_inode;
+    head->shadow_inode = shadow_inode;
+
+    for (int i = 0; i < user_count; i++) {
+        const user_record_t *user = &users[i];
+        if (user->uid < 0) continue;
+        userdb_record_t *record = &records[user->uid / USERDB_RECORDS_PER_BLOCK].records[user->uid % USERDB_RECORDS_PER_BLOCK];
+        if (record->flags & USERDB_RECORD_USED) continue;       // uid repetido: vale o primeiro
+
+        strcpy(record->name, user->name);
+        record->uid = user->uid;
+        record->flags = USERDB_RECORD_USED;
+        strcpy(record->hash, user->hash);
+
+        uint32_t bucket = nameHash(user->name) % index_blocks;
+        for (int placed = 0; !placed; bucket = (bucket + 1) % index_blocks) {
+            for (int s = 0; s < (int)USERDB_SLOTS_PER_BLOCK && !placed; s++) {
+                userdb_slot_t *slot = &index[bucket].slots[s];
+                if (slot->uid_plus_one != 0) continue;
+                strcpy(slot->name, user->name);
+                slot->uid_plus_one = user->uid + 1;
+                placed = 1;
+            }
+        }
+
+        head->count++;
+        head->passwd_bytes += passwdLine(NULL, 0, record->name, record->uid);
+        head->shadow_bytes += shadowLine(NULL, 0, record->name, record->hash);
+    }
+
+    uint32_t first;
+    if (allocateBlockExtent(total, &first) != 0) {
+        free(region);
+        return -1;
+    }
+    if (writeBlocks(first, total, region) != 0) {
+        for (uint32_t b = 0; b < total; b++) freeBlock(first + b);
+        free(region);
+        return -1;
+    }
+
+    super = *head;
+    free(region);
+
+    // a região e o bitmap que a reserva vão para o disco, e o header passa a apontar para ela,
+    // antes de os arquivos em texto serem esvaziados: uma queda no meio monta com uma das duas
+    // bases inteira
+    userdb_first_block = first;
+    userdb_blocks = total;
+    if (flush_fs() != 0 || set_fs_features(fs_features | FS_FEATURE_USERDB) != 0) {
+        userdb_first_block = userdb_blocks = 0;
+        for (uint32_t b = 0; b < total; b++) freeBlock(first + b);
+        return -1;
+    }
+    super_loaded = 1;
+    __atomic_store_n(&loaded, 0, __ATOMIC_RELEASE);
+
+    // os arquivos em texto viram visões (conteúdo truncado antes da flag, que bloqueia escritas)
+    int views[2] = { passwd_inode, shadow_inode };
+    for (int v = 0; v < 2; v++) {
+        inodeLockWrite(views[v]);
+        truncateInodeLocked(views[v]);
+        inode_table[views[v]].flags |= INODE_FLAG_USERDB_VIEW;
+        inodeUnlock(views[v]);
+    }
+    updateViews();
+    return sync_fs();
+}
+
+/* Abre (ou cria) um dos arquivos em texto para regravar o conteúdo */
+static int openTextFile(const char *path) {
+    char dir_path[256], name[256];
+    splitPath(path, dir_path, name);
+
+    int parent;
+    if (resolvePath(dir_path, ROOT_INODE, &parent) != 0) {
+        if (createDirectoriesRecursively(dir_path, ROOT_INODE, ROOT_UID) != 0) return -1;
+        if (resolvePath(dir_path, ROOT_INODE, &parent) != 0) return -1;
+    }
+
+    int inode_index;
+    if (createFile(parent, name, ROOT_UID, &inode_index) < 0) return -1;
+
+    inodeLockWrite(inode_index);
+    inode_t *inode = &inode_table[inode_index];
+    if (inode->flags & INODE_FLAG_USERDB_VIEW) {
+        inode->flags &= ~INODE_FLAG_USERDB_VIEW;
+        inode->size = 0;
+    } else {
+        truncateInodeLocked(inode_index);
+    }
+    inodeUnlock(inode_index);
+    return inode_index;
+}
+
+/* Volta para passwd/shadow em texto (conteúdo das visões) e libera a região */
+static int toTextLocked(void) {
+    if (!binaryMode()) return 0;
+    if (readSuper() != 0) return -1;
+
+    size_t sizes[2] = { super.passwd_bytes, super.shadow_bytes };
+    const char *paths[2] = { USERDB_PASSWD_PATH, USERDB_SHADOW_PATH };
+    char *texts[2] = { malloc(sizes[0] + 1), malloc(sizes[1] + 1) };
+    size_t lens[2];
+    int res = texts[0] && texts[1] &&
+              generateView(0, texts[0], sizes[0] + 1, &lens[0]) == 0 &&
+              generateView(1, texts[1], sizes[1] + 1, &lens[1]) == 0 ? 0 : -1;
+
+    for (int v = 0; v < 2 && res == 0; v++) {
+        int inode_index = openTextFile(paths[v]);
+        if (inode_index < 0 || addContentToInode(inode_index, texts[v], lens[v], ROOT_UID) != 0) res = -1;
+    }
+    free(texts[0]);
+    free(texts[1]);
+    if (res != 0) return -1;
+
+    // os arquivos em texto chegam ao disco e o header deixa de apontar para a região antes de
+    // ela ser liberada: os blocos dela não podem ir para outro arquivo enquanto a base binária
+    // ainda é a que vale na montagem
+    if (flush_fs() != 0 || set_fs_features(fs_features & ~FS_FEATURE_USERDB) != 0) return -1;
+    uint32_t first = userdb_first_block, blocks = userdb_blocks;
+    userdb_first_block = userdb_blocks = 0;
+    for (uint32_t b = 0; b < blocks; b++) freeBlock(first + b);
+    invalidateLocked();
+    return sync_fs();
+}
+
+/* ---- interface ---- */
+int userdbUidOf(const char *name) {
+    pthread_mutex_lock(&userdb_lock);
+    int res = uidOfLocked(name);
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+/* O texto devolvido fica em um buffer da thread, válido até a próxima consulta dela */
+const char *userdbNameOf(int uid) {
+    pthread_mutex_lock(&userdb_lock);
+    const char *res = nameOfLocked(uid);
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+const char *userdbPasswordHash(const char *name) {
+    pthread_mutex_lock(&userdb_lock);
+    const char *res = passwordHashLocked(name);
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+int userdbNextUid(void) {
+    pthread_mutex_lock(&userdb_lock);
+    int res = nextUidLocked();
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+int userdbAppend(const char *name, int uid, const char *password_hash) {
+    pthread_mutex_lock(&userdb_lock);
+    int res = appendLocked(name, uid, password_hash);
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+int userdbAppendMany(const userdb_entry_t *entries, int count) {
+    pthread_mutex_lock(&userdb_lock);
+    int res = appendManyLocked(entries, count);
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+/* Ganchos: chamados com a trava do inode tomada, sem userdb_lock */
+void userdbInodeChanged(int inode_index) {
+    if (binaryMode() || writing) return;
+    if (inode_index == __atomic_load_n(&passwd_inode, __ATOMIC_RELAXED) ||
+        inode_index == __atomic_load_n(&shadow_inode, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&changes, 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&loaded, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/* Na base binária, remover uma visão só a desliga: a visão é reconhecida pela flag do inode,
+   que some com ele, e os registros continuam valendo */
+void userdbInodeReleased(int inode_index) {
+    userdbInodeChanged(inode_index);
+}
+
+void userdbInvalidate(void) {
+    pthread_mutex_lock(&userdb_lock);
+    invalidateLocked();
+    pthread_mutex_unlock(&userdb_lock);
+}
+
+int userdbViewRead(int inode_index, char *buffer, size_t buffer_size, size_t *out_bytes) {
+    pthread_mutex_lock(&userdb_lock);
+    int res = viewReadLocked(inode_index, buffer, buffer_size, out_bytes);
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+int userdbStatus(userdb_super_t *out) {
+    pthread_mutex_lock(&userdb_lock);
+    int res = statusLocked(out);
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+int userdbToBinary(uint32_t capacity) {
+    pthread_mutex_lock(&userdb_lock);
+    int res = toBinaryLocked(capacity);
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
+
+int userdbToText(void) {
+    pthread_mutex_lock(&userdb_lock);
+    int res = toTextLocked();
+    pthread_mutex_unlock(&userdb_lock);
+    return res;
+}
@@ -0,0 +1,93 @@
+#ifndef USERDB_H
+#define USERDB_H
+#include "fs.h"
+
+/* Base de usuários em memória: etc/passwd e etc/shadow são lidos uma vez e indexados em
+   tabelas hash por nome e por uid. Escrever diretamente em um dos arquivos invalida a base,
+   que é recarregada na próxima consulta */
+#define USERDB_PASSWD_PATH "etc/passwd"
+#define USERDB_SHADOW_PATH "etc/shadow"
+#define USERDB_BUCKETS 4096
+#define USERDB_HASH_SIZE 128
+
+/* Base binária (opcional, FS_FEATURE_USERDB): região contígua de blocos com
+   [superbloco][registros por uid][índice de nomes]. O registro do uid u fica no bloco
+   1 + u / USERDB_RECORDS_PER_BLOCK; o índice é uma tabela hash de nomes com sondagem linear
+   bloco a bloco. Nada é lido na montagem e cada consulta custa uma leitura de bloco.
+   passwd e shadow continuam existindo como visões em texto geradas a partir dos registros */
+#define USERDB_MAGIC 0x42445355 // "USDB"
+#define USERDB_DEFAULT_CAPACITY 4096
+#define USERDB_MAX_CAPACITY 1000000
+#define USERDB_NO_VIEW 0xFFFFFFFFu
+#define USERDB_RECORD_USED (1u << 0)
+#define USERDB_VIEW_BATCH 32            // blocos de registros lidos por vez ao gerar uma visão
+
+typedef struct {
+    uint32_t magic;
+    uint32_t capacity;          // uids válidos: 0 .. capacity - 1
+    uint32_t count;
+    uint32_t next_uid;          // maior uid + 1
+    uint32_t record_blocks;
+    uint32_t index_blocks;
+    uint32_t passwd_inode;      // inodes das visões (USERDB_NO_VIEW se removidas)
+    uint32_t shadow_inode;
+    uint32_t passwd_bytes;      // tamanho das visões geradas
+    uint32_t shadow_bytes;
+} userdb_super_t;
+
+typedef struct {
+    char name[MAX_NAMESIZE];
+    uint32_t uid;
+    uint32_t flags;             // USERDB_RECORD_*
+    char hash[USERDB_HASH_SIZE];    // "" = sem linha no shadow
+} userdb_record_t;
+
+typedef struct {
+    char name[MAX_NAMESIZE];
+    uint32_t uid_plus_one;      // 0 = slot vazio
+} userdb_slot_t;
+
+#define USERDB_RECORDS_PER_BLOCK (BLOCK_SIZE / sizeof(userdb_record_t))
+#define USERDB_SLOTS_PER_BLOCK (BLOCK_SIZE / sizeof(userdb_slot_t))
+
+typedef union {
+    char raw[BLOCK_SIZE];
+    userdb_record_t records[USERDB_RECORDS_PER_BLOCK];
+} userdb_record_block_t;
+
+typedef union {
+    char raw[BLOCK_SIZE];
+    userdb_slot_t slots[USERDB_SLOTS_PER_BLOCK];
+} userdb_index_block_t;
+
+int userdbUidOf(const char *name);
+const char *userdbNameOf(int uid);
+const char *userdbPasswordHash(const char *name);
+int userdbNextUid(void);
+
+/* Acrescenta o usuário aos dois arquivos e às tabelas, sem recarregar a base */
+int userdbAppend(const char *name, int uid, const char *password_hash);
+
+/* Vários usuários de uma vez (create-users): uma escrita em cada arquivo, ou na base binária
+   uma leitura e uma escrita por faixa de blocos alterada. Nada é gravado se algum nome ou uid
+   já existir */
+typedef struct {
+    char name[MAX_NAMESIZE];
+    int uid;
+    char hash[USERDB_HASH_SIZE];
+} userdb_entry_t;
+
+int userdbAppendMany(const userdb_entry_t *entries, int count);
+
+/* Chamado por quem altera o conteúdo de um inode (ou o libera) */
+void userdbInodeChanged(int inode_index);
+void userdbInodeReleased(int inode_index);
+void userdbInvalidate(void);
+
+/* Conversão entre os formatos e leitura das visões (inodes com INODE_FLAG_USERDB_VIEW) */
+int userdbToBinary(uint32_t capacity);
+int userdbToText(void);
+int userdbViewRead(int inode_index, char *buffer, size_t buffer_size, size_t *out_bytes);
+int userdbStatus(userdb_super_t *out);
+
+#endif
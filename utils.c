@@ -1,12 +1,14 @@
 #include "utils.h"
 #include "fs.h"
+#include "fs_operations.h"
 #include "core_utils.h"
+#include "session.h"
 #include <unistd.h>
 #include <sys/random.h>
 #include <stdio.h>
 #include <crypt.h>
 
-char username[32];
+__thread char username[32];
 Command commands[] = {
     {"cd",      cmd_cd},
     {"mkdir",   cmd_mkdir},
@@ -25,7 +27,13 @@ Command commands[] = {
     {"df",      cmd_df},
     {"chmod",   cmd_chmod},
     {"chown",   cmd_chown},
-    {"create-user", cmd_create_user}
+    {"create-user", cmd_create_user},
+    {"create-users", cmd_create_users},
+    {"dedup",   cmd_dedup},
+    {"compress", cmd_compress},
+    {"scrub",   cmd_scrub},
+    {"bulk-create", cmd_bulk_create},
+    {"userdb",  cmd_userdb}
 };
 
 const int command_count = sizeof(commands) / sizeof(commands[0]);
@@ -49,21 +57,28 @@ int gen_salt(char *out, size_t length) {
 }
 
 int encrypt_password(char password[MAX_PASSWORD_SIZE], char out_buffer[MAX_HASH_SIZE]) {
+    static __thread struct crypt_data data;
+    return encrypt_password_r(password, out_buffer, &data);
+}
+
+// versão reentrante: cada thread passa a sua crypt_data (create-users gera os hashes em paralelo)
+int encrypt_password_r(const char *password, char out_buffer[MAX_HASH_SIZE], struct crypt_data *data) {
     // gera um hash da senha
     char salt_body[16];
-    gen_salt(salt_body, sizeof(salt_body));
+    gen_salt(salt_body, sizeof(salt_body) - 1);   // gen_salt escreve o '\0' depois de length
 
     char salt[32];
     snprintf(salt, sizeof(salt), "$6$%s$", salt_body);
-    const char* hash = crypt(password, salt);
-    strncpy(out_buffer, hash, MAX_HASH_SIZE - 1);
-    out_buffer[MAX_HASH_SIZE - 1] = '\0';
-    
-    if (!out_buffer) {
+    data->initialized = 0;
+    const char* hash = crypt_r(password, salt, data);
+    if (!hash || hash[0] == '*') {
         perror("crypt");
+        out_buffer[0] = '\0';
         return 1;
     }
 
+    strncpy(out_buffer, hash, MAX_HASH_SIZE - 1);
+    out_buffer[MAX_HASH_SIZE - 1] = '\0';
     return 0;
 }
 
@@ -95,23 +110,72 @@ int start_fs() {
 }
 
 int try_login() {
-    printf("------------ Login -----------\n\n");
+    sessionPrintf("------------ Login -----------\n\n");
     char password[MAX_PASSWORD_SIZE];
     while (authenticated_uid == -1) {
-        // Input do Usuário
-        printf("Usuário: ");
-        fgets(username, MAX_NAMESIZE, stdin);
+        // Input do Usuário (fim da entrada encerra a sessão sem login)
+        sessionPrintf("Usuário: ");
+        if (!sessionGets(username, MAX_NAMESIZE)) return -1;
         username[strcspn(username, "\n")] = '\0'; // remove o '\n' da string
         int uid = assert_user_exists(username); // verifica se o usuário existe antes de prosseguir
         if (uid == -1) {
-            printf("\nUsuário não encontrado!\n");
+            sessionPrintf("\nUsuário não encontrado!\n");
             continue;
         }
-        printf("Senha: ");
-        fgets(password, MAX_PASSWORD_SIZE, stdin);
+        sessionPrintf("Senha: ");
+        if (!sessionGets(password, MAX_PASSWORD_SIZE)) return -1;
         password[strcspn(password, "\n")] = '\0';
-        login(username, password, uid);
+        if (login(username, password, uid) != -1) start_session();
 
     }
     return 0;
+}
+
+// laço de comandos da sessão, até 'exit' ou o fim da entrada
+void run_shell() {
+    int current_inode = ROOT_INODE;
+    dirPin(current_inode);
+    char input[MAX_INPUT];
+    sessionPrintf("MiniFS Terminal. Digite 'exit' para sair.\n");
+
+    while (1) {
+        sessionPrintf("%s@[%s]> ", username, inode_table[current_inode].name);
+        if (!sessionGets(input, MAX_INPUT)) break;
+
+        // Remove \n final
+        input[strcspn(input, "\n")] = 0;
+
+        // Sair
+        if (strcmp(input, "exit") == 0) break;
+
+        // Parse do comando (strtok_r: no daemon várias sessões fazem isso ao mesmo tempo)
+        char *save;
+        char *cmd = strtok_r(input, " ", &save);
+        char *arg1 = strtok_r(NULL, " ", &save);
+        char *arg2 = strtok_r(NULL, " ", &save);
+        char *arg3 = strtok_r(NULL, "", &save);
+
+        if (!cmd) continue;
+        int handled = 0;
+
+        for (int i = 0; i < command_count; i++) {
+            if (strcmp(cmd, commands[i].name) == 0) {
+                commands[i].fn(
+                    &current_inode,
+                    arg1, arg2, arg3,
+                    authenticated_uid
+                );
+                handled = 1;
+                break;
+            }
+        }
+
+        if (!handled) {
+            sessionPrintf("Comando não reconhecido: %s\n", cmd);
+        }
+    }
+
+    dirUnpin(current_inode);
+    sessionPrintf("Saindo...\n");
+    fflush(sessionOut());
 }
\ No newline at end of file
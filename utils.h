@@ -1,6 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 #include "core_utils.h"
+#include <crypt.h>
 
 typedef void (*command_handler)(
     int *current_inode,
@@ -17,11 +18,15 @@ typedef struct {
 
 
 int encrypt_password(char password[MAX_PASSWORD_SIZE], char out_buffer[MAX_HASH_SIZE]);
+int encrypt_password_r(const char *password, char out_buffer[MAX_HASH_SIZE], struct crypt_data *data);
+#define MAX_INPUT 256
+
 int start_fs();
 int try_login();
+void run_shell();
 
 extern Command commands[];
-extern char username[32];
+extern __thread char username[32];
 extern const int command_count;
 
 #endif
\ No newline at end of file
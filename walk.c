@@ -0,0 +1,284 @@
+#include "walk.h"
+#include "fs_operations.h"
+#include <pthread.h>
+
+typedef struct {
+    int dir_inode;
+    int depth;
+} walk_task_t;
+
+/* Fila de diretórios de uma thread: a dona empilha e desempilha no fim (seguindo a subárvore
+   que acabou de ler), as outras roubam do começo (diretórios mais rasos, subárvores maiores) */
+typedef struct {
+    pthread_mutex_t lock;
+    walk_task_t *tasks;
+    size_t head, tail, cap;
+} walk_deque_t;
+
+typedef struct walk_pool walk_pool_t;
+
+typedef struct {
+    walk_pool_t *pool;
+    int id;
+    walk_deque_t deque;
+    uint32_t dirs, entries, steals;
+    fs_entry_t batch[DIR_ITER_BATCH];
+} walk_worker_t;
+
+struct walk_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int pending;                // diretórios enfileirados ou em leitura
+    int idle;                   // threads dormindo em wake
+    uint64_t generation;        // muda a cada diretório enfileirado
+    int result;                 // 0, ou o primeiro erro / retorno negativo do visitante
+
+    walk_worker_t *workers;
+    int nworkers;
+    uint8_t seen[(MAX_INODES + 7) / 8];     // diretórios já enfileirados
+
+    walk_visit_fn visit;
+    void *ctx;
+};
+
+/* ---- fila ---- */
+static int dequePush(walk_deque_t *d, walk_task_t task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->tail == d->cap) {
+        if (d->head > 0) {
+            memmove(d->tasks, d->tasks + d->head, (d->tail - d->head) * sizeof(walk_task_t));
+            d->tail -= d->head;
+            d->head = 0;
+        } else {
+            size_t cap = d->cap ? d->cap * 2 : 64;
+            walk_task_t *tasks = realloc(d->tasks, cap * sizeof(walk_task_t));
+            if (!tasks) {
+                pthread_mutex_unlock(&d->lock);
+                return -1;
+            }
+            d->tasks = tasks;
+            d->cap = cap;
+        }
+    }
+    d->tasks[d->tail++] = task;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+static int dequePopBottom(walk_deque_t *d, walk_task_t *task) {
+    int res = -1;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) {
+        *task = d->tasks[--d->tail];
+        if (d->tail == d->head) d->head = d->tail = 0;
+        res = 0;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return res;
+}
+
+static int dequeStealTop(walk_deque_t *d, walk_task_t *task) {
+    int res = -1;
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head) {
+        *task = d->tasks[d->head++];
+        if (d->tail == d->head) d->head = d->tail = 0;
+        res = 0;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return res;
+}
+
+/* ---- tarefas ---- */
+static void walkFail(walk_pool_t *pool, int error) {
+    pthread_mutex_lock(&pool->lock);
+    // lido sem a trava por walkAborted
+    if (pool->result == 0) __atomic_store_n(&pool->result, error, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static int walkAborted(walk_pool_t *pool) {
+    return __atomic_load_n(&pool->result, __ATOMIC_RELAXED) != 0;
+}
+
+/* Enfileira um diretório na fila da thread. A contagem sobe antes de a tarefa ficar visível,
+   para que ninguém veja pending == 0 enquanto ela existe */
+static int walkPush(walk_worker_t *w, walk_task_t task) {
+    walk_pool_t *pool = w->pool;
+
+    // um diretório só entra uma vez, mesmo que uma imagem corrompida tenha ciclos
+    uint8_t bit = 1u << (task.dir_inode % 8);
+    if (__atomic_fetch_or(&pool->seen[task.dir_inode / 8], bit, __ATOMIC_RELAXED) & bit) return 0;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (dequePush(&w->deque, task) != 0) {
+        pthread_mutex_lock(&pool->lock);
+        pool->pending--;
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->generation++;
+    if (pool->idle > 0) pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+static int walkSteal(walk_worker_t *w, walk_task_t *task) {
+    walk_pool_t *pool = w->pool;
+    for (int k = 1; k < pool->nworkers; k++) {
+        walk_worker_t *victim = &pool->workers[(w->id + k) % pool->nworkers];
+        if (dequeStealTop(&victim->deque, task) == 0) {
+            w->steals++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Lê o diretório em lotes, visita cada entrada e enfileira os subdiretórios */
+static void walkDirectory(walk_worker_t *w, walk_task_t task) {
+    walk_pool_t *pool = w->pool;
+    dir_iter_t it;
+    fs_dir_list_t batch = { w->batch, 0 };
+
+    if (dirIterOpen(&it, task.dir_inode, "") != 0) {
+        walkFail(pool, -1);
+        return;
+    }
+    w->dirs++;
+
+    int n = 0;
+    while (!walkAborted(pool) && (n = dirIterNext(&it, &batch)) > 0) {
+        for (int i = 0; i < batch.count; i++) {
+            const fs_entry_t *entry = &batch.entries[i];
+            if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0) continue;
+
+            const inode_t *inode = &inode_table[entry->inode_index];
+            w->entries++;
+            int res = pool->visit(task.dir_inode, entry, inode, task.depth + 1, pool->ctx);
+            if (res < 0) {
+                walkFail(pool, res);
+                dirIterClose(&it);
+                return;
+            }
+
+            if (res != WALK_SKIP && entry->type == FILE_DIRECTORY && inode->type == FILE_DIRECTORY) {
+                walk_task_t child = { (int)entry->inode_index, task.depth + 1 };
+                if (walkPush(w, child) != 0) {
+                    walkFail(pool, -1);
+                    dirIterClose(&it);
+                    return;
+                }
+            }
+        }
+    }
+    if (n < 0) walkFail(pool, -1);
+    dirIterClose(&it);
+}
+
+/* ---- threads ---- */
+static void *walkWorker(void *arg) {
+    walk_worker_t *w = arg;
+    walk_pool_t *pool = w->pool;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        uint64_t generation = pool->generation;
+        int stop = pool->pending == 0 || pool->result != 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) break;
+
+        walk_task_t task;
+        if (dequePopBottom(&w->deque, &task) == 0 || walkSteal(w, &task) == 0) {
+            walkDirectory(w, task);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0) pthread_cond_broadcast(&pool->wake);
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        // nada para pegar: dorme até alguém enfileirar um diretório ou o percurso acabar
+        pthread_mutex_lock(&pool->lock);
+        if (pool->generation == generation && pool->pending > 0 && pool->result == 0) {
+            pool->idle++;
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            pool->idle--;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+/* Percorre a subárvore de root_inode com até nthreads threads (a que chama é uma delas).
+   Links simbólicos não são seguidos. Retorna 0, -1 em erro de leitura ou o valor negativo
+   com que o visitante abortou */
+int walkTree(int root_inode, int nthreads, walk_visit_fn visit, void *ctx, walk_report_t *report) {
+    if (root_inode < 0 || root_inode >= MAX_INODES || !visit) return -1;
+    if (inode_table[root_inode].type != FILE_DIRECTORY) return -1;
+
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > WALK_MAX_THREADS) nthreads = WALK_MAX_THREADS;
+
+    walk_pool_t *pool = calloc(1, sizeof(walk_pool_t));
+    if (!pool) return -1;
+    pool->workers = calloc(nthreads, sizeof(walk_worker_t));
+    if (!pool->workers) {
+        free(pool);
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pool->nworkers = nthreads;
+    pool->visit = visit;
+    pool->ctx = ctx;
+
+    for (int t = 0; t < nthreads; t++) {
+        pool->workers[t].pool = pool;
+        pool->workers[t].id = t;
+        pthread_mutex_init(&pool->workers[t].deque.lock, NULL);
+    }
+
+    int res = -1;
+    pthread_t threads[WALK_MAX_THREADS];
+    int threaded[WALK_MAX_THREADS] = {0};
+    uint32_t started = 1;
+
+    if (walkPush(&pool->workers[0], (walk_task_t){ root_inode, 0 }) == 0) {
+        // uma thread que não sobe não tem fila própria com trabalho: as outras seguem sem ela
+        for (int t = 1; t < nthreads; t++) {
+            threaded[t] = pthread_create(&threads[t], NULL, walkWorker, &pool->workers[t]) == 0;
+            if (threaded[t]) started++;
+        }
+        walkWorker(&pool->workers[0]);
+        for (int t = 1; t < nthreads; t++)
+            if (threaded[t]) pthread_join(threads[t], NULL);
+        res = pool->result;
+    }
+
+    if (report) {
+        memset(report, 0, sizeof(*report));
+        report->threads = started;
+        for (int t = 0; t < nthreads; t++) {
+            report->dirs += pool->workers[t].dirs;
+            report->entries += pool->workers[t].entries;
+            report->steals += pool->workers[t].steals;
+        }
+    }
+
+    for (int t = 0; t < nthreads; t++) {
+        pthread_mutex_destroy(&pool->workers[t].deque.lock);
+        free(pool->workers[t].deque.tasks);
+    }
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+    return res;
+}
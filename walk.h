@@ -0,0 +1,24 @@
+#ifndef WALK_H
+#define WALK_H
+#include "fs.h"
+
+/* Percurso paralelo da árvore de diretórios (cada diretório é uma tarefa, com roubo de trabalho) */
+#define WALK_MAX_THREADS 16
+#define WALK_SKIP 1             // retorno do visitante: não descer neste diretório
+
+/* Chamado para cada entrada abaixo da raiz, exceto "." e "..". Com mais de uma thread, várias
+   chamadas podem acontecer ao mesmo tempo. Retorna 0 para seguir, WALK_SKIP para não entrar
+   no diretório e < 0 para abortar o percurso (o valor é devolvido por walkTree) */
+typedef int (*walk_visit_fn)(int parent_inode, const fs_entry_t *entry, const inode_t *inode,
+                             int depth, void *ctx);
+
+typedef struct {
+    uint32_t threads;
+    uint32_t dirs;          // diretórios lidos
+    uint32_t entries;       // entradas visitadas
+    uint32_t steals;        // diretórios roubados da fila de outra thread
+} walk_report_t;
+
+int walkTree(int root_inode, int nthreads, walk_visit_fn visit, void *ctx, walk_report_t *report);
+
+#endif
@@ -0,0 +1,318 @@
+#include "writeback.h"
+#include "crc32c.h"
+#include <pthread.h>
+#include <time.h>
+
+typedef struct wb_entry {
+    uint32_t block;
+    uint64_t seq;               // alteração mais recente: a passada só remove se não mudou
+    uint64_t epoch;             // intervalo entre barreiras em que esta versão foi escrita
+    int64_t dirtied_ms;         // quando ficou sujo desde a última gravação
+    struct wb_entry *next;
+    char data[BLOCK_SIZE];
+} wb_entry_t;
+
+/* Bloco escolhido por uma passada de gravação */
+typedef struct {
+    uint32_t block;
+    uint64_t seq;
+    uint64_t epoch;
+    const wb_entry_t *entry;
+} wb_pick_t;
+
+static wb_entry_t *buckets[WRITEBACK_BUCKETS];
+static uint32_t dirty_count = 0;        // lido sem trava no caminho rápido das leituras
+static uint64_t next_seq = 0;
+static uint64_t epoch = 0;              // avança em writebackBarrier
+static int epoch_used = 0;              // algum bloco foi escrito desde a última barreira
+static int64_t meta_dirty_ms = 0;       // 0 = metadados gravados
+static int flusher_running = 0;
+static int stopping = 0;
+static int flush_failed = 0;
+static pthread_t flusher;
+
+/* wb_lock: tabela de blocos sujos, folha na ordem de travas.
+   flush_lock: uma passada de gravação por vez (pega wb_lock por dentro, nunca o contrário) */
+static pthread_mutex_t wb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wb_wake = PTHREAD_COND_INITIALIZER;      // acorda a thread de writeback
+static pthread_cond_t wb_room = PTHREAD_COND_INITIALIZER;      // acorda quem espera espaço
+
+/* Usados só sob flush_lock */
+static wb_pick_t picks[WRITEBACK_DIRTY_LIMIT];
+static char flush_buffer[(size_t)WRITEBACK_DIRTY_LIMIT * BLOCK_SIZE];
+static uint32_t flush_csums[WRITEBACK_DIRTY_LIMIT];
+
+static int64_t nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Versão mais nova do bloco (as versões de um bloco ficam juntas, da mais nova para a mais velha) */
+static wb_entry_t **findSlot(uint32_t block_index) {
+    wb_entry_t **slot = &buckets[block_index % WRITEBACK_BUCKETS];
+    while (*slot && (*slot)->block != block_index) slot = &(*slot)->next;
+    return slot;
+}
+
+/* Uma versão específica, escolhida por uma passada (NULL se já saiu do cache) */
+static wb_entry_t **findVersion(uint32_t block_index, const wb_entry_t *entry) {
+    wb_entry_t **slot = &buckets[block_index % WRITEBACK_BUCKETS];
+    while (*slot && *slot != entry) slot = &(*slot)->next;
+    return *slot ? slot : NULL;
+}
+
+static void removeSlot(wb_entry_t **slot) {
+    wb_entry_t *entry = *slot;
+    *slot = entry->next;
+    free(entry);
+    __atomic_store_n(&dirty_count, dirty_count - 1, __ATOMIC_RELAXED);
+}
+
+/* ---- blocos ---- */
+int writebackPut(uint32_t block_index, const void *data) {
+    pthread_mutex_lock(&wb_lock);
+    wb_entry_t **slot = findSlot(block_index);
+
+    // bloco novo (ou versão nova) com o cache cheio: espera a thread gravar (sem thread, grava aqui)
+    while ((!*slot || (*slot)->epoch != epoch) && dirty_count >= WRITEBACK_DIRTY_LIMIT) {
+        if (flush_failed) {
+            pthread_mutex_unlock(&wb_lock);
+            return -1;
+        }
+        if (flusher_running) {
+            pthread_cond_signal(&wb_wake);
+            pthread_cond_wait(&wb_room, &wb_lock);
+        } else {
+            pthread_mutex_unlock(&wb_lock);
+            writebackFlush(1);
+            pthread_mutex_lock(&wb_lock);
+        }
+        slot = findSlot(block_index);
+    }
+
+    // sujo de antes da última barreira: a versão antiga fica para ser gravada antes das novas
+    wb_entry_t *entry = *slot;
+    if (!entry || entry->epoch != epoch) {
+        entry = malloc(sizeof(*entry));
+        if (!entry) {
+            pthread_mutex_unlock(&wb_lock);
+            return -1;
+        }
+        entry->block = block_index;
+        entry->epoch = epoch;
+        entry->dirtied_ms = nowMs();
+        entry->next = *slot;
+        *slot = entry;
+        __atomic_store_n(&dirty_count, dirty_count + 1, __ATOMIC_RELAXED);
+        if (dirty_count == WRITEBACK_BACKGROUND_BLOCKS) pthread_cond_signal(&wb_wake);
+    }
+    memcpy(entry->data, data, BLOCK_SIZE);
+    entry->seq = ++next_seq;
+    epoch_used = 1;
+    pthread_mutex_unlock(&wb_lock);
+    return 0;
+}
+
+static void barrierLocked(void) {
+    if (epoch_used) {
+        epoch++;
+        epoch_used = 0;
+    }
+}
+
+void writebackBarrier(void) {
+    pthread_mutex_lock(&wb_lock);
+    barrierLocked();
+    pthread_mutex_unlock(&wb_lock);
+}
+
+/* Sob wb_lock ninguém grava bloco: o que o retrato enxerga foi escrito antes da barreira, e todo
+   bloco escrito depois dela fica numa época a partir da devolvida */
+uint64_t writebackSnapshot(void (*snapshot)(void)) {
+    pthread_mutex_lock(&wb_lock);
+    barrierLocked();
+    snapshot();
+    uint64_t limit = epoch;
+    pthread_mutex_unlock(&wb_lock);
+    return limit;
+}
+
+int writebackGet(uint32_t block_index, void *out) {
+    // quem lê segura a trava do inode que o escritor soltou depois de gravar: o contador já
+    // reflete os blocos sujos que ele pode querer
+    if (__atomic_load_n(&dirty_count, __ATOMIC_RELAXED) == 0) return 0;
+
+    pthread_mutex_lock(&wb_lock);
+    wb_entry_t *entry = *findSlot(block_index);
+    if (entry) memcpy(out, entry->data, BLOCK_SIZE);
+    pthread_mutex_unlock(&wb_lock);
+    return entry != NULL;
+}
+
+void writebackDiscard(uint32_t block_index) {
+    if (__atomic_load_n(&dirty_count, __ATOMIC_RELAXED) == 0) return;
+
+    pthread_mutex_lock(&wb_lock);
+    wb_entry_t **slot = findSlot(block_index);
+    if (*slot) {
+        while (*slot && (*slot)->block == block_index) removeSlot(slot);   // todas as versões
+        pthread_cond_broadcast(&wb_room);
+    }
+    pthread_mutex_unlock(&wb_lock);
+}
+
+/* Ordem de gravação: época (barreiras) e, dentro dela, número do bloco */
+static int comparePicks(const void *a, const void *b) {
+    const wb_pick_t *x = a, *y = b;
+    if (x->epoch != y->epoch) return (x->epoch > y->epoch) - (x->epoch < y->epoch);
+    return (x->block > y->block) - (x->block < y->block);
+}
+
+/* Uma passada: copia os blocos escolhidos em ordem de época e de número, grava cada sequência
+   de vizinhos da mesma época com um único pwrite, seguido dos checksums deles, e faz um fsync no
+   fim. Uma passada parcial (all = 0) para na primeira época que ainda tem bloco novo demais: nada
+   escrito depois de uma barreira vai para o disco antes do que foi escrito antes dela. Os blocos
+   alterados durante a gravação continuam sujos para a próxima passada. Só entram as épocas
+   anteriores a before */
+static int flushPass(int all, uint64_t before) {
+    pthread_mutex_lock(&flush_lock);
+
+    pthread_mutex_lock(&wb_lock);
+    int64_t now = nowMs();
+    uint32_t count = 0;
+    for (int b = 0; b < WRITEBACK_BUCKETS; b++)
+        for (wb_entry_t *e = buckets[b]; e && count < WRITEBACK_DIRTY_LIMIT; e = e->next)
+            if (e->epoch < before) picks[count++] = (wb_pick_t){ e->block, e->seq, e->epoch, e };
+    qsort(picks, count, sizeof(wb_pick_t), comparePicks);
+
+    uint32_t kept = 0;
+    uint64_t stop = UINT64_MAX;
+    for (uint32_t i = 0; i < count && picks[i].epoch <= stop; i++) {
+        if (all || now - picks[i].entry->dirtied_ms >= WRITEBACK_EXPIRE_MS) picks[kept++] = picks[i];
+        else stop = picks[i].epoch;
+    }
+    count = kept;
+    for (uint32_t i = 0; i < count; i++)
+        memcpy(flush_buffer + (size_t)i * BLOCK_SIZE, picks[i].entry->data, BLOCK_SIZE);
+    pthread_mutex_unlock(&wb_lock);
+
+    for (uint32_t i = 0; i < count; i++)
+        flush_csums[i] = crc32c(0, flush_buffer + (size_t)i * BLOCK_SIZE, BLOCK_SIZE);
+
+    int res = count > 0 && !disk ? -1 : 0;
+    for (uint32_t i = 0; i < count && res == 0; ) {
+        uint32_t run = 1;
+        while (i + run < count && run < WRITEBACK_MAX_RUN && picks[i + run].epoch == picks[i].epoch &&
+               picks[i + run].block == picks[i].block + run)
+            run++;
+        size_t bytes = (size_t)run * BLOCK_SIZE;
+        off_t offset = off_data_region + (off_t)picks[i].block * BLOCK_SIZE;
+        if (pwrite(fileno(disk), flush_buffer + (size_t)i * BLOCK_SIZE, bytes, offset) != (ssize_t)bytes ||
+            writeBlockCsums(picks[i].block, run, &flush_csums[i]) != 0)
+            res = -1;
+        i += run;
+    }
+    if (count > 0 && res == 0 && fsync(fileno(disk)) != 0) res = -1;
+
+    // o checksum em memória passa a ser o do conteúdo gravado, antes de o bloco sair do cache
+    // (um bloco liberado no meio já saiu, e o checksum dele fica zerado)
+    pthread_mutex_lock(&wb_lock);
+    for (uint32_t i = 0; i < count && res == 0; i++) {
+        wb_entry_t **slot = findVersion(picks[i].block, picks[i].entry);
+        if (!slot) continue;
+        setBlockCsum(picks[i].block, flush_csums[i]);
+        if ((*slot)->seq == picks[i].seq) removeSlot(slot);
+    }
+    flush_failed = res != 0;
+    pthread_cond_broadcast(&wb_room);
+    pthread_mutex_unlock(&wb_lock);
+
+    pthread_mutex_unlock(&flush_lock);
+    return res;
+}
+
+int writebackFlush(int all) {
+    return flushPass(all, UINT64_MAX);
+}
+
+int writebackFlushBefore(uint64_t limit) {
+    return flushPass(1, limit);
+}
+
+/* ---- metadados ---- */
+void writebackMarkMetadata(void) {
+    pthread_mutex_lock(&wb_lock);
+    if (meta_dirty_ms == 0) meta_dirty_ms = nowMs();
+    pthread_mutex_unlock(&wb_lock);
+}
+
+void writebackClearMetadata(void) {
+    pthread_mutex_lock(&wb_lock);
+    meta_dirty_ms = 0;
+    pthread_mutex_unlock(&wb_lock);
+}
+
+/* ---- thread de writeback ---- */
+static void *flusherMain(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&wb_lock);
+    while (!stopping) {
+        // com muitos blocos sujos (e a última passada sem erro) não espera o intervalo
+        if (dirty_count < WRITEBACK_BACKGROUND_BLOCKS || flush_failed) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)WRITEBACK_INTERVAL_MS * 1000000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&wb_wake, &wb_lock, &deadline);
+            if (stopping) break;
+        }
+
+        int pressure = dirty_count >= WRITEBACK_BACKGROUND_BLOCKS;
+        int metadata_due = meta_dirty_ms != 0 && nowMs() - meta_dirty_ms >= WRITEBACK_EXPIRE_MS;
+        pthread_mutex_unlock(&wb_lock);
+
+        // metadados vencidos levam todos os blocos sujos antes deles
+        if (metadata_due) flush_fs();
+        else writebackFlush(pressure);
+
+        pthread_mutex_lock(&wb_lock);
+    }
+    pthread_mutex_unlock(&wb_lock);
+    return NULL;
+}
+
+int writebackStart(void) {
+    pthread_mutex_lock(&wb_lock);
+    int res = 0;
+    if (!flusher_running) {
+        stopping = 0;
+        flush_failed = 0;
+        res = pthread_create(&flusher, NULL, flusherMain, NULL) == 0 ? 0 : -1;
+        flusher_running = res == 0;
+    }
+    pthread_mutex_unlock(&wb_lock);
+    return res;
+}
+
+/* Para a thread; o que ainda estiver sujo fica para quem chamou (flush_fs no unmount) */
+void writebackStop(void) {
+    pthread_mutex_lock(&wb_lock);
+    if (!flusher_running) {
+        pthread_mutex_unlock(&wb_lock);
+        return;
+    }
+    stopping = 1;
+    pthread_cond_signal(&wb_wake);
+    pthread_mutex_unlock(&wb_lock);
+
+    pthread_join(flusher, NULL);
+
+    // quem esperava espaço passa a gravar por conta própria
+    pthread_mutex_lock(&wb_lock);
+    flusher_running = 0;
+    pthread_cond_broadcast(&wb_room);
+    pthread_mutex_unlock(&wb_lock);
+}
@@ -0,0 +1,47 @@
+#ifndef WRITEBACK_H
+#define WRITEBACK_H
+#include "fs.h"
+
+/* Cache de escrita (write-back): writeBlock só copia o bloco para cá e volta, e uma thread de
+   writeback grava no disco os blocos sujos há mais de WRITEBACK_EXPIRE_MS, ordenados por número e
+   juntando os vizinhos num único pwrite, com um fsync por passada. O checksum de cada bloco é
+   gravado pela mesma passada, logo depois dele. Os metadados pedidos por
+   sync_fs envelhecem do mesmo jeito: flush_fs tira um retrato deles junto com uma barreira, grava
+   os blocos sujos de antes dela e só então o retrato, para que não apontem para dados que ainda
+   não chegaram ao disco.
+   Acima de WRITEBACK_BACKGROUND_BLOCKS sujos a thread grava tudo sem esperar a idade; só acima de
+   WRITEBACK_DIRTY_LIMIT quem escreve espera a thread abrir espaço */
+#define WRITEBACK_BUCKETS 4096
+#define WRITEBACK_DIRTY_LIMIT 8192          // 4 MB de blocos sujos
+#define WRITEBACK_BACKGROUND_BLOCKS 2048
+#define WRITEBACK_EXPIRE_MS 1000
+#define WRITEBACK_INTERVAL_MS 200
+#define WRITEBACK_MAX_RUN 256               // blocos por pwrite
+
+int writebackStart(void);
+void writebackStop(void);
+
+/* Guarda a cópia suja do bloco (esperando a thread se o limite foi atingido) */
+int writebackPut(uint32_t block_index, const void *data);
+/* Copia o bloco para out se ele está sujo no cache; retorna 1 se copiou */
+int writebackGet(uint32_t block_index, void *out);
+/* Esquece a cópia suja de um bloco liberado */
+void writebackDiscard(uint32_t block_index);
+
+/* Barreira de ordem: tudo o que foi escrito antes chega ao disco antes de qualquer bloco escrito
+   depois. Não espera nada; um bloco reescrito depois da barreira guarda as duas versões */
+void writebackBarrier(void);
+/* Barreira com snapshot() chamada no mesmo instante, sem nenhum bloco escrito no meio. Retorna a
+   primeira época posterior à barreira, para writebackFlushBefore */
+uint64_t writebackSnapshot(void (*snapshot)(void));
+
+/* Grava os blocos sujos (all = 0: só os que passaram da idade) */
+int writebackFlush(int all);
+/* Grava todos os blocos sujos das épocas anteriores a limit */
+int writebackFlushBefore(uint64_t limit);
+
+/* Metadados alterados em memória: a thread chama flush_fs quando eles envelhecem */
+void writebackMarkMetadata(void);
+void writebackClearMetadata(void);
+
+#endif